@@ -0,0 +1,320 @@
+/**
+* @file bench/bench.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+
+#include <unistd.h>
+
+#include <clang-c/Index.h>
+
+#include "clang_tool.hpp"
+#include "clang_resource_dir.hpp"
+#include "corpus.hpp"
+
+namespace {
+    /** Latency samples of all operations in microseconds */
+    std::map<std::string, std::vector<double>> samples;
+
+    /** Runs fn and records its latency as op */
+    void measure(const char* op, const std::function<void()>& fn) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+
+        samples[op].push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    /** Returns the p-th percentile of sorted values */
+    double percentile(const std::vector<double>& sorted, double p) {
+        size_t idx = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+        return sorted[idx];
+    }
+
+    /** Returns resident set size in bytes */
+    uint64_t rss() {
+        std::ifstream statm("/proc/self/statm");
+        uint64_t size = 0, resident = 0;
+
+        statm >> size >> resident;
+        return resident * sysconf(_SC_PAGESIZE);
+    }
+
+    /** Returns the value of --name=value, or def */
+    uint32_t option(int argc, char** argv, const char* name, uint32_t def) {
+        size_t len = strlen(name);
+
+        for (int i = 1; i < argc; ++i) {
+            if (strncmp(argv[i], "--", 2) == 0 && strncmp(argv[i]+2, name, len) == 0 && argv[i][2+len] == '=')
+                return strtoul(argv[i]+3+len, nullptr, 10);
+        }
+
+        return def;
+    }
+
+    /** Returns the value of --name=value as a string, or an empty string */
+    std::string string_option(int argc, char** argv, const char* name) {
+        size_t len = strlen(name);
+
+        for (int i = 1; i < argc; ++i) {
+            if (strncmp(argv[i], "--", 2) == 0 && strncmp(argv[i]+2, name, len) == 0 && argv[i][2+len] == '=')
+                return argv[i]+3+len;
+        }
+
+        return "";
+    }
+
+    /** Returns the number following "key": in line, or 0 */
+    double json_number(const std::string& line, const std::string& key) {
+        std::string::size_type pos = line.find("\""+key+"\":");
+        return pos == std::string::npos ? 0 : strtod(line.c_str() + pos + key.size() + 3, nullptr);
+    }
+
+    /** Reads mean and p50 of each operation from the output of an earlier run */
+    std::map<std::string, std::pair<double, double>> load_baseline(const std::string& path) {
+        std::map<std::string, std::pair<double, double>> ret;
+        std::ifstream in(path.c_str());
+        std::string line;
+
+        while (std::getline(in, line)) {
+            if (line.compare(0, 7, "{\"op\":\"") != 0)
+                continue;
+
+            std::string op = line.substr(7, line.find('"', 7) - 7);
+            ret[op] = std::make_pair(json_number(line, "mean_us"), json_number(line, "p50_us"));
+        }
+
+        return ret;
+    }
+
+    /// Arguments for full parses, timed as op
+    struct parse_case {
+        const char* op;
+        std::vector<std::string> args;
+    };
+
+    /** Parses every file of c once with args, records the latency as op unless op is null */
+    void parse_pass(CXIndex idx, const char* op, const bench::corpus& c, const std::vector<std::string>& args) {
+        std::vector<const char*> argv;
+        for (auto &a : args) {
+            argv.push_back(a.c_str());
+        }
+
+        for (auto &f : c.files) {
+            auto parse = [&]{
+                CXTranslationUnit unit = clang_parseTranslationUnit(idx, f.path.c_str(), argv.data(), argv.size(),
+                    nullptr, 0, CXTranslationUnit_None);
+
+                if (unit)
+                    clang_disposeTranslationUnit(unit);
+            };
+
+            if (op)
+                measure(op, parse);
+            else
+                parse();
+        }
+    }
+
+    /**
+     * Parses every file with libclang directly for each case
+     *
+     * Bypasses the tool so the arguments are exactly those of the case. Every case runs once
+     * untimed to warm the file cache, afterwards the order of the cases rotates each iteration
+     * so no case profits from always running after another.
+     */
+    void parse_cases(const std::vector<parse_case>& cases, const bench::corpus& c, uint32_t iterations) {
+        CXIndex idx = clang_createIndex(0, 0);
+
+        for (auto &pc : cases) {
+            parse_pass(idx, nullptr, c, pc.args);
+        }
+
+        for (uint32_t i = 0; i < iterations; ++i) {
+            for (size_t k = 0; k < cases.size(); ++k) {
+                const parse_case& pc = cases[(i + k) % cases.size()];
+                parse_pass(idx, pc.op, c, pc.args);
+            }
+        }
+
+        clang_disposeIndex(idx);
+    }
+
+    /** Returns content of path */
+    std::string read_file(const std::string& path) {
+        std::ifstream in(path.c_str());
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+}
+
+/**
+ * Benchmarks the tool against a synthetic project
+ *
+ * Options: --files, --depth, --classes, --methods, --templates, --seed, --iterations and
+ * --workers, e.g. --files=50. Prints one JSON object per line so results of different
+ * commits can be compared with standard tools. With --baseline=<file> the speedup of each
+ * operation over an earlier run is printed as well.
+ *
+ * Full parses are timed with and without the detected -resource-dir (parse_resource_dir /
+ * parse_no_resource_dir) and with the formerly hardcoded clang 3.x include paths
+ * (parse_legacy_includes), after an untimed warm-up pass and in alternating order. With
+ * --workers=N all units are sharded across N worker processes, compare against an
+ * in-process run with --baseline.
+ */
+int main(int argc, char** argv) {
+    bench::corpus_options o;
+    o.files = option(argc, argv, "files", 20);
+    o.depth = option(argc, argv, "depth", 4);
+    o.classes = option(argc, argv, "classes", 10);
+    o.methods = option(argc, argv, "methods", 20);
+    o.templates = option(argc, argv, "templates", 1) != 0;
+    o.seed = option(argc, argv, "seed", 1);
+    uint32_t iterations = option(argc, argv, "iterations", 5);
+    uint32_t workers = option(argc, argv, "workers", 0);
+
+    char tmp[] = "/tmp/clang_tool_bench_XXXXXX";
+    if (!mkdtemp(tmp)) {
+        std::cerr << "Unable to create corpus directory" << std::endl;
+        return 1;
+    }
+
+    std::string dir(tmp);
+    bench::corpus c = bench::generate_corpus(dir, o);
+
+    std::cout << "{\"config\":{\"files\":" << o.files << ",\"depth\":" << o.depth << ",\"classes\":" << o.classes
+              << ",\"methods\":" << o.methods << ",\"templates\":" << o.templates << ",\"seed\":" << o.seed
+              << ",\"iterations\":" << iterations << ",\"workers\":" << workers << "}}" << std::endl;
+
+    // header lookups with the detected resource directory, without it and with the include
+    // paths the tool used to guess for clang 3.x
+    std::vector<std::string> parseArgs = {"-x", "c++", "-std=c++11", "-I"+c.include};
+    std::vector<parse_case> cases;
+    cases.push_back({"parse_no_resource_dir", parseArgs});
+
+    std::vector<std::string> legacyArgs = parseArgs;
+    legacyArgs.push_back("-I/usr/include/clang/3.5/include");
+    legacyArgs.push_back("-I/usr/include/clang/3.6/include");
+    legacyArgs.push_back("-I/usr/include/clang/3.7/include");
+    cases.push_back({"parse_legacy_includes", legacyArgs});
+
+    if (!clang::resource_dir().empty()) {
+        parseArgs.push_back("-resource-dir");
+        parseArgs.push_back(clang::resource_dir());
+        cases.push_back({"parse_resource_dir", parseArgs});
+    }
+
+    parse_cases(cases, c, iterations);
+
+    std::cout << "{\"resource_dir\":\"" << clang::resource_dir() << "\"}" << std::endl;
+
+    uint64_t rssBefore = rss();
+
+    {
+        clang::tool tool;
+
+        if (workers && !tool.workers_start(workers)) {
+            std::cerr << "Unable to start " << workers << " workers" << std::endl;
+
+            std::string cmd = "rm -rf '"+dir+"'";
+            if (system(cmd.c_str()) != 0)
+                std::cerr << "Unable to remove " << dir << std::endl;
+
+            return 1;
+        }
+
+        std::string include = "-I"+c.include;
+        const char* args[] = {"-x", "c++", "-std=c++11", include.c_str()};
+        tool.arguments_set(args, 4);
+
+        for (auto &f : c.files) {
+            measure("index_touch", [&]{ tool.index_touch(f.path.c_str()); });
+        }
+
+        for (uint32_t i = 0; i < iterations; ++i) {
+            for (auto &f : c.files) {
+                std::string content = read_file(f.path) + "\n// edit " + std::to_string(i) + "\n";
+
+                measure("reparse_unsaved", [&]{ tool.index_touch_unsaved(f.path.c_str(), content.c_str(), content.size()); });
+                measure("cursor_complete", [&]{ tool.cursor_complete(f.path.c_str(), f.row, f.col); });
+                measure("tu_ast", [&]{ tool.tu_ast(f.path.c_str()); });
+                measure("tu_diagnose", [&]{ tool.tu_diagnose(f.path.c_str()); });
+            }
+        }
+
+        std::stringstream speedups;
+        uint64_t units = 0;
+        for (auto &u : tool.index_status()) {
+            units += u.second[CXTUResourceUsage_Combined];
+        }
+
+        // units live in the workers, there is nothing to save in-process
+        if (!workers) {
+            std::string index = dir+"/index_";
+            measure("index_save", [&]{ tool.index_save(index.c_str()); });
+            measure("index_load", [&]{ tool.index_load(index.c_str()); });
+        }
+
+        auto baseline = load_baseline(string_option(argc, argv, "baseline"));
+
+        for (auto &s : samples) {
+            std::vector<double>& v = s.second;
+            std::sort(v.begin(), v.end());
+
+            double sum = 0;
+            for (double d : v)
+                sum += d;
+
+            auto base = baseline.find(s.first);
+            if (base != baseline.end() && sum > 0 && percentile(v, 50) > 0) {
+                speedups << "{\"speedup\":{\"op\":\"" << s.first
+                         << "\",\"mean\":" << base->second.first / (sum / v.size())
+                         << ",\"p50\":" << base->second.second / percentile(v, 50) << "}}" << std::endl;
+            }
+
+            std::cout << "{\"op\":\"" << s.first << "\",\"count\":" << v.size()
+                      << ",\"mean_us\":" << sum / v.size()
+                      << ",\"p50_us\":" << percentile(v, 50)
+                      << ",\"p90_us\":" << percentile(v, 90)
+                      << ",\"p99_us\":" << percentile(v, 99)
+                      << ",\"max_us\":" << v.back() << "}" << std::endl;
+        }
+
+        std::cout << "{\"memory\":{\"units_bytes\":" << units << ",\"rss_bytes\":" << rss()
+                  << ",\"rss_delta_bytes\":" << static_cast<int64_t>(rss() - rssBefore) << "}}" << std::endl;
+
+        std::cout << speedups.str();
+    }
+
+    // remove the corpus, index files included
+    std::string cmd = "rm -rf '"+dir+"'";
+    return system(cmd.c_str()) == 0 ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+/**
+* @file bench/corpus.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <fstream>
+#include <random>
+
+#include <sys/stat.h>
+
+#include "corpus.hpp"
+
+namespace bench {
+    namespace {
+        /** Returns name of class i in header level */
+        std::string class_name(uint32_t level, uint32_t i) {
+            return "c"+std::to_string(level)+"_"+std::to_string(i);
+        }
+
+        /** Writes header of the given level, it includes the next level */
+        void write_header(const std::string& path, uint32_t level, const corpus_options& o, std::mt19937& rng) {
+            std::ofstream out(path.c_str());
+
+            out << "#pragma once\n\n";
+            if (level + 1 < o.depth)
+                out << "#include \"level_" << level + 1 << ".hpp\"\n\n";
+            else
+                out << "#include <vector>\n#include <string>\n#include <map>\n\n";
+
+            out << "namespace corpus {\n";
+
+            for (uint32_t c = 0; c < o.classes; ++c) {
+                out << "    /** Class " << c << " of level " << level << " */\n";
+                out << "    class " << class_name(level, c) << " {\n    public:\n";
+
+                for (uint32_t m = 0; m < o.methods; ++m) {
+                    // method_0 is called by the sources, keep its signature fixed
+                    uint32_t kind = m == 0 ? 0 : rng() % 3;
+                    out << "        /** Method " << m << " */\n";
+
+                    if (kind == 0) {
+                        out << "        int method_" << m << "(int a, int b) const { return a * " << rng() % 100 << " + b; }\n";
+                    } else if (kind == 1) {
+                        out << "        std::string method_" << m << "(const std::string& s) { return s + \"" << m << "\"; }\n";
+                    } else {
+                        out << "        std::vector<int> method_" << m << "() const;\n";
+                    }
+                }
+
+                out << "    private:\n        int mValue;\n        std::map<std::string, int> mMap;\n    };\n\n";
+            }
+
+            if (o.templates) {
+                for (uint32_t c = 0; c < o.classes; ++c) {
+                    out << "    template <typename T, int N = " << c << ">\n";
+                    out << "    struct t" << level << "_" << c << " {\n";
+                    out << "        T values[N + 1];\n";
+                    out << "        template <typename U> U convert(const U& u) const { return u + static_cast<U>(values[0]); }\n";
+                    out << "        T sum() const { T r = T(); for (int i = 0; i <= N; ++i) r += values[i]; return r; }\n";
+                    out << "    };\n\n";
+                    out << "    typedef t" << level << "_" << c << "<double, " << rng() % 8 << "> t" << level << "_" << c << "_d;\n\n";
+                }
+            }
+
+            out << "}\n";
+        }
+
+        /** Writes source file n, returns the completion position */
+        corpus_file write_source(const std::string& path, uint32_t n, const corpus_options& o, std::mt19937& rng) {
+            std::ofstream out(path.c_str());
+            uint32_t row = 1;
+
+            out << "#include \"level_0.hpp\"\n\n"; row += 2;
+            out << "namespace corpus {\n"; row += 1;
+
+            for (uint32_t f = 0; f < o.classes; ++f) {
+                uint32_t level = rng() % o.depth;
+                uint32_t c = rng() % o.classes;
+
+                out << "    int function_" << n << "_" << f << "(int x) {\n";
+                out << "        " << class_name(level, c) << " obj;\n";
+                out << "        int r = obj.method_0(x, " << f << ");\n";
+                out << "        for (int i = 0; i < x; ++i) r += i * " << rng() % 10 << ";\n";
+                row += 4;
+
+                if (o.templates) {
+                    out << "        t" << level << "_" << c << "_d t;\n";
+                    out << "        r += static_cast<int>(t.convert(t.sum()));\n";
+                    row += 2;
+                }
+
+                out << "        return r;\n";
+                out << "    }\n\n";
+                row += 3;
+            }
+
+            // completion target, col is right after "obj."
+            out << "    void complete_" << n << "() {\n"; row += 1;
+            out << "        " << class_name(0, 0) << " obj;\n"; row += 1;
+            out << "        obj.method_0(1, 2);\n";
+            out << "    }\n}\n";
+
+            return {path, row, 13};
+        }
+    }
+
+    corpus generate_corpus(const std::string& directory, const corpus_options& options) {
+        corpus_options o = options;
+        if (o.depth == 0)
+            o.depth = 1;
+
+        if (o.classes == 0)
+            o.classes = 1;
+
+        if (o.methods == 0)
+            o.methods = 1;
+
+        std::mt19937 rng(o.seed);
+        std::string include = directory+"/include";
+
+        mkdir(directory.c_str(), 0755);
+        mkdir(include.c_str(), 0755);
+
+        for (uint32_t level = 0; level < o.depth; ++level) {
+            write_header(include+"/level_"+std::to_string(level)+".hpp", level, o, rng);
+        }
+
+        corpus ret{include, {}};
+        for (uint32_t n = 0; n < o.files; ++n) {
+            ret.files.push_back(write_source(directory+"/source_"+std::to_string(n)+".cpp", n, o, rng));
+        }
+
+        return ret;
+    }
+}
@@ -0,0 +1,68 @@
+/**
+* @file bench/corpus.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_BENCH_CORPUS_HPP_
+#define _RD_BENCH_CORPUS_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace bench {
+    /** Shape of a synthetic project */
+    struct corpus_options {
+        /// Number of source files
+        uint32_t files;
+        /// Length of the header include chain every source file pulls in
+        uint32_t depth;
+        /// Classes per header
+        uint32_t classes;
+        /// Methods per class
+        uint32_t methods;
+        /// Whether headers contain class templates and their instantiations
+        bool templates;
+        /// Seed for the generator, equal seeds produce equal projects
+        uint32_t seed;
+    };
+
+    /** Generated source file */
+    struct corpus_file {
+        /// Absolute path
+        std::string path;
+        /// Position right after a member access, for code completion
+        uint32_t row;
+        uint32_t col;
+    };
+
+    /** Generated project */
+    struct corpus {
+        /// Directory to add as include path
+        std::string include;
+        /// All source files
+        std::vector<corpus_file> files;
+    };
+
+    /** Writes a synthetic project to directory, which is created if needed */
+    corpus generate_corpus(const std::string& directory, const corpus_options& options);
+}
+
+#endif /* _RD_BENCH_CORPUS_HPP_ */
@@ -0,0 +1,79 @@
+/**
+* @file clang_background_worker.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "clang_background_worker.hpp"
+
+namespace clang {
+    background_worker::background_worker() : mSeq(0), mStop(false) {
+        mThread = std::thread(&background_worker::run, this);
+    }
+
+    void background_worker::stop() {
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            mStop = true;
+        }
+
+        mCond.notify_one();
+
+        if (mThread.joinable())
+            mThread.join();
+    }
+
+    void background_worker::push(uint64_t priority, task_t task) {
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            mQueue.push({priority, mSeq++, std::move(task)});
+        }
+
+        mCond.notify_one();
+    }
+
+    void background_worker::clear() {
+        std::lock_guard<std::mutex> l(mMutex);
+        mQueue = std::priority_queue<entry>();
+    }
+
+    size_t background_worker::size() {
+        std::lock_guard<std::mutex> l(mMutex);
+        return mQueue.size();
+    }
+
+    void background_worker::run() {
+        std::unique_lock<std::mutex> l(mMutex);
+
+        while (true) {
+            mCond.wait(l, [this]{ return mStop || !mQueue.empty(); });
+
+            if (mStop)
+                return;
+
+            task_t task = std::move(const_cast<entry&>(mQueue.top()).task);
+            mQueue.pop();
+
+            // run without holding the queue lock so tasks can queue more work
+            l.unlock();
+            task();
+            l.lock();
+        }
+    }
+}
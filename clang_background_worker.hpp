@@ -0,0 +1,89 @@
+/**
+* @file clang_background_worker.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_BACKGROUND_WORKER_HPP_
+#define _RD_CLANG_BACKGROUND_WORKER_HPP_
+
+#include <queue>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <cstdint>
+
+#include "noncopyable.hpp"
+
+namespace clang {
+    /** Runs tasks on a single background thread, highest priority first */
+    class background_worker : private noncopyable {
+    public:
+        /// Type for a single task
+        typedef std::function<void()> task_t;
+
+        /** Starts the worker thread */
+        background_worker();
+
+        /** Stops the worker */
+        ~background_worker() {
+            stop();
+        }
+
+        /** Stops the worker, waits for the current task and drops all pending ones */
+        void stop();
+
+        /** Queues a task, tasks with equal priority run in order */
+        void push(uint64_t priority, task_t task);
+
+        /** Drops all pending tasks */
+        void clear();
+
+        /** Returns number of pending tasks */
+        size_t size();
+    private:
+        /** Queue entry */
+        struct entry {
+            uint64_t priority;
+            uint64_t seq;
+            task_t task;
+
+            bool operator<(const entry& e) const {
+                if (priority != e.priority)
+                    return priority < e.priority;
+
+                return seq > e.seq;
+            }
+        };
+
+        std::priority_queue<entry> mQueue;
+        uint64_t mSeq;
+        bool mStop;
+        std::mutex mMutex;
+        std::condition_variable mCond;
+        std::thread mThread;
+
+        /** Thread main loop */
+        void run();
+    };
+}
+
+#endif /* _RD_CLANG_BACKGROUND_WORKER_HPP_ */
@@ -0,0 +1,219 @@
+/**
+* @file clang_compilation_database.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <cstring>
+
+#include <clang-c/Index.h>
+#include <clang-c/CXCompilationDatabase.h>
+
+#include "sha1.hpp"
+#include "util.hpp"
+#include "clang_resource_dir.hpp"
+#include "clang_compilation_database.hpp"
+
+namespace clang {
+    namespace {
+        /** Returns arguments appended to every set */
+        const std::vector<std::string>& builtin_arguments() {
+            static const std::vector<std::string> args = resource_dir().empty()
+                ? std::vector<std::string>()
+                : std::vector<std::string>{"-resource-dir", resource_dir()};
+
+            return args;
+        }
+
+        /** Returns the clang version, queried only once */
+        const std::string& clang_version() {
+            static const std::string version = cx2std(clang_getClangVersion());
+            return version;
+        }
+
+        /** Makes path absolute relative to dir */
+        std::string absolute(const std::string& dir, const std::string& path) {
+            if (path.empty() || path[0] == '/' || dir.empty())
+                return path;
+
+            return dir + "/" + path;
+        }
+
+        /** Returns true if arg is -o<path>, i.e. an output file joined to the option */
+        bool joined_output(const std::string& arg) {
+            // clang options which merely start with -o, matched before -o by the driver
+            static const char* options[] = {"-objc-isystem", "-objcmt-", "-object", "-order_file"};
+
+            if (arg.size() <= 2 || arg.compare(0, 2, "-o") != 0)
+                return false;
+
+            for (auto opt : options) {
+                if (arg.compare(0, strlen(opt), opt) == 0)
+                    return false;
+            }
+
+            return true;
+        }
+
+        /** Converts a compile command to the arguments we pass to clang */
+        std::vector<std::string> command_arguments(CXCompileCommand cmd, const std::string& dir, const std::string& file) {
+            // options taking a path as separate argument, matched by exact name
+            static const char* path_options[] = {"-I", "-isystem", "-iquote", "-include", "-include-pch", "-F"};
+            // options also accepting the path joined to them, longest first so prefixes don't shadow
+            static const char* joined_options[] = {"-isystem", "-iquote", "-include", "-I", "-F"};
+
+            std::vector<std::string> ret;
+            uint32_t n = clang_CompileCommand_getNumArgs(cmd);
+            ret.reserve(n);
+
+            // first argument is the compiler itself
+            for (uint32_t i = 1; i < n; ++i) {
+                std::string arg = cx2std(clang_CompileCommand_getArg(cmd, i));
+
+                // drop everything tied to the actual compilation
+                if (arg == "-c")
+                    continue;
+
+                if (arg == "-o") {
+                    ++i;
+                    continue;
+                }
+
+                if (joined_output(arg) || absolute(dir, arg) == file)
+                    continue;
+
+                // path options are relative to the working directory of the command
+                bool handled = false;
+                for (auto opt : path_options) {
+                    if (arg != opt)
+                        continue;
+
+                    ret.push_back(arg);
+                    if (i+1 < n)
+                        ret.push_back(absolute(dir, cx2std(clang_CompileCommand_getArg(cmd, ++i))));
+
+                    handled = true;
+                    break;
+                }
+
+                for (auto opt : joined_options) {
+                    size_t len = strlen(opt);
+                    if (handled || arg.size() <= len || arg.compare(0, len, opt) != 0)
+                        continue;
+
+                    // other options sharing the prefix, e.g. -include-pch or -isystem-after
+                    if (arg[len] == '-')
+                        break;
+
+                    ret.push_back(arg.substr(0, len) + absolute(dir, arg.substr(len)));
+                    handled = true;
+                }
+
+                if (!handled)
+                    ret.push_back(std::move(arg));
+            }
+
+            return ret;
+        }
+    }
+
+    argument_set::argument_set(std::vector<std::string> args) : mArgs(std::move(args)) {
+        mPtrs.reserve(mArgs.size());
+        for (auto &arg : mArgs) {
+            mPtrs.push_back(arg.c_str());
+        }
+
+        // create a hash constsisting of:
+        // [1] All compiler arguments
+        // [2] Current clang version
+        std::string src = join(mArgs.begin(), mArgs.end(), '.');
+        src.append(clang_version());
+
+        unsigned char hash_binary[21] = {'\0'};
+        char hash[41] = {'\0'};
+        sha1::calc(src.c_str(), src.size(), hash_binary);
+        sha1::toHexString(hash_binary, hash);
+
+        mHash = hash;
+    }
+
+    compilation_database::compilation_database() {
+        set_default({});
+    }
+
+    argument_set_shared compilation_database::intern(const std::vector<std::string>& args) {
+        std::vector<std::string> full(args);
+        full.insert(full.end(), builtin_arguments().begin(), builtin_arguments().end());
+
+        std::string key;
+        for (auto &arg : full) {
+            key.append(arg);
+            key += '\0';
+        }
+
+        auto it = mSets.find(key);
+        if (it != mSets.end())
+            return it->second;
+
+        argument_set_shared set = std::make_shared<argument_set>(std::move(full));
+        mSets.insert(std::make_pair(std::move(key), set));
+        return set;
+    }
+
+    void compilation_database::set_default(const std::vector<std::string>& args) {
+        mDefault = intern(args);
+    }
+
+    void compilation_database::set(const std::string& path, const std::vector<std::string>& args) {
+        mFiles[path] = intern(args);
+    }
+
+    argument_set_shared compilation_database::find(const std::string& path) {
+        auto it = mFiles.find(path);
+        if (it != mFiles.end())
+            return it->second;
+
+        return mDefault;
+    }
+
+    int32_t compilation_database::load(const char* directory) {
+        CXCompilationDatabase_Error error;
+        CXCompilationDatabase db = clang_CompilationDatabase_fromDirectory(directory, &error);
+
+        if (error != CXCompilationDatabase_NoError)
+            return -1;
+
+        CXCompileCommands cmds = clang_CompilationDatabase_getAllCompileCommands(db);
+        uint32_t n = clang_CompileCommands_getSize(cmds);
+        mFiles.reserve(mFiles.size() + n);
+
+        for (uint32_t i = 0; i < n; ++i) {
+            CXCompileCommand cmd = clang_CompileCommands_getCommand(cmds, i);
+            std::string dir = cx2std(clang_CompileCommand_getDirectory(cmd));
+            std::string file = absolute(dir, cx2std(clang_CompileCommand_getFilename(cmd)));
+
+            mFiles[file] = intern(command_arguments(cmd, dir, file));
+        }
+
+        clang_CompileCommands_dispose(cmds);
+        clang_CompilationDatabase_dispose(db);
+
+        return n;
+    }
+}
@@ -0,0 +1,109 @@
+/**
+* @file clang_compilation_database.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_COMPILATION_DATABASE_HPP_
+#define _RD_CLANG_COMPILATION_DATABASE_HPP_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+#include "noncopyable.hpp"
+
+namespace clang {
+    /** An immutable list of compiler arguments, shared by all units compiled with it */
+    class argument_set : private noncopyable {
+    public:
+        /** Creates a new set, also calculates its fingerprint */
+        argument_set(std::vector<std::string> args);
+
+        /** Returns pointer to the arguments as expected by clang_parseTranslationUnit */
+        const char* const* data() const {
+            return mPtrs.data();
+        }
+
+        /** Returns number of arguments */
+        int size() const {
+            return mPtrs.size();
+        }
+
+        /** Returns the arguments */
+        const std::vector<std::string>& args() const {
+            return mArgs;
+        }
+
+        /** Returns sha1 of all arguments and the clang version */
+        const std::string& hash() const {
+            return mHash;
+        }
+    private:
+        std::vector<std::string> mArgs;
+        std::vector<const char*> mPtrs;
+        std::string mHash;
+    };
+
+    /// Type for a shared argument set
+    typedef std::shared_ptr<const argument_set> argument_set_shared;
+
+    /**
+     * Maps files to the arguments they are compiled with.
+     *
+     * Argument sets are interned, files with identical flags point to the same set. Files
+     * without an entry use the default set.
+     */
+    class compilation_database : private noncopyable {
+    public:
+        /** Constructor */
+        compilation_database();
+
+        /** Returns an interned set for args */
+        argument_set_shared intern(const std::vector<std::string>& args);
+
+        /** Sets the arguments used for files without an entry */
+        void set_default(const std::vector<std::string>& args);
+
+        /** Returns the default arguments */
+        argument_set_shared get_default() {
+            return mDefault;
+        }
+
+        /** Sets the arguments for a single file */
+        void set(const std::string& path, const std::vector<std::string>& args);
+
+        /** Returns the arguments for path */
+        argument_set_shared find(const std::string& path);
+
+        /** Loads compile_commands.json from directory, returns number of entries or -1 on error */
+        int32_t load(const char* directory);
+    private:
+        /// Interned sets, key are the arguments joined by '\0'
+        std::unordered_map<std::string, argument_set_shared> mSets;
+        /// File -> arguments
+        std::unordered_map<std::string, argument_set_shared> mFiles;
+        /// Arguments for everything else
+        argument_set_shared mDefault;
+    };
+}
+
+#endif /* _RD_CLANG_COMPILATION_DATABASE_HPP_ */
@@ -0,0 +1,68 @@
+/**
+* @file clang_cursor_query.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_CURSOR_QUERY_
+#define _RD_CLANG_CURSOR_QUERY_
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include "clang_location.hpp"
+
+namespace clang {
+    /** Information a cursor query asks for, can be combined */
+    enum cursor_query_kind : uint32_t {
+        cursor_query_type = 1,
+        cursor_query_declaration = 2,
+        cursor_query_definition = 4,
+        cursor_query_all = 7
+    };
+
+    /** Single position of a batched cursor query */
+    struct cursor_query {
+        uint32_t row;
+        uint32_t col;
+        uint32_t kinds;
+    };
+
+    /** Answer to a cursor query, fields not asked for stay empty */
+    struct cursor_answer {
+        std::string type;
+        location declaration;
+        location definition;
+    };
+
+    /** Everything known about the entity under a cursor, e.g. for a tooltip */
+    struct cursor_details {
+        std::string type;
+        std::string canonical_type;
+        location declaration;
+        location definition;
+        std::string usr;
+        std::string kind;
+        std::string brief;
+        std::string doc;
+    };
+}
+
+#endif /* _RD_CLANG_CURSOR_QUERY_ */
@@ -23,24 +23,37 @@
 #include "clang_diagnostic.hpp"
 
 namespace clang {
-    std::string diagnostic_text(CXDiagnostic diag) {
-        if (!diag)
-            return "";
+    namespace {
+        /** Appends text of diag and all its children to out */
+        void append_diagnostic_text(CXDiagnostic diag, uint32_t options, std::string& out) {
+            CXString txt = clang_formatDiagnostic(diag, options);
+            const char* str = clang_getCString(txt);
 
-        std::string txt = cx2std(clang_formatDiagnostic(diag, clang_defaultDiagnosticDisplayOptions()));
+            if (str)
+                out.append(str);
 
-        CXDiagnosticSet children = clang_getChildDiagnostics(diag);
-        if (!children)
-            return txt;
+            clang_disposeString(txt);
 
-        uint32_t child_num = clang_getNumDiagnosticsInSet(children);
-        if (!child_num)
-            return txt;
+            CXDiagnosticSet children = clang_getChildDiagnostics(diag);
+            if (!children)
+                return;
 
-        for (uint32_t i = 0; i < child_num; ++i) {
-            txt.append(diagnostic_text(clang_getDiagnosticInSet( children, i )));
+            uint32_t child_num = clang_getNumDiagnosticsInSet(children);
+            for (uint32_t i = 0; i < child_num; ++i) {
+                append_diagnostic_text(clang_getDiagnosticInSet( children, i ), options, out);
+            }
         }
+    }
+
+    std::string diagnostic_text(CXDiagnostic diag) {
+        if (!diag)
+            return "";
+
+        // build everything in one string instead of concatenating temporaries per child
+        std::string txt;
+        txt.reserve(256);
+        append_diagnostic_text(diag, clang_defaultDiagnosticDisplayOptions(), txt);
 
         return txt;
     }
-}
\ No newline at end of file
+}
@@ -24,6 +24,9 @@
 #define _RD_CLANG_DIAGNOSTIC_CACHE_
 
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
 #include <clang-c/Index.h>
 
 #include "clang_location.hpp"
@@ -38,9 +41,21 @@ namespace clang {
         std::string summary;
     };
 
+    /// Type for an immutable list of diagnostics shared between callers
+    typedef std::shared_ptr<const std::vector<diagnostic>> diagnostic_list_shared;
+
+    /// Type for a map of file -> diagnostics located in that file
+    typedef std::unordered_map<std::string, std::vector<diagnostic>> diagnostic_map;
+
     /** Builds the diagnostic string from a CXDiagnostic */
     std::string diagnostic_text(CXDiagnostic diag);
 
+    /** Returns a key identifying equal diagnostics, e.g. to diff two lists */
+    inline std::string diagnostic_key(const diagnostic& d) {
+        return d.loc.file+":"+std::to_string(d.loc.row)+":"+std::to_string(d.loc.col)+":"
+            +std::to_string(d.severity)+":"+d.text;
+    }
+
     /** Returns small diagnostic summary */
     inline std::string diagnostic_summary(CXDiagnostic diag) {
         return cx2std(clang_getDiagnosticSpelling(diag));
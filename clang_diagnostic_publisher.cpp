@@ -0,0 +1,138 @@
+/**
+* @file clang_diagnostic_publisher.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "clang_diagnostic_publisher.hpp"
+
+namespace clang {
+    void diagnostic_publisher::subscribe(callback_t callback, std::chrono::milliseconds interval) {
+        unsubscribe();
+
+        std::lock_guard<std::mutex> l(mMutex);
+        mCallback = std::move(callback);
+        mInterval = interval;
+        mStop = false;
+        mPublished.clear();
+        mThread = std::thread(&diagnostic_publisher::run, this);
+    }
+
+    void diagnostic_publisher::unsubscribe() {
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            mStop = true;
+            mCallback = nullptr;
+            mDirty.clear();
+        }
+
+        mCond.notify_one();
+
+        if (mThread.joinable())
+            mThread.join();
+    }
+
+    void diagnostic_publisher::changed(const std::string& path) {
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            if (!mCallback)
+                return;
+
+            mDirty.insert(path);
+        }
+
+        mCond.notify_one();
+    }
+
+    void diagnostic_publisher::run() {
+        std::unique_lock<std::mutex> l(mMutex);
+
+        while (true) {
+            mCond.wait(l, [this]{ return mStop || !mDirty.empty(); });
+
+            // let bursts of reparses settle before publishing
+            if (!mStop)
+                mCond.wait_for(l, mInterval, [this]{ return mStop; });
+
+            if (mStop)
+                return;
+
+            std::unordered_set<std::string> dirty;
+            dirty.swap(mDirty);
+            callback_t callback = mCallback;
+
+            // fetch without holding the lock so units can keep reporting changes
+            l.unlock();
+            for (auto &path : dirty) {
+                publish(path, callback);
+            }
+            l.lock();
+        }
+    }
+
+    void diagnostic_publisher::publish(const std::string& path, const callback_t& callback) {
+        diagnostic_list_shared current = mFetch(path);
+        diagnostic_list_shared& previous = mPublished[path];
+
+        if (current == previous)
+            return;
+
+        std::unordered_map<std::string, uint32_t> old;
+        if (previous) {
+            for (auto &d : *previous) {
+                ++old[diagnostic_key(d)];
+            }
+        }
+
+        std::vector<diagnostic> added;
+        if (current) {
+            for (auto &d : *current) {
+                auto it = old.find(diagnostic_key(d));
+
+                if (it != old.end() && it->second) {
+                    --it->second;
+                } else {
+                    added.push_back(d);
+                }
+            }
+        }
+
+        // whatever is left in old is gone
+        std::vector<diagnostic> removed;
+        if (previous) {
+            for (auto &d : *previous) {
+                auto it = old.find(diagnostic_key(d));
+
+                if (it->second) {
+                    --it->second;
+                    removed.push_back(d);
+                }
+            }
+        }
+
+        if (current) {
+            previous = current;
+        } else {
+            mPublished.erase(path);
+        }
+
+        if (!added.empty() || !removed.empty())
+            callback(path, added, removed);
+    }
+}
@@ -0,0 +1,91 @@
+/**
+* @file clang_diagnostic_publisher.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_DIAGNOSTIC_PUBLISHER_HPP_
+#define _RD_CLANG_DIAGNOSTIC_PUBLISHER_HPP_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <condition_variable>
+
+#include "noncopyable.hpp"
+#include "clang_diagnostic.hpp"
+
+namespace clang {
+    /**
+     * Pushes diagnostic changes to a subscriber
+     *
+     * Units report when they have been reparsed, after a quiet interval the publisher fetches
+     * their diagnostics on its own thread and hands only the difference to the last update
+     * to the callback. Bursts of reparses of the same unit result in a single update.
+     */
+    class diagnostic_publisher : private noncopyable {
+    public:
+        /// Returns current diagnostics of a unit, nullptr if it is not on the index anymore
+        typedef std::function<diagnostic_list_shared(const std::string& path)> fetch_t;
+
+        /// Receives diagnostics which appeared and disappeared since the last update of path
+        typedef std::function<void(const std::string& path, const std::vector<diagnostic>& added,
+            const std::vector<diagnostic>& removed)> callback_t;
+
+        /** Constructor */
+        diagnostic_publisher(fetch_t fetch) : mFetch(std::move(fetch)), mInterval(0), mStop(false) {}
+
+        /** Stops publishing */
+        ~diagnostic_publisher() {
+            unsubscribe();
+        }
+
+        /** Starts publishing to callback, replaces any previous subscriber */
+        void subscribe(callback_t callback, std::chrono::milliseconds interval);
+
+        /** Stops publishing, must not be called from within the callback */
+        void unsubscribe();
+
+        /** Marks diagnostics of path as changed, cheap if there is no subscriber */
+        void changed(const std::string& path);
+    private:
+        fetch_t mFetch;
+        callback_t mCallback;
+        std::chrono::milliseconds mInterval;
+        std::unordered_set<std::string> mDirty;
+        std::unordered_map<std::string, diagnostic_list_shared> mPublished;
+        bool mStop;
+        std::mutex mMutex;
+        std::condition_variable mCond;
+        std::thread mThread;
+
+        /** Thread main loop */
+        void run();
+
+        /** Publishes the difference between the last update of path and its current diagnostics */
+        void publish(const std::string& path, const callback_t& callback);
+    };
+}
+
+#endif /* _RD_CLANG_DIAGNOSTIC_PUBLISHER_HPP_ */
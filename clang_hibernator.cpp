@@ -0,0 +1,99 @@
+/**
+* @file clang_hibernator.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "clang_hibernator.hpp"
+
+namespace clang {
+    hibernator::hibernator(sweep_t sweep) : mSweep(std::move(sweep)), mSeq(0), mIdle(0), mStop(false) {
+        const char* tmp = getenv("TMPDIR");
+        std::string dir = std::string(tmp ? tmp : "/tmp") + "/clang_tool_XXXXXX";
+
+        if (mkdtemp(&dir[0]))
+            mDir = dir;
+    }
+
+    hibernator::~hibernator() {
+        stop();
+
+        // units remove their own files when they are destroyed
+        if (!mDir.empty())
+            rmdir(mDir.c_str());
+    }
+
+    void hibernator::start(std::chrono::milliseconds idle) {
+        stop();
+
+        if (idle.count() <= 0)
+            return;
+
+        std::lock_guard<std::mutex> l(mMutex);
+        mIdle = idle;
+        mStop = false;
+        mThread = std::thread(&hibernator::run, this);
+    }
+
+    void hibernator::stop() {
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            mStop = true;
+        }
+
+        mCond.notify_one();
+
+        if (mThread.joinable())
+            mThread.join();
+    }
+
+    std::string hibernator::file() {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        if (mDir.empty())
+            return "";
+
+        return mDir+"/"+std::to_string(mSeq++)+".unit";
+    }
+
+    void hibernator::run() {
+        std::unique_lock<std::mutex> l(mMutex);
+
+        // units go to sleep at most a quarter of the idle period late
+        std::chrono::milliseconds interval = std::max(mIdle / 4, std::chrono::milliseconds(1));
+
+        while (true) {
+            mCond.wait_for(l, interval, [this]{ return mStop; });
+
+            if (mStop)
+                return;
+
+            std::chrono::milliseconds idle = mIdle;
+
+            l.unlock();
+            mSweep(idle);
+            l.lock();
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/**
+* @file clang_hibernator.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_HIBERNATOR_HPP_
+#define _RD_CLANG_HIBERNATOR_HPP_
+
+#include <string>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include <cstdint>
+
+#include "noncopyable.hpp"
+
+namespace clang {
+    /**
+     * Periodically asks the owner to hibernate idle units
+     *
+     * Hibernated units are saved into a private directory and disposed, they are loaded
+     * again on their next access. The sweep runs on its own thread a few times per idle
+     * period, the actual saving is left to the callback.
+     */
+    class hibernator : private noncopyable {
+    public:
+        /// Hibernates all units which have not been accessed for the given time
+        typedef std::function<void(std::chrono::milliseconds idle)> sweep_t;
+
+        /** Creates a private directory for hibernated units */
+        hibernator(sweep_t sweep);
+
+        /** Stops sweeping and removes the directory */
+        ~hibernator();
+
+        /** Starts sweeping for units idle for longer than idle, 0 stops */
+        void start(std::chrono::milliseconds idle);
+
+        /** Stops sweeping, must not be called from within the callback */
+        void stop();
+
+        /** Returns a new file name in the private directory, empty if it could not be created */
+        std::string file();
+    private:
+        sweep_t mSweep;
+        std::string mDir;
+        uint64_t mSeq;
+        std::chrono::milliseconds mIdle;
+        bool mStop;
+        std::mutex mMutex;
+        std::condition_variable mCond;
+        std::thread mThread;
+
+        /** Thread main loop */
+        void run();
+    };
+}
+
+#endif /* _RD_CLANG_HIBERNATOR_HPP_ */
@@ -0,0 +1,69 @@
+/**
+* @file clang_job_queue.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "clang_job_queue.hpp"
+
+namespace clang {
+    job_queue::job_queue(uint32_t n) : mStop(false) {
+        for (uint32_t i = 0; i < n; ++i) {
+            mThreads.emplace_back(&job_queue::run, this);
+        }
+    }
+
+    job_queue::~job_queue() {
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            mStop = true;
+        }
+
+        mCond.notify_all();
+        for (auto &t : mThreads) {
+            t.join();
+        }
+    }
+
+    void job_queue::push(job_t job) {
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            mJobs.push_back(std::move(job));
+        }
+
+        mCond.notify_one();
+    }
+
+    void job_queue::run() {
+        std::unique_lock<std::mutex> l(mMutex);
+
+        while (true) {
+            mCond.wait(l, [this]{ return mStop || !mJobs.empty(); });
+            if (mJobs.empty())
+                return;
+
+            job_t job = std::move(mJobs.front());
+            mJobs.pop_front();
+
+            l.unlock();
+            job();
+            l.lock();
+        }
+    }
+}
@@ -0,0 +1,63 @@
+/**
+* @file clang_job_queue.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_JOB_QUEUE_HPP_
+#define _RD_CLANG_JOB_QUEUE_HPP_
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <cstdint>
+
+#include "noncopyable.hpp"
+
+namespace clang {
+    /** Runs jobs on a fixed number of threads in the order they have been queued */
+    class job_queue : private noncopyable {
+    public:
+        /// Type for a single job
+        typedef std::function<void()> job_t;
+
+        /** Starts n threads */
+        job_queue(uint32_t n);
+
+        /** Runs all queued jobs and stops the threads */
+        ~job_queue();
+
+        /** Queues a job */
+        void push(job_t job);
+    private:
+        std::deque<job_t> mJobs;
+        std::vector<std::thread> mThreads;
+        bool mStop;
+        std::mutex mMutex;
+        std::condition_variable mCond;
+
+        /** Thread main loop */
+        void run();
+    };
+}
+
+#endif /* _RD_CLANG_JOB_QUEUE_HPP_ */
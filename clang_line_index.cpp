@@ -0,0 +1,114 @@
+/**
+* @file clang_line_index.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#include "clang_line_index.hpp"
+
+namespace clang {
+    namespace {
+        /** Returns the number of UTF-16 code units needed for the sequence starting with lead */
+        uint32_t utf16_units(unsigned char lead) {
+            if ((lead & 0xC0) == 0x80)
+                return 0; // continuation byte
+
+            return lead >= 0xF0 ? 2 : 1; // 4 byte sequences need a surrogate pair
+        }
+    }
+
+    line_index::line_index(unsaved_buffer_shared buffer) : mBuffer(std::move(buffer)) {
+        if (!mBuffer)
+            return;
+
+        const char* data = mBuffer->data();
+        const char* end = data + mBuffer->size();
+
+        // memchr is vectorized by the libc, much faster than a byte loop
+        mOffsets.push_back(0);
+        for (const char* p = data; (p = static_cast<const char*>(memchr(p, '\n', end - p))) != nullptr; ++p) {
+            mOffsets.push_back(p - data + 1);
+        }
+    }
+
+    uint32_t line_index::row_begin(uint32_t row) const {
+        if (row == 0 || mOffsets.empty())
+            return 0;
+
+        return row <= mOffsets.size() ? mOffsets[row-1] : mBuffer->size();
+    }
+
+    uint32_t line_index::row_end(uint32_t row) const {
+        if (mOffsets.empty())
+            return 0;
+
+        return row < mOffsets.size() ? mOffsets[row] : mBuffer->size();
+    }
+
+    uint32_t line_index::offset(uint32_t row, uint32_t col) const {
+        uint32_t begin = row_begin(row);
+        return std::min(begin + (col ? col-1 : 0), row_end(row));
+    }
+
+    std::pair<uint32_t, uint32_t> line_index::position(uint32_t offset) const {
+        if (mOffsets.empty())
+            return std::make_pair(1, 1);
+
+        // first row starting after offset
+        auto it = std::upper_bound(mOffsets.begin(), mOffsets.end(), offset);
+        uint32_t row = it - mOffsets.begin();
+
+        return std::make_pair(row, offset - mOffsets[row-1] + 1);
+    }
+
+    uint32_t line_index::utf16_column(uint32_t row, uint32_t col) const {
+        uint32_t begin = row_begin(row);
+        uint32_t end = offset(row, col);
+        uint32_t ret = 1;
+
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(mBuffer ? mBuffer->data() : nullptr);
+        for (uint32_t i = begin; i < end; ++i) {
+            ret += utf16_units(data[i]);
+        }
+
+        return ret;
+    }
+
+    uint32_t line_index::byte_column(uint32_t row, uint32_t utf16) const {
+        uint32_t begin = row_begin(row);
+        uint32_t end = row_end(row);
+        uint32_t units = 1;
+        uint32_t i = begin;
+
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(mBuffer ? mBuffer->data() : nullptr);
+        while (i < end && units < utf16) {
+            units += utf16_units(data[i]);
+
+            // skip the continuation bytes of the sequence
+            ++i;
+            while (i < end && utf16_units(data[i]) == 0)
+                ++i;
+        }
+
+        return i - begin + 1;
+    }
+}
@@ -0,0 +1,83 @@
+/**
+* @file clang_line_index.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_LINE_INDEX_HPP_
+#define _RD_CLANG_LINE_INDEX_HPP_
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+#include "noncopyable.hpp"
+#include "clang_unsaved_buffer.hpp"
+
+namespace clang {
+    /**
+     * Start offsets of all lines in a buffer
+     *
+     * Converts between byte offsets, rows / byte columns as used by libclang and UTF-16
+     * columns as used by most editors. Rows and columns are 1-based, offsets 0-based.
+     * The index is immutable and keeps the buffer alive, it can be used without locking.
+     */
+    class line_index : private noncopyable {
+    public:
+        /** Indexes buffer, a null buffer results in an empty index */
+        explicit line_index(unsaved_buffer_shared buffer);
+
+        /** Returns the indexed buffer */
+        const unsaved_buffer_shared& buffer() const {
+            return mBuffer;
+        }
+
+        /** Returns number of rows */
+        uint32_t rows() const {
+            return mOffsets.size();
+        }
+
+        /** Returns offset of the first byte of row */
+        uint32_t row_begin(uint32_t row) const;
+
+        /** Returns offset after the last byte of row, including its newline */
+        uint32_t row_end(uint32_t row) const;
+
+        /** Returns offset of row and byte column, columns past the row end are clamped */
+        uint32_t offset(uint32_t row, uint32_t col) const;
+
+        /** Returns row and byte column of offset */
+        std::pair<uint32_t, uint32_t> position(uint32_t offset) const;
+
+        /** Converts a byte column to an UTF-16 column */
+        uint32_t utf16_column(uint32_t row, uint32_t col) const;
+
+        /** Converts an UTF-16 column to a byte column */
+        uint32_t byte_column(uint32_t row, uint32_t utf16) const;
+    private:
+        unsaved_buffer_shared mBuffer;
+        std::vector<uint32_t> mOffsets;
+    };
+
+    /// Type for a shared line index
+    typedef std::shared_ptr<const line_index> line_index_shared;
+}
+
+#endif /* _RD_CLANG_LINE_INDEX_HPP_ */
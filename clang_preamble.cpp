@@ -0,0 +1,139 @@
+/**
+* @file clang_preamble.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <cstring>
+
+#include "sha1.hpp"
+#include "util.hpp"
+#include "clang_preamble.hpp"
+
+namespace clang {
+    uint32_t preamble_length(const char* data, uint32_t size) {
+        uint32_t end = 0;
+        uint32_t i = 0;
+
+        while (i < size) {
+            char c = data[i];
+
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v') {
+                ++i;
+            } else if (c == '/' && i+1 < size && data[i+1] == '/') {
+                // line comment
+                while (i < size && data[i] != '\n')
+                    ++i;
+            } else if (c == '/' && i+1 < size && data[i+1] == '*') {
+                // block comment
+                const char* close = static_cast<const char*>(memmem(data+i+2, size-i-2, "*/", 2));
+                i = close ? (close - data) + 2 : size;
+            } else if (c == '#') {
+                // directive, including escaped newlines
+                while (i < size && data[i] != '\n') {
+                    if (data[i] == '\\' && i+1 < size && data[i+1] == '\n')
+                        ++i;
+
+                    ++i;
+                }
+
+                end = i;
+            } else {
+                break;
+            }
+        }
+
+        return end;
+    }
+
+    namespace {
+        /** Returns sha1 of src as hex string */
+        std::string sha1_hex(const std::string& src) {
+            unsigned char hash_binary[21] = {'\0'};
+            char hash[41] = {'\0'};
+            sha1::calc(src.c_str(), src.size(), hash_binary);
+            sha1::toHexString(hash_binary, hash);
+
+            return hash;
+        }
+
+        /** Data passed through clang_getInclusions */
+        struct inclusion_data {
+            std::string src;
+            uint32_t headers;
+            const unsaved_files* files;
+        };
+
+        void visitor_inclusions(CXFile file, CXSourceLocation* stack, unsigned len, CXClientData client_data) {
+            if (len == 0)
+                return; // main file
+
+            inclusion_data* d = reinterpret_cast<inclusion_data*>(client_data);
+            std::string name = cx2std(clang_getFileName(file));
+            d->src.append(name);
+
+            // unsaved headers are identified by their content, buffers may be reused at the same address
+            if (d->files) {
+                for (auto &f : d->files->entries) {
+                    if (f.first == name) {
+                        d->src.append(f.second->data(), f.second->size());
+                        ++d->headers;
+                        return;
+                    }
+                }
+            }
+
+            d->src.append(std::to_string(clang_getFileTime(file)));
+            ++d->headers;
+        }
+    }
+
+    preamble_key preamble_key_from_unit(CXTranslationUnit unit, const std::string& name,
+        const unsaved_buffer_shared& buffer, const unsaved_files_shared& files)
+    {
+        inclusion_data d{"", 0, files.get()};
+        preamble_key ret{"", "", 0, 0, false};
+
+        // region of the main file
+        unsaved_buffer_shared main = buffer ? buffer : unsaved_buffer::map(name.c_str());
+        if (main) {
+            ret.size = preamble_length(main->data(), main->size());
+            d.src.append(main->data(), ret.size);
+
+            ret.region = sha1_hex(d.src);
+            ret.quoted = d.src.find('"') != std::string::npos;
+        }
+
+        // all headers
+        clang_getInclusions(unit, visitor_inclusions, &d);
+        ret.headers = d.headers;
+
+        ret.hash = sha1_hex(d.src);
+        return ret;
+    }
+
+    std::string preamble_group(const preamble_key& key, const std::string& path, const std::string& args_hash) {
+        std::string src = key.region + args_hash;
+
+        if (key.quoted)
+            src.append(path.substr(0, path.find_last_of('/')+1));
+
+        return sha1_hex(src);
+    }
+}
@@ -0,0 +1,77 @@
+/**
+* @file clang_preamble.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_PREAMBLE_HPP_
+#define _RD_CLANG_PREAMBLE_HPP_
+
+#include <string>
+#include <cstdint>
+
+#include <clang-c/Index.h>
+
+#include "clang_unsaved_overlay.hpp"
+
+namespace clang {
+    /** State of a translation unit's precompiled preamble */
+    enum class preamble_state {
+        none = 0,     // not built yet
+        building = 1, // region or headers changed, rebuild pending
+        ready = 2,    // up to date
+        shared = 3    // parsed with a precompiled header shared with other units
+    };
+
+    /**
+     * Returns the length of the preamble in data
+     *
+     * The preamble is the leading block of comments and preprocessor directives, this is
+     * the part clang precompiles.
+     */
+    uint32_t preamble_length(const char* data, uint32_t size);
+
+    /** Identifies a preamble, changes whenever the region or one of its headers changes */
+    struct preamble_key {
+        /// sha1 of region, header names and modification times or unsaved content
+        std::string hash;
+        /// sha1 of the region only
+        std::string region;
+        /// Length of the preamble region in bytes
+        uint32_t size;
+        /// Number of headers included by the unit
+        uint32_t headers;
+        /// Whether the region contains quoted includes, which are relative to the file
+        bool quoted;
+    };
+
+    /** Calculates the preamble key of unit, files are the unsaved files it has been parsed with */
+    preamble_key preamble_key_from_unit(CXTranslationUnit unit, const std::string& name,
+        const unsaved_buffer_shared& buffer, const unsaved_files_shared& files);
+
+    /**
+     * Returns the group of a preamble, units in the same group can share one precompiled header
+     *
+     * Units are grouped by region and arguments, regions with quoted includes are additionally
+     * grouped by directory.
+     */
+    std::string preamble_group(const preamble_key& key, const std::string& path, const std::string& args_hash);
+}
+
+#endif /* _RD_CLANG_PREAMBLE_HPP_ */
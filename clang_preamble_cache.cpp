@@ -0,0 +1,233 @@
+/**
+* @file clang_preamble_cache.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <fstream>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "util.hpp"
+#include "clang_preamble_cache.hpp"
+#include "clang_stats.hpp"
+
+namespace clang {
+    namespace {
+        /** Data passed through clang_getInclusions */
+        struct header_data {
+            CXTranslationUnit unit;
+            std::vector<std::pair<std::string, time_t>>* headers;
+            bool guarded;
+        };
+
+        /** Collects all headers of a unit with their modification time, checks for include guards */
+        void visitor_headers(CXFile file, CXSourceLocation* stack, unsigned len, CXClientData client_data) {
+            if (len == 0)
+                return; // main file
+
+            header_data* d = reinterpret_cast<header_data*>(client_data);
+            d->headers->push_back(std::make_pair(cx2std(clang_getFileName(file)), clang_getFileTime(file)));
+
+            // covers #pragma once as well
+            if (!clang_isFileMultipleIncludeGuarded(d->unit, file))
+                d->guarded = false;
+        }
+
+        /** Returns the header language matching source */
+        const char* header_language(const std::string& source) {
+            std::string::size_type dot = source.find_last_of('.');
+
+            if (dot != std::string::npos && source.compare(dot, std::string::npos, ".c") == 0)
+                return "c-header";
+
+            return "c++-header";
+        }
+    }
+
+    shared_preamble::~shared_preamble() {
+        unlink(mPch.c_str());
+        unlink((mPch+".h").c_str());
+    }
+
+    uint64_t shared_preamble::size() const {
+        struct stat st;
+        if (!built() || stat(mPch.c_str(), &st) != 0)
+            return 0;
+
+        return st.st_size;
+    }
+
+    bool shared_preamble::stale(const unsaved_files_shared& files) const {
+        for (auto &header : mHeaders) {
+            struct stat st;
+            if (stat(header.first.c_str(), &st) != 0 || st.st_mtime != header.second)
+                return true;
+
+            for (auto &f : files->entries) {
+                if (f.first == header.first)
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool shared_preamble::build(CXIndex idx, const std::string& region, const std::string& source, const argument_set& args) {
+        std::string header = mPch+".h";
+        std::string dir = source.substr(0, source.find_last_of('/')+1);
+        std::string iquote = "-iquote" + (dir.empty() ? std::string(".") : dir);
+
+        std::ofstream output(header.c_str(), std::ofstream::out | std::ofstream::binary);
+        output << region;
+        output.close();
+
+        std::vector<const char*> argv(args.data(), args.data()+args.size());
+        argv.push_back("-x");
+        argv.push_back(header_language(source));
+        argv.push_back(iquote.c_str());
+
+        CXTranslationUnit unit;
+        {
+            scoped_timer t(stat_op::clang_parse);
+            unit = clang_parseTranslationUnit(
+                idx, header.c_str(), argv.data(), argv.size(), nullptr, 0,
+                CXTranslationUnit_Incomplete | CXTranslationUnit_ForSerialization
+            );
+        }
+
+        if (!unit)
+            return false;
+
+        // a header with errors would just replicate them into every unit
+        bool ok = true;
+        for (uint32_t i = 0; i < clang_getNumDiagnostics(unit) && ok; ++i) {
+            CXDiagnostic diag = clang_getDiagnostic(unit, i);
+            ok = clang_getDiagnosticSeverity(diag) < CXDiagnostic_Error;
+            clang_disposeDiagnostic(diag);
+        }
+
+        // units still include their headers after the shared preamble, which only works with guards
+        if (ok) {
+            header_data d{unit, &mHeaders, true};
+            clang_getInclusions(unit, visitor_headers, &d);
+            ok = d.guarded;
+        }
+
+        if (ok) {
+            scoped_timer t(stat_op::clang_save);
+            ok = clang_saveTranslationUnit(unit, mPch.c_str(), clang_defaultSaveOptions(unit)) == 0;
+        }
+
+        clang_disposeTranslationUnit(unit);
+
+        mBuilt = ok;
+        return ok;
+    }
+
+    preamble_cache::preamble_cache() : mSeq(0) {
+        const char* tmp = getenv("TMPDIR");
+        std::string dir = std::string(tmp ? tmp : "/tmp") + "/clang_tool_XXXXXX";
+
+        if (mkdtemp(&dir[0]))
+            mDir = dir;
+    }
+
+    preamble_cache::~preamble_cache() {
+        mGroups.clear();
+
+        if (!mDir.empty())
+            rmdir(mDir.c_str());
+    }
+
+    shared_preamble_ptr preamble_cache::add(const std::string& path, const std::string& name) {
+        auto it = mMembers.find(path);
+        if (it != mMembers.end() && it->second != name)
+            remove(path);
+
+        group& g = mGroups[name];
+        g.members.insert(path);
+        mMembers[path] = name;
+
+        if (g.members.size() < 2 || g.preamble || g.failed || mDir.empty())
+            return nullptr;
+
+        g.preamble = std::make_shared<shared_preamble>(mDir+"/"+name+"."+std::to_string(mSeq++)+".pch");
+        return g.preamble;
+    }
+
+    void preamble_cache::remove(const std::string& path) {
+        auto it = mMembers.find(path);
+        if (it == mMembers.end())
+            return;
+
+        auto g = mGroups.find(it->second);
+        if (g != mGroups.end()) {
+            g->second.members.erase(path);
+
+            if (g->second.members.empty())
+                mGroups.erase(g);
+        }
+
+        mMembers.erase(it);
+    }
+
+    void preamble_cache::invalidate(const std::string& path) {
+        auto it = mMembers.find(path);
+        if (it == mMembers.end())
+            return;
+
+        group& g = mGroups[it->second];
+        g.preamble = nullptr;
+        g.failed = false;
+    }
+
+    void preamble_cache::clear() {
+        mGroups.clear();
+        mMembers.clear();
+    }
+
+    shared_preamble_ptr preamble_cache::find(const std::string& path) {
+        auto it = mMembers.find(path);
+        if (it == mMembers.end())
+            return nullptr;
+
+        group& g = mGroups[it->second];
+        if (g.members.size() < 2 || !g.preamble || !g.preamble->built())
+            return nullptr;
+
+        return g.preamble;
+    }
+
+    std::vector<std::string> preamble_cache::members(const std::string& name) {
+        auto it = mGroups.find(name);
+        if (it == mGroups.end())
+            return {};
+
+        return std::vector<std::string>(it->second.members.begin(), it->second.members.end());
+    }
+
+    void preamble_cache::failed(const std::string& name) {
+        auto it = mGroups.find(name);
+        if (it != mGroups.end())
+            it->second.failed = true;
+    }
+}
@@ -0,0 +1,139 @@
+/**
+* @file clang_preamble_cache.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_PREAMBLE_CACHE_HPP_
+#define _RD_CLANG_PREAMBLE_CACHE_HPP_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <ctime>
+
+#include <clang-c/Index.h>
+
+#include "noncopyable.hpp"
+#include "clang_compilation_database.hpp"
+#include "clang_unsaved_overlay.hpp"
+
+namespace clang {
+    /** A precompiled header built from a preamble shared by several units */
+    class shared_preamble : private noncopyable {
+    public:
+        /** Constructor, pch is the path the header will be written to */
+        shared_preamble(std::string pch) : mPch(std::move(pch)), mBuilt(false) {}
+
+        /** Removes the precompiled header from disk */
+        ~shared_preamble();
+
+        /** Returns path to the precompiled header */
+        const std::string& pch() const {
+            return mPch;
+        }
+
+        /** Returns size of the precompiled header on disk, 0 if it has not been built */
+        uint64_t size() const;
+
+        /** Returns true if the header has been built */
+        bool built() const {
+            return mBuilt.load();
+        }
+
+        /** Returns true if one of the headers changed on disk or has unsaved content */
+        bool stale(const unsaved_files_shared& files) const;
+
+        /**
+         * Builds the precompiled header from region
+         *
+         * Source is the file the region has been taken from, quoted includes are resolved
+         * relative to it. Units keep including their headers after the precompiled one, so
+         * the build fails if a header has no include guard or #pragma once, e.g. X-macro
+         * headers. Members of a failed group use a preamble of their own.
+         */
+        bool build(CXIndex idx, const std::string& region, const std::string& source, const argument_set& args);
+    private:
+        std::string mPch;
+        std::atomic<bool> mBuilt;
+        std::vector<std::pair<std::string, time_t>> mHeaders;
+    };
+
+    /// Type for a shared preamble
+    typedef std::shared_ptr<shared_preamble> shared_preamble_ptr;
+
+    /**
+     * Keeps track of which units have identical preambles
+     *
+     * As soon as two units share a group, one precompiled header is built for the group and
+     * all members are parsed with -include-pch instead of building their own preamble.
+     */
+    class preamble_cache : private noncopyable {
+    public:
+        /** Creates a private directory for all precompiled headers */
+        preamble_cache();
+
+        /** Removes the directory */
+        ~preamble_cache();
+
+        /**
+         * Makes path a member of group
+         *
+         * Returns the group's preamble if it needs to be built, nullptr otherwise.
+         */
+        shared_preamble_ptr add(const std::string& path, const std::string& group);
+
+        /** Removes path from its group */
+        void remove(const std::string& path);
+
+        /** Drops the preamble of path's group, e.g. because it is stale */
+        void invalidate(const std::string& path);
+
+        /** Removes all groups */
+        void clear();
+
+        /** Returns the built preamble path should be parsed with, nullptr if there is none */
+        shared_preamble_ptr find(const std::string& path);
+
+        /** Returns all members of group */
+        std::vector<std::string> members(const std::string& group);
+
+        /** Marks preamble of group as failed so it is not attempted again until the group changes */
+        void failed(const std::string& group);
+    private:
+        /** Group of units with identical preambles */
+        struct group {
+            group() : failed(false) {}
+
+            std::unordered_set<std::string> members;
+            shared_preamble_ptr preamble;
+            bool failed;
+        };
+
+        std::string mDir;
+        uint64_t mSeq;
+        std::unordered_map<std::string, group> mGroups;
+        std::unordered_map<std::string, std::string> mMembers;
+    };
+}
+
+#endif /* _RD_CLANG_PREAMBLE_CACHE_HPP_ */
@@ -0,0 +1,113 @@
+/**
+* @file clang_resource_dir.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <vector>
+#include <cstdlib>
+#include <climits>
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+
+#include <clang-c/Index.h>
+
+#include "util.hpp"
+#include "clang_resource_dir.hpp"
+
+namespace clang {
+    namespace {
+        /** Returns true if path/include is a directory */
+        bool has_include_dir(const std::string& path) {
+            struct stat st;
+            return stat((path+"/include").c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        /** Returns the directory libclang has been loaded from */
+        std::string library_dir() {
+            Dl_info info;
+            if (!dladdr(reinterpret_cast<void*>(&clang_getClangVersion), &info) || !info.dli_fname)
+                return "";
+
+            char real[PATH_MAX];
+            if (!realpath(info.dli_fname, real))
+                return "";
+
+            std::string ret(real);
+            return ret.substr(0, ret.find_last_of('/'));
+        }
+
+        /** Returns the possible version directory names, e.g. 3.7.1, 3.7 and 3 */
+        std::vector<std::string> versions() {
+            // e.g. "clang version 3.7.1 (tags/RELEASE_371/final)"
+            std::string str = cx2std(clang_getClangVersion());
+            std::string::size_type pos = str.find("version ");
+
+            if (pos == std::string::npos)
+                return {};
+
+            pos += 8;
+            std::string::size_type end = str.find_first_not_of("0123456789.", pos);
+            std::string full = str.substr(pos, end == std::string::npos ? end : end - pos);
+
+            std::vector<std::string> ret;
+            while (!full.empty()) {
+                ret.push_back(full);
+
+                std::string::size_type dot = full.find_last_of('.');
+                if (dot == std::string::npos)
+                    break;
+
+                full.resize(dot);
+            }
+
+            return ret;
+        }
+
+        /** Searches all known locations */
+        std::string detect() {
+            std::vector<std::string> prefixes;
+
+            std::string lib = library_dir();
+            if (!lib.empty()) {
+                prefixes.push_back(lib+"/clang/");        // <prefix>/lib/clang/<version>
+                prefixes.push_back(lib+"/../lib/clang/"); // lib64 installs with headers below lib
+            }
+
+            prefixes.push_back("/usr/lib/clang/");
+            prefixes.push_back("/usr/local/lib/clang/");
+            prefixes.push_back("/usr/include/clang/");
+
+            for (auto &version : versions()) {
+                for (auto &prefix : prefixes) {
+                    if (has_include_dir(prefix+version))
+                        return prefix+version;
+                }
+            }
+
+            return "";
+        }
+    }
+
+    const std::string& resource_dir() {
+        static const std::string dir = detect();
+        return dir;
+    }
+}
@@ -0,0 +1,39 @@
+/**
+* @file clang_resource_dir.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_RESOURCE_DIR_HPP_
+#define _RD_CLANG_RESOURCE_DIR_HPP_
+
+#include <string>
+
+namespace clang {
+    /**
+     * Returns the resource directory matching the loaded libclang
+     *
+     * The directory contains include/ with clang's builtin headers (stddef.h, ...). It is
+     * looked up once, based on clang_getClangVersion and the location of the library.
+     * Returns an empty string if none could be found.
+     */
+    const std::string& resource_dir();
+}
+
+#endif /* _RD_CLANG_RESOURCE_DIR_HPP_ */
@@ -21,27 +21,61 @@
 */
 
 #include <cassert>
+#include <chrono>
 
 #include "clang_translation_unit.hpp"
 #include "clang_ressource_usage.hpp"
 
 namespace clang {
     ressource_usage usage_from_unit(translation_unit_shared u) {
-        ressource_usage ret(CXTUResourceUsage_Last+1, 0); // needs to have n+1 elements
-        auto res = clang_getCXTUResourceUsage(u->ptr());
-        uint32_t all = 0;
+        ressource_usage ret(usage_fields, 0);
+        uint64_t all = 0;
 
-        for (unsigned i = 0; i < res.numEntries; ++i ) {
-            CXTUResourceUsageEntry entry = res.entries[i];
-            assert(entry.kind < (CXTUResourceUsage_Last+1));
+        // hibernated units hold no libclang memory, don't wake them up
+        if (!u->hibernated()) {
+            auto res = clang_getCXTUResourceUsage(u->ptr());
 
-            ret[entry.kind] = entry.amount;
-            all += entry.amount;
-        }
+            for (unsigned i = 0; i < res.numEntries; ++i ) {
+                CXTUResourceUsageEntry entry = res.entries[i];
+                assert(entry.kind < (CXTUResourceUsage_Last+1));
+
+                ret[entry.kind] = entry.amount;
+                all += entry.amount;
+            }
 
-        clang_disposeCXTUResourceUsage(res);
+            clang_disposeCXTUResourceUsage(res);
+        }
 
         ret[0] = all; // CXTUResourceUsage_Combined
+        ret[usage_hibernated] = u->hibernated() ? 1 : 0;
+        ret[usage_preamble_state] = static_cast<uint32_t>(u->preamble());
+        ret[usage_preamble_size] = u->preamble_size();
+        ret[usage_preamble_headers] = u->preamble_headers();
+        ret[usage_tier] = static_cast<uint32_t>(u->tier());
+
+        ret[usage_parses] = u->parses();
+        ret[usage_reparses] = u->reparses();
+        ret[usage_parse_time] = u->parse_time();
+        ret[usage_last_parse_time] = u->last_parse_time();
+        ret[usage_idle] = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - u->last_access()
+        ).count();
+
+        unsaved_buffer_shared unsaved = u->unsaved();
+        ret[usage_unsaved_size] = unsaved ? unsaved->size() : 0;
+
+        shared_preamble_ptr pch = u->pch();
+        ret[usage_pch_size] = pch ? pch->size() : 0;
+
+        ret[usage_queries_complete] = u->query_count(stat_op::cursor_complete);
+        ret[usage_queries_type] = u->query_count(stat_op::cursor_type);
+        ret[usage_queries_declaration] = u->query_count(stat_op::cursor_declaration);
+        ret[usage_queries_definition] = u->query_count(stat_op::cursor_definition);
+        ret[usage_queries_info] = u->query_count(stat_op::cursor_info);
+        ret[usage_queries_batch] = u->query_count(stat_op::cursor_batch);
+        ret[usage_queries_tokens] = u->query_count(stat_op::tu_tokens);
+        ret[usage_queries_ast] = u->query_count(stat_op::tu_ast);
+        ret[usage_queries_diagnose] = u->query_count(stat_op::tu_diagnose);
         return ret;
     }
 }
\ No newline at end of file
@@ -26,6 +26,7 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <cstdint>
 
 #include <clang-c/Index.h>
 
@@ -36,8 +37,52 @@
 static_assert(CXTUResourceUsage_First != 0, "Error ensuring usage consistency");
 
 namespace clang {
-    /// Type for our ressource usage structure
-    typedef std::vector<uint32_t> ressource_usage;
+    /**
+     * Fields of ressource_usage following libclang's CXTUResourceUsageKind values
+     *
+     * Kept in our own namespace so they cannot clash with kinds added by a newer libclang.
+     */
+    enum ressource_field : uint32_t {
+        /// State of the precompiled preamble, see clang::preamble_state
+        usage_preamble_state = CXTUResourceUsage_Last+1,
+        /// Size of the preamble region in bytes
+        usage_preamble_size,
+        /// Number of headers covered by the preamble
+        usage_preamble_headers,
+        /// Tier the unit has been parsed with, see clang::parse_tier
+        usage_tier,
+        /// Number of full parses, including rebuilds with new arguments or preambles
+        usage_parses,
+        /// Number of reparses
+        usage_reparses,
+        /// Time spent in parses and reparses in nanoseconds
+        usage_parse_time,
+        /// Duration of the most recent parse or reparse in nanoseconds
+        usage_last_parse_time,
+        /// Milliseconds since the unit has last been accessed
+        usage_idle,
+        /// Size of the unit's own unsaved content in bytes
+        usage_unsaved_size,
+        /// Size of the shared precompiled header on disk, 0 if the unit uses none
+        usage_pch_size,
+        /// Number of queries per entry point
+        usage_queries_complete,
+        usage_queries_type,
+        usage_queries_declaration,
+        usage_queries_definition,
+        usage_queries_info,
+        usage_queries_batch,
+        usage_queries_tokens,
+        usage_queries_ast,
+        usage_queries_diagnose,
+        /// 1 if the unit has been saved to disk and disposed, memory fields are 0 in that case
+        usage_hibernated,
+        /// Number of fields, keep last
+        usage_fields
+    };
+
+    /// Type for our ressource usage structure, 64 bit so units above 4 GB are reported correctly
+    typedef std::vector<uint64_t> ressource_usage;
 
     /// Type for a map of file -> ressources
     typedef std::unordered_map<std::string, ressource_usage> ressource_map;
@@ -0,0 +1,155 @@
+/**
+* @file clang_session_log.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <algorithm>
+
+#include "clang_session_log.hpp"
+
+namespace clang {
+    namespace {
+        /// Identifies a session log
+        const char magic[4] = {'C', 'T', 'S', 'L'};
+
+        /** Writes value as is */
+        template <typename T>
+        void write(std::ofstream& out, T value) {
+            out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        /** Reads a value written by write */
+        template <typename T>
+        bool read(std::ifstream& in, T& value) {
+            return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+        }
+    }
+
+    bool session_recorder::start(const char* path) {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        if (mOutput.is_open())
+            mOutput.close();
+
+        mOutput.open(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+        if (!mOutput) {
+            mActive.store(false, std::memory_order_relaxed);
+            return false;
+        }
+
+        mOutput.write(magic, sizeof(magic));
+        write<uint32_t>(mOutput, version);
+
+        mStart = std::chrono::steady_clock::now();
+        mActive.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    void session_recorder::stop() {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        mActive.store(false, std::memory_order_relaxed);
+        if (mOutput.is_open())
+            mOutput.close();
+    }
+
+    void session_recorder::record(session_op op, const std::vector<std::string>& strings, const std::vector<uint32_t>& values) {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        // stopped while the record was being built
+        if (!mOutput.is_open())
+            return;
+
+        // taken under the lock so times never go backwards in the log
+        uint64_t time = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - mStart
+        ).count();
+
+        write<uint8_t>(mOutput, static_cast<uint8_t>(op));
+        write<uint64_t>(mOutput, time);
+
+        write<uint32_t>(mOutput, strings.size());
+        for (auto &s : strings) {
+            write<uint32_t>(mOutput, s.size());
+            mOutput.write(s.data(), s.size());
+        }
+
+        write<uint32_t>(mOutput, values.size());
+        for (auto v : values) {
+            write<uint32_t>(mOutput, v);
+        }
+
+        // keep the log usable if the process dies
+        mOutput.flush();
+    }
+
+    bool session_reader::open(const char* path) {
+        mInput.open(path, std::ifstream::in | std::ifstream::binary);
+        if (!mInput)
+            return false;
+
+        // counts and lengths in the log are checked against the size before anything is allocated
+        mInput.seekg(0, std::ifstream::end);
+        mSize = mInput.tellg();
+        mInput.seekg(0, std::ifstream::beg);
+
+        char m[sizeof(magic)];
+        uint32_t v = 0;
+
+        return mInput.read(m, sizeof(m)) && std::equal(m, m+sizeof(m), magic)
+            && read(mInput, v) && v == session_recorder::version;
+    }
+
+    bool session_reader::next(session_record& record) {
+        uint8_t op = 0;
+        uint32_t count = 0;
+
+        if (!read(mInput, op) || op >= static_cast<uint8_t>(session_op::count) || !read(mInput, record.time))
+            return false;
+
+        record.op = static_cast<session_op>(op);
+
+        // every string takes at least its length
+        if (!read(mInput, count) || count > remaining() / sizeof(uint32_t))
+            return false;
+
+        record.strings.resize(count);
+        for (auto &s : record.strings) {
+            uint32_t length = 0;
+            if (!read(mInput, length) || length > remaining())
+                return false;
+
+            s.resize(length);
+            if (length && !mInput.read(&s[0], length))
+                return false;
+        }
+
+        if (!read(mInput, count) || count > remaining() / sizeof(uint32_t))
+            return false;
+
+        record.values.resize(count);
+        for (auto &v : record.values) {
+            if (!read(mInput, v))
+                return false;
+        }
+
+        return true;
+    }
+}
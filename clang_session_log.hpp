@@ -0,0 +1,174 @@
+/**
+* @file clang_session_log.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_SESSION_LOG_HPP_
+#define _RD_CLANG_SESSION_LOG_HPP_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+#include "noncopyable.hpp"
+
+#define S2SMACRO(op__) case session_op::op__: return #op__;
+
+namespace clang {
+    /** Recorded tool calls, values are part of the log format and must not change */
+    enum class session_op : uint8_t {
+        arguments_set = 0,
+        arguments_set_file,
+        arguments_load,
+        index_save,
+        index_load,
+        index_clear,
+        index_touch,
+        index_add,
+        index_touch_unsaved,
+        index_remove,
+        tu_ast,
+        tu_tokens,
+        tu_diagnose,
+        workspace_diagnose,
+        cursor_complete,
+        cursor_type,
+        cursor_declaration,
+        cursor_definition,
+        cursor_info,
+        cursor_batch,
+        index_discard_unsaved,
+        // number of operations, keep last
+        count
+    };
+
+    /** Converts a recorded operation to a string */
+    inline const char* session2str(session_op op) {
+        switch (op) {
+            S2SMACRO(arguments_set)
+            S2SMACRO(arguments_set_file)
+            S2SMACRO(arguments_load)
+            S2SMACRO(index_save)
+            S2SMACRO(index_load)
+            S2SMACRO(index_clear)
+            S2SMACRO(index_touch)
+            S2SMACRO(index_add)
+            S2SMACRO(index_touch_unsaved)
+            S2SMACRO(index_remove)
+            S2SMACRO(tu_ast)
+            S2SMACRO(tu_tokens)
+            S2SMACRO(tu_diagnose)
+            S2SMACRO(workspace_diagnose)
+            S2SMACRO(cursor_complete)
+            S2SMACRO(cursor_type)
+            S2SMACRO(cursor_declaration)
+            S2SMACRO(cursor_definition)
+            S2SMACRO(cursor_info)
+            S2SMACRO(cursor_batch)
+            S2SMACRO(index_discard_unsaved)
+            S2SMACRO(count)
+        }
+
+        return "";
+    }
+
+    /**
+     * Single recorded call
+     *
+     * Strings hold the path first, followed by compiler arguments or the unsaved content.
+     * Values hold row / column pairs, token ranges or (row, col, kinds) triples for batches.
+     */
+    struct session_record {
+        /// Called operation
+        session_op op;
+        /// Microseconds since recording started
+        uint64_t time;
+        /// Path and other string arguments
+        std::vector<std::string> strings;
+        /// Integer arguments
+        std::vector<uint32_t> values;
+    };
+
+    /**
+     * Writes tool calls into a compact binary log
+     *
+     * The log starts with a magic and version, followed by one record per call: op (u8),
+     * time (u64), string count (u32) and length prefixed strings, value count (u32) and the
+     * values, all in host byte order. Records are written when a call starts, so they are
+     * ordered by time even if calls come from different threads.
+     */
+    class session_recorder : private noncopyable {
+    public:
+        /// Log format version
+        static const uint32_t version = 1;
+
+        /** Constructor */
+        session_recorder() : mActive(false) {}
+
+        /** Starts recording to path, truncating it, returns false if it could not be opened */
+        bool start(const char* path);
+
+        /** Stops recording and closes the log */
+        void stop();
+
+        /** Returns true while recording, callers should check this before building a record */
+        bool active() const {
+            return mActive.load(std::memory_order_relaxed);
+        }
+
+        /** Appends a call to the log */
+        void record(session_op op, const std::vector<std::string>& strings, const std::vector<uint32_t>& values = {});
+    private:
+        std::atomic<bool> mActive;
+        std::ofstream mOutput;
+        std::chrono::steady_clock::time_point mStart;
+        std::mutex mMutex;
+    };
+
+    /** Reads a log written by session_recorder */
+    class session_reader : private noncopyable {
+    public:
+        /** Constructor */
+        session_reader() : mSize(0) {}
+
+        /** Opens log at path, returns false if it does not exist or has an unknown format */
+        bool open(const char* path);
+
+        /** Reads the next record, returns false at the end of the log or if it is truncated */
+        bool next(session_record& record);
+    private:
+        std::ifstream mInput;
+        uint64_t mSize;
+
+        /** Returns number of bytes left in the log */
+        uint64_t remaining() {
+            std::streamoff pos = mInput.tellg();
+            return pos < 0 || static_cast<uint64_t>(pos) > mSize ? 0 : mSize - pos;
+        }
+    };
+}
+
+#undef S2SMACRO
+
+#endif /* _RD_CLANG_SESSION_LOG_HPP_ */
@@ -0,0 +1,115 @@
+/**
+* @file clang_stats.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "clang_stats.hpp"
+
+namespace clang {
+    void histogram::record(uint64_t value) {
+        mBuckets[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+        mCount.fetch_add(1, std::memory_order_relaxed);
+        mSum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t max = mMax.load(std::memory_order_relaxed);
+        while (value > max && !mMax.compare_exchange_weak(max, value, std::memory_order_relaxed));
+    }
+
+    void histogram::reset() {
+        for (auto &b : mBuckets) {
+            b.store(0, std::memory_order_relaxed);
+        }
+
+        mCount.store(0, std::memory_order_relaxed);
+        mSum.store(0, std::memory_order_relaxed);
+        mMax.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t histogram::percentile(double p) const {
+        uint64_t total = count();
+        if (total == 0)
+            return 0;
+
+        uint64_t target = static_cast<uint64_t>(total * p / 100.0);
+        if (target == 0)
+            target = 1;
+
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < buckets; ++i) {
+            seen += mBuckets[i].load(std::memory_order_relaxed);
+
+            if (seen >= target)
+                return std::min(bucket_max(i), max());
+        }
+
+        return max();
+    }
+
+    uint32_t histogram::bucket(uint64_t value) {
+        // values below 2^sub_bits get a bucket each
+        if (value < (1ull << sub_bits))
+            return value;
+
+        uint32_t msb = 63 - __builtin_clzll(value);
+        uint32_t shift = msb - sub_bits;
+        uint32_t sub = (value >> shift) & ((1u << sub_bits) - 1);
+
+        return ((shift + 1) << sub_bits) + sub;
+    }
+
+    uint64_t histogram::bucket_max(uint32_t bucket) {
+        if (bucket < (1u << sub_bits))
+            return bucket;
+
+        uint32_t shift = (bucket >> sub_bits) - 1;
+        uint64_t sub = bucket & ((1u << sub_bits) - 1);
+        uint64_t base = ((1ull << sub_bits) | sub) << shift;
+
+        return base + ((1ull << shift) - 1);
+    }
+
+    statistics& statistics::global() {
+        static statistics instance;
+        return instance;
+    }
+
+    std::vector<stat_entry> statistics::summary() const {
+        std::vector<stat_entry> ret;
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(stat_op::count); ++i) {
+            const histogram& h = mOps[i];
+            if (h.count() == 0)
+                continue;
+
+            ret.push_back({
+                static_cast<stat_op>(i), h.count(), h.sum(),
+                h.percentile(50.0), h.percentile(90.0), h.percentile(99.0), h.max()
+            });
+        }
+
+        return ret;
+    }
+
+    void statistics::reset() {
+        for (auto &h : mOps) {
+            h.reset();
+        }
+    }
+}
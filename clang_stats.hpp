@@ -0,0 +1,249 @@
+/**
+* @file clang_stats.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_STATS_HPP_
+#define _RD_CLANG_STATS_HPP_
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+#include "noncopyable.hpp"
+#include "clang_trace.hpp"
+
+#define S2SMACRO(op__) case stat_op::op__: return #op__;
+
+namespace clang {
+    /** Instrumented operations */
+    enum class stat_op {
+        // tool entry points
+        index_touch = 0,
+        index_touch_unsaved,
+        index_add,
+        index_save,
+        index_load,
+        tu_ast,
+        tu_tokens,
+        tu_diagnose,
+        workspace_diagnose,
+        cursor_complete,
+        cursor_type,
+        cursor_declaration,
+        cursor_definition,
+        cursor_info,
+        cursor_batch,
+        // libclang calls
+        clang_parse,
+        clang_reparse,
+        clang_complete,
+        clang_ast_walk,
+        clang_annotate,
+        clang_diagnose,
+        clang_save,
+        clang_load,
+        // time spent waiting for locks
+        lock_tool,
+        lock_unit,
+        // number of operations, keep last
+        count
+    };
+
+    /** Converts an operation to a string */
+    inline const char* stat2str(stat_op op) {
+        switch (op) {
+            S2SMACRO(index_touch)
+            S2SMACRO(index_touch_unsaved)
+            S2SMACRO(index_add)
+            S2SMACRO(index_save)
+            S2SMACRO(index_load)
+            S2SMACRO(tu_ast)
+            S2SMACRO(tu_tokens)
+            S2SMACRO(tu_diagnose)
+            S2SMACRO(workspace_diagnose)
+            S2SMACRO(cursor_complete)
+            S2SMACRO(cursor_type)
+            S2SMACRO(cursor_declaration)
+            S2SMACRO(cursor_definition)
+            S2SMACRO(cursor_info)
+            S2SMACRO(cursor_batch)
+            S2SMACRO(clang_parse)
+            S2SMACRO(clang_reparse)
+            S2SMACRO(clang_complete)
+            S2SMACRO(clang_ast_walk)
+            S2SMACRO(clang_annotate)
+            S2SMACRO(clang_diagnose)
+            S2SMACRO(clang_save)
+            S2SMACRO(clang_load)
+            S2SMACRO(lock_tool)
+            S2SMACRO(lock_unit)
+            S2SMACRO(count)
+        }
+
+        return "";
+    }
+
+    /**
+     * Lock-free latency histogram
+     *
+     * Buckets are log-linear like in HdrHistogram: each power of two is split into 8
+     * sub-buckets, so percentiles are accurate to within 12.5% over the whole range.
+     */
+    class histogram : private noncopyable {
+    public:
+        /// Sub-buckets per power of two, as a power of two
+        static const uint32_t sub_bits = 3;
+        /// Total number of buckets
+        static const uint32_t buckets = (64 - sub_bits + 1) << sub_bits;
+
+        /** Constructor */
+        histogram() {
+            reset();
+        }
+
+        /** Records a single value */
+        void record(uint64_t value);
+
+        /** Resets all counters */
+        void reset();
+
+        /** Returns number of recorded values */
+        uint64_t count() const {
+            return mCount.load(std::memory_order_relaxed);
+        }
+
+        /** Returns sum of all recorded values */
+        uint64_t sum() const {
+            return mSum.load(std::memory_order_relaxed);
+        }
+
+        /** Returns the largest recorded value */
+        uint64_t max() const {
+            return mMax.load(std::memory_order_relaxed);
+        }
+
+        /** Returns the value below which p percent of all values are, e.g. 99.0 */
+        uint64_t percentile(double p) const;
+    private:
+        std::atomic<uint64_t> mBuckets[buckets];
+        std::atomic<uint64_t> mCount;
+        std::atomic<uint64_t> mSum;
+        std::atomic<uint64_t> mMax;
+
+        /** Returns bucket of value */
+        static uint32_t bucket(uint64_t value);
+
+        /** Returns the largest value in bucket */
+        static uint64_t bucket_max(uint32_t bucket);
+    };
+
+    /** Summary of a single operation, times are in nanoseconds */
+    struct stat_entry {
+        stat_op op;
+        uint64_t count;
+        uint64_t total;
+        uint64_t p50;
+        uint64_t p90;
+        uint64_t p99;
+        uint64_t max;
+    };
+
+    /** Process wide latency histograms for all operations */
+    class statistics : private noncopyable {
+    public:
+        /** Returns the global instance */
+        static statistics& global();
+
+        /** Records a single operation which took ns nanoseconds */
+        void record(stat_op op, uint64_t ns) {
+            mOps[static_cast<uint32_t>(op)].record(ns);
+        }
+
+        /** Returns summaries for all operations which have been recorded at least once */
+        std::vector<stat_entry> summary() const;
+
+        /** Resets all histograms */
+        void reset();
+    private:
+        histogram mOps[static_cast<uint32_t>(stat_op::count)];
+    };
+
+    /** Records the lifetime of the timer for op, and as a span if tracing is enabled */
+    class scoped_timer : private noncopyable {
+    public:
+        /** Starts the timer */
+        scoped_timer(stat_op op) : mOp(op), mStart(std::chrono::steady_clock::now()) {}
+
+        /** Returns the time since the timer has been started in nanoseconds */
+        uint64_t elapsed() const {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStart).count();
+        }
+
+        /** Records the elapsed time */
+        ~scoped_timer() {
+            auto end = std::chrono::steady_clock::now();
+            statistics::global().record(mOp, std::chrono::duration_cast<std::chrono::nanoseconds>(end - mStart).count());
+
+            if (tracer::enabled())
+                tracer::span(stat2str(mOp), mStart, end);
+        }
+    private:
+        stat_op mOp;
+        std::chrono::steady_clock::time_point mStart;
+    };
+
+    /** Like std::lock_guard, but records the time spent waiting for the mutex as op */
+    class timed_lock : private noncopyable {
+    public:
+        /** Locks mutex */
+        timed_lock(std::mutex& mutex, stat_op op) : mMutex(mutex) {
+            // uncontended locks are not worth a clock read
+            if (mMutex.try_lock()) {
+                statistics::global().record(op, 0);
+                return;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            mMutex.lock();
+            auto end = std::chrono::steady_clock::now();
+
+            statistics::global().record(op, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+
+            // only contended locks show up in the trace
+            if (tracer::enabled())
+                tracer::span(stat2str(op), start, end);
+        }
+
+        /** Unlocks mutex */
+        ~timed_lock() {
+            mMutex.unlock();
+        }
+    private:
+        std::mutex& mMutex;
+    };
+}
+
+#undef S2SMACRO
+
+#endif /* _RD_CLANG_STATS_HPP_ */
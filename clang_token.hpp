@@ -0,0 +1,43 @@
+/**
+* @file clang_token.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_TOKEN_
+#define _RD_CLANG_TOKEN_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace clang {
+    /** Single annotated token, e.g. for semantic highlighting */
+    struct token {
+        /// Byte offset in the file
+        uint32_t offset;
+        /// Length in bytes
+        uint32_t length;
+        /// Kind of the cursor the token belongs to, see CXCursorKind
+        uint16_t cursor;
+        /// Kind of the token itself, see CXTokenKind
+        uint8_t kind;
+    };
+}
+
+#endif /* _RD_CLANG_TOKEN_ */
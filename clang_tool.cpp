@@ -20,127 +20,1216 @@
 *   limitations under the License.
 */
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
 
 #include "util.hpp"
 #include "clang_tool.hpp"
 
 namespace clang {
+    void tool::arguments_set(const char** args, uint32_t size) {
+        if (mRecorder.active())
+            mRecorder.record(session_op::arguments_set, std::vector<std::string>(args, args+size));
+
+        // kept for workers started later
+        std::vector<std::string> v(args, args+size);
+        remember_arguments("default", [v](worker_pool& p){ p.arguments_set(v); });
+
+        if (pooled())
+            mPool->arguments_set(v);
+
+        timed_lock l(mMutex, stat_op::lock_tool);
+
+        mDatabase.set_default(std::vector<std::string>(args, args+size));
+        invalidate_arguments();
+    }
+
+    void tool::arguments_set(const char* path, const char** args, uint32_t size) {
+        if (mRecorder.active()) {
+            std::vector<std::string> strings(1, path);
+            strings.insert(strings.end(), args, args+size);
+            mRecorder.record(session_op::arguments_set_file, strings);
+        }
+
+        std::string p(path);
+        std::vector<std::string> v(args, args+size);
+        remember_arguments("file:"+p, [p, v](worker_pool& pool){ pool.arguments_set(p, v); });
+
+        if (pooled())
+            mPool->arguments_set(p, v);
+
+        timed_lock l(mMutex, stat_op::lock_tool);
+
+        mDatabase.set(path, std::vector<std::string>(args, args+size));
+        invalidate_arguments();
+    }
+
+    int32_t tool::arguments_load(const char* directory) {
+        if (mRecorder.active())
+            mRecorder.record(session_op::arguments_load, {directory});
+
+        std::string dir(directory);
+        remember_arguments("load:"+dir, [dir](worker_pool& p){ p.arguments_load(dir); });
+
+        int32_t workers = pooled() ? mPool->arguments_load(dir) : 0;
+
+        timed_lock l(mMutex, stat_op::lock_tool);
+
+        int32_t ret = mDatabase.load(directory);
+        invalidate_arguments();
+
+        return pooled() ? workers : ret;
+    }
+
+    void tool::index_save(const char* path) {
+        if (mRecorder.active())
+            mRecorder.record(session_op::index_save, {path});
+
+        scoped_timer t(stat_op::index_save);
+
+        timed_lock l(mMutex, stat_op::lock_tool);
+        mCache.serialize(path);
+    }
+
+    void tool::index_load(const char* path) {
+        if (mRecorder.active())
+            mRecorder.record(session_op::index_load, {path});
+
+        scoped_timer t(stat_op::index_load);
+
+        timed_lock l(mMutex, stat_op::lock_tool);
+
+        for (auto &unit : mCache) {
+            mPublisher.changed(unit.first);
+        }
+
+        mCache.clear();
+        mPreambles.clear();
+        mCache.unserialize(path, mIndex, mDatabase, &mOverlay);
+
+        for (auto &unit : mCache) {
+            mPublisher.changed(unit.first);
+        }
+    }
+
+    void tool::index_clear() {
+        if (mRecorder.active())
+            mRecorder.record(session_op::index_clear, {});
+
+        if (pooled())
+            mPool->index_clear();
+
+        timed_lock l(mMutex, stat_op::lock_tool);
+
+        for (auto &unit : mCache) {
+            mPublisher.changed(unit.first);
+        }
+
+        mCache.clear();
+        mPreambles.clear();
+        mOverlay.clear();
+    }
+
     void tool::index_touch(const char* path) {
-        std::lock_guard<std::mutex> l(mMutex);
+        if (mRecorder.active())
+            mRecorder.record(session_op::index_touch, {path});
 
-        auto it = mCache.find(path);
-        if (it != mCache.end()) {
-            it->second->reparse();
+        scoped_timer t(stat_op::index_touch);
+
+        if (pooled()) {
+            mPool->index_touch(path);
+            mPublisher.changed(path);
+            return;
+        }
+
+        // the file has been saved, drop any unsaved content
+        bool changed = mOverlay.remove(path) != 0;
+        bool warmup = false;
+
+        translation_unit_shared unit = find(path);
+        if (unit) {
+            timed_lock l(unit->mutex(), stat_op::lock_unit);
+            unit->reparse();
+            warmup = unit->needs_warmup();
         } else {
-            std::shared_ptr<translation_unit> unit = std::make_shared<translation_unit>(
-                clang_parseTranslationUnit(mIndex, path, &mArgs[0], mArgs.size(), nullptr, 0, translation_unit::parsing_options()), path
+            argument_set_shared args;
+            {
+                timed_lock l(mMutex, stat_op::lock_tool);
+                args = mDatabase.find(path);
+            }
+
+            // parse without holding the lock so other units stay available
+            uint64_t elapsed = 0;
+            unit = std::make_shared<translation_unit>(
+                translation_unit::parse(mIndex, path, *args, mOverlay.snapshot(), nullptr, parse_tier::full, &elapsed),
+                path, args, &mOverlay, parse_tier::full, mIndex
             );
+            unit->parsed(elapsed);
+
+            timed_lock l(mMutex, stat_op::lock_tool);
+            if (mCache.find(path) == mCache.end()) {
+                mCache.insert(path, unit);
+                warmup = true;
+            }
+        }
+
+        mPublisher.changed(path);
+
+        if (warmup)
+            schedule_warmup(path, unit);
+
+        if (changed)
+            reparse_dependents(path);
+    }
+
+    void tool::index_add(const char* path) {
+        if (mRecorder.active())
+            mRecorder.record(session_op::index_add, {path});
+
+        scoped_timer t(stat_op::index_add);
+
+        if (pooled()) {
+            mPool->index_add(path);
+            mPublisher.changed(path);
+            return;
+        }
+
+        argument_set_shared args;
+        {
+            timed_lock l(mMutex, stat_op::lock_tool);
+            if (mCache.find(path) != mCache.end())
+                return;
+
+            args = mDatabase.find(path);
+        }
+
+        uint64_t elapsed = 0;
+        translation_unit_shared unit = std::make_shared<translation_unit>(
+            translation_unit::parse(mIndex, path, *args, mOverlay.snapshot(), nullptr, parse_tier::light, &elapsed),
+            path, args, &mOverlay, parse_tier::light, mIndex
+        );
+        unit->parsed(elapsed);
+
+        timed_lock l(mMutex, stat_op::lock_tool);
+        if (mCache.find(path) == mCache.end()) {
             mCache.insert(path, unit);
+            mPublisher.changed(path);
         }
     }
 
     void tool::index_touch_unsaved(const char* path, const char* value, uint32_t length) {
-        std::lock_guard<std::mutex> l(mMutex);
+        index_touch_unsaved(path, unsaved_buffer::copy(value, length));
+    }
 
-        auto it = mCache.find(path);
-        if (it != mCache.end()) {
-            it->second->set_unsaved(value, length);
+    void tool::index_touch_unsaved(const char* path, unsaved_buffer_shared buffer) {
+        // e.g. unsaved_buffer::map on a missing file, there is no content to overlay
+        if (!buffer) {
+            index_discard_unsaved(path);
+            return;
+        }
+
+        if (mRecorder.active())
+            mRecorder.record(session_op::index_touch_unsaved, {path, std::string(buffer->data(), buffer->size())});
+
+        scoped_timer t(stat_op::index_touch_unsaved);
+
+        if (pooled()) {
+            mPool->index_touch_unsaved(path, buffer);
+            mPublisher.changed(path);
+            return;
         }
+
+        mOverlay.set(path, buffer);
+
+        translation_unit_shared unit = find(path);
+        if (unit) {
+            bool warmup = false;
+            {
+                timed_lock l(unit->mutex(), stat_op::lock_unit);
+                unit->set_unsaved(std::move(buffer));
+                warmup = unit->preamble() == preamble_state::building;
+            }
+
+            mPublisher.changed(path);
+
+            if (warmup)
+                schedule_warmup(path, unit);
+        }
+
+        reparse_dependents(path);
+    }
+
+    void tool::index_discard_unsaved(const char* path) {
+        if (mRecorder.active())
+            mRecorder.record(session_op::index_discard_unsaved, {path});
+
+        if (pooled()) {
+            mPool->index_discard_unsaved(path);
+            mPublisher.changed(path);
+            return;
+        }
+
+        if (mOverlay.remove(path) == 0)
+            return;
+
+        translation_unit_shared unit = find(path);
+        if (unit) {
+            {
+                timed_lock l(unit->mutex(), stat_op::lock_unit);
+                unit->reparse();
+            }
+
+            mPublisher.changed(path);
+        }
+
+        reparse_dependents(path);
     }
 
     ressource_map tool::index_status() {
-        std::lock_guard<std::mutex> l(mMutex);
+        if (pooled())
+            return mPool->index_status();
+
         ressource_map ret;
 
-        for (auto &unit : mCache) {
-            ret.insert(std::make_pair<std::string, ressource_usage>(std::string(unit.first), usage_from_unit(unit.second)));
+        for (auto &unit : units()) {
+            timed_lock l(unit.second->mutex(), stat_op::lock_unit);
+            ret.insert(std::make_pair(unit.first, usage_from_unit(unit.second)));
         }
 
         return ret;
     }
 
     void tool::index_remove(const char* path) {
-        std::lock_guard<std::mutex> l(mMutex);
+        if (mRecorder.active())
+            mRecorder.record(session_op::index_remove, {path});
+
+        if (pooled()) {
+            mPool->index_remove(path);
+            mPublisher.changed(path);
+            return;
+        }
+
+        timed_lock l(mMutex, stat_op::lock_tool);
 
         auto it = mCache.find(path);
         if (it != mCache.end())
             mCache.erase(it);
+
+        mPreambles.remove(path);
+        mPublisher.changed(path);
     }
 
-    std::string tool::index_hash() {
-        // create a hash constsisting of:
-        // [1] All compiler arguments
-        // [2] Current clang version
-        std::string src = join(mArgs.begin(), mArgs.end(), '.');
-        src.append(cx2std(clang_getClangVersion()));
+    void tool::index_hibernate(std::chrono::milliseconds idle) {
+        if (pooled())
+            mPool->index_hibernate(idle.count());
 
-        // calculate sha1 and return it
-        unsigned char hash_binary[21] = {'\0'};
-        std::string hash(' ', 40);
-        sha1::calc(src.c_str(), src.size(), hash_binary);
-        sha1::toHexString(hash_binary, &hash[0]);
+        mHibernator.start(idle);
+    }
 
-        return hash;
+    std::string tool::index_hash() {
+        timed_lock l(mMutex, stat_op::lock_tool);
+        return mDatabase.get_default()->hash();
+    }
+
+    std::string tool::index_hash(const char* path) {
+        timed_lock l(mMutex, stat_op::lock_tool);
+        return mDatabase.find(path)->hash();
     }
 
     ast_element tool::tu_ast(const char* path) {
-        std::lock_guard<std::mutex> l(mMutex);
+        if (mRecorder.active())
+            mRecorder.record(session_op::tu_ast, {path});
 
-        auto it = mCache.find(path);
-        if (it != mCache.end())
-            return it->second->ast();
+        scoped_timer t(stat_op::tu_ast);
+
+        if (pooled())
+            return mPool->tu_ast(path);
+
+        translation_unit_shared unit = find(path);
+        if (!unit)
+            return {};
 
-        return {};
+        timed_lock l(unit->mutex(), stat_op::lock_unit);
+        unit->count_query(stat_op::tu_ast);
+        return unit->ast();
+    }
+
+    std::vector<token> tool::tu_tokens(const char* path, uint32_t first, uint32_t last) {
+        if (mRecorder.active())
+            mRecorder.record(session_op::tu_tokens, {path}, {first, last});
+
+        scoped_timer t(stat_op::tu_tokens);
+
+        if (pooled())
+            return mPool->tu_tokens(path, first, last);
+
+        translation_unit_shared unit = find(path);
+        if (!unit)
+            return {};
+
+        timed_lock l(unit->mutex(), stat_op::lock_unit);
+        unit->count_query(stat_op::tu_tokens);
+        return unit->tokens(first, last);
+    }
+
+    line_index_shared tool::tu_lines(const char* path) {
+        translation_unit_shared unit = find(path);
+        if (!unit)
+            return nullptr;
+
+        timed_lock l(unit->mutex(), stat_op::lock_unit);
+        return unit->lines();
     }
 
     std::vector<diagnostic> tool::tu_diagnose(const char* path) {
-        std::lock_guard<std::mutex> l(mMutex);
+        if (mRecorder.active())
+            mRecorder.record(session_op::tu_diagnose, {path});
 
-        auto it = mCache.find(path);
-        if (it != mCache.end())
-            return it->second->diagnose();
+        scoped_timer t(stat_op::tu_diagnose);
+
+        if (pooled())
+            return mPool->tu_diagnose(path);
+
+        translation_unit_shared unit = find_full(path);
+        if (!unit)
+            return {};
+
+        timed_lock l(unit->mutex(), stat_op::lock_unit);
+        unit->count_query(stat_op::tu_diagnose);
+        return unit->diagnose();
+    }
+
+    diagnostic_map tool::workspace_diagnose() {
+        if (mRecorder.active())
+            mRecorder.record(session_op::workspace_diagnose, {});
+
+        scoped_timer t(stat_op::workspace_diagnose);
+
+        std::vector<diagnostic_list_shared> results;
+
+        if (pooled()) {
+            // workers diagnose their units in parallel, headers may still be reported by several
+            for (auto &map : mPool->workspace_diagnose()) {
+                for (auto &file : map) {
+                    results.push_back(std::make_shared<std::vector<diagnostic>>(std::move(file.second)));
+                }
+            }
+        } else {
+            auto all = units();
+            results.resize(all.size());
+            std::atomic<size_t> next(0);
+
+            auto work = [&]{
+                for (size_t i = next++; i < all.size(); i = next++) {
+                    timed_lock l(all[i].second->mutex(), stat_op::lock_unit);
+                    results[i] = all[i].second->diagnostics();
+                }
+            };
+
+            // units are independent, only uncached ones do real work
+            size_t helpers = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), all.size());
+            helpers = helpers ? helpers - 1 : 0;
+
+            std::mutex m;
+            std::condition_variable cond;
+            size_t running = helpers;
+
+            job_queue& jobs = diagnose_jobs();
+            for (size_t i = 0; i < helpers; ++i) {
+                jobs.push([&]{
+                    work();
+
+                    std::lock_guard<std::mutex> l(m);
+                    if (--running == 0)
+                        cond.notify_all();
+                });
+            }
+
+            // helpers reference our stack, wait for all of them even if we ran out of units first
+            work();
+
+            std::unique_lock<std::mutex> l(m);
+            cond.wait(l, [&]{ return running == 0; });
+        }
+
+        // headers shared by several units report the same diagnostic for each of them
+        diagnostic_map ret;
+        std::unordered_set<std::string> seen;
+
+        for (auto &result : results) {
+            if (!result)
+                continue;
+
+            for (auto &d : *result) {
+                if (seen.insert(diagnostic_key(d)).second)
+                    ret[d.loc.file].push_back(d);
+            }
+        }
+
+        for (auto &file : ret) {
+            std::sort(file.second.begin(), file.second.end(), [](const diagnostic& a, const diagnostic& b) {
+                return a.loc.row < b.loc.row || (a.loc.row == b.loc.row && a.loc.col < b.loc.col);
+            });
+        }
+
+        return ret;
+    }
+
+    job_queue& tool::diagnose_jobs() {
+        timed_lock l(mMutex, stat_op::lock_tool);
+
+        if (!mDiagnoseJobs)
+            mDiagnoseJobs.reset(new job_queue(std::max(1u, std::thread::hardware_concurrency()) - 1));
+
+        return *mDiagnoseJobs;
+    }
+
+    void tool::diagnostics_subscribe(diagnostic_publisher::callback_t callback, std::chrono::milliseconds interval) {
+        mPublisher.subscribe(std::move(callback), interval);
+
+        // the first update contains everything
+        timed_lock l(mMutex, stat_op::lock_tool);
+        for (auto &unit : mCache) {
+            mPublisher.changed(unit.first);
+        }
+    }
+
+    void tool::diagnostics_unsubscribe() {
+        mPublisher.unsubscribe();
+    }
+
+    std::vector<stat_entry> tool::stats() {
+        return statistics::global().summary();
+    }
+
+    void tool::stats_reset() {
+        statistics::global().reset();
+    }
+
+    void tool::trace_start() {
+        tracer::clear();
+        tracer::enable(true);
+    }
+
+    void tool::trace_stop() {
+        tracer::enable(false);
+    }
+
+    bool tool::trace_dump(const char* path) {
+        return tracer::dump(path);
+    }
+
+    bool tool::record_start(const char* path) {
+        return mRecorder.start(path);
+    }
+
+    void tool::record_stop() {
+        mRecorder.stop();
+    }
+
+    bool tool::workers_start(uint32_t n, const char* executable) {
+        index_clear();
+        mPool.reset();
+
+        // the pool is only created here, tools which never use workers do not pay for it
+        std::unique_ptr<worker_pool> pool(new worker_pool(executable ? executable : worker_pool::default_executable()));
+        {
+            timed_lock l(mMutex, stat_op::lock_tool);
+            for (auto &a : mWorkerArguments) {
+                a.second(*pool);
+            }
+        }
+
+        if (!pool->start(n))
+            return false;
+
+        mPool = std::move(pool);
+        return true;
+    }
+
+    void tool::workers_stop() {
+        mPool.reset();
+    }
+
+    void tool::workers_rebalance() {
+        if (pooled())
+            mPool->rebalance();
+    }
 
-        return {};
+    void tool::remember_arguments(const std::string& key, std::function<void(worker_pool&)> call) {
+        timed_lock l(mMutex, stat_op::lock_tool);
+
+        auto it = std::find_if(mWorkerArguments.begin(), mWorkerArguments.end(),
+            [&](const std::pair<std::string, std::function<void(worker_pool&)>>& a) { return a.first == key; });
+
+        // later calls may override earlier ones, keep them in order
+        if (it != mWorkerArguments.end())
+            mWorkerArguments.erase(it);
+
+        mWorkerArguments.push_back(std::make_pair(key, std::move(call)));
     }
 
     completion_list tool::cursor_complete(const char* path, uint32_t row, uint32_t col) {
-        std::lock_guard<std::mutex> l(mMutex);
+        if (mRecorder.active())
+            mRecorder.record(session_op::cursor_complete, {path}, {row, col});
 
-        auto it = mCache.find(path);
-        if (it != mCache.end())
-            return it->second->complete_at(row, col);
+        scoped_timer t(stat_op::cursor_complete);
+
+        if (pooled())
+            return mPool->cursor_complete(path, row, col);
 
-        return {};
+        translation_unit_shared unit = find_full(path);
+        if (!unit)
+            return {};
+
+        timed_lock l(unit->mutex(), stat_op::lock_unit);
+        unit->count_query(stat_op::cursor_complete);
+        return unit->complete_at(row, col);
     }
 
     std::string tool::cursor_type(const char* path, uint32_t row, uint32_t col) {
-        std::lock_guard<std::mutex> l(mMutex);
+        if (mRecorder.active())
+            mRecorder.record(session_op::cursor_type, {path}, {row, col});
 
-        auto it = mCache.find(path);
-        if (it != mCache.end())
-            return it->second->type_at(row, col);
+        scoped_timer t(stat_op::cursor_type);
+
+        if (pooled())
+            return mPool->cursor_type(path, row, col);
+
+        translation_unit_shared unit = find(path);
+        if (!unit)
+            return "";
 
-        return "";
+        timed_lock l(unit->mutex(), stat_op::lock_unit);
+        unit->count_query(stat_op::cursor_type);
+        return unit->type_at(row, col);
     }
 
     location tool::cursor_declaration(const char* path, uint32_t row, uint32_t col) {
-        std::lock_guard<std::mutex> l(mMutex);
+        if (mRecorder.active())
+            mRecorder.record(session_op::cursor_declaration, {path}, {row, col});
 
-        auto it = mCache.find(path);
-        if (it != mCache.end())
-            return it->second->declaration_location_at(row, col);
+        scoped_timer t(stat_op::cursor_declaration);
+
+        if (pooled())
+            return mPool->cursor_declaration(path, row, col);
 
-        return {"", 0, 0};
+        translation_unit_shared unit = find(path);
+        if (!unit)
+            return {"", 0, 0};
+
+        timed_lock l(unit->mutex(), stat_op::lock_unit);
+        unit->count_query(stat_op::cursor_declaration);
+        return unit->declaration_location_at(row, col);
     }
 
     location tool::cursor_definition(const char* path, uint32_t row, uint32_t col) {
-        std::lock_guard<std::mutex> l(mMutex);
+        if (mRecorder.active())
+            mRecorder.record(session_op::cursor_definition, {path}, {row, col});
 
-        auto it = mCache.find(path);
-        if (it != mCache.end())
-            return it->second->definition_location_at(row, col);
+        scoped_timer t(stat_op::cursor_definition);
+
+        if (pooled())
+            return mPool->cursor_definition(path, row, col);
+
+        translation_unit_shared unit = find(path);
+        if (!unit)
+            return {"", 0, 0};
+
+        timed_lock l(unit->mutex(), stat_op::lock_unit);
+        unit->count_query(stat_op::cursor_definition);
+        return unit->definition_location_at(row, col);
+    }
+
+    cursor_details tool::cursor_info(const char* path, uint32_t row, uint32_t col) {
+        if (mRecorder.active())
+            mRecorder.record(session_op::cursor_info, {path}, {row, col});
+
+        scoped_timer t(stat_op::cursor_info);
+
+        if (pooled())
+            return mPool->cursor_info(path, row, col);
+
+        translation_unit_shared unit = find(path);
+        if (!unit)
+            return {"", "", {"", 0, 0}, {"", 0, 0}, "", "", "", ""};
+
+        timed_lock l(unit->mutex(), stat_op::lock_unit);
+        unit->count_query(stat_op::cursor_info);
+        return unit->info_at(row, col);
+    }
+
+    std::vector<cursor_answer> tool::cursor_batch(const char* path, const std::vector<cursor_query>& queries) {
+        if (mRecorder.active()) {
+            std::vector<uint32_t> values;
+            values.reserve(queries.size() * 3);
+
+            for (auto &q : queries) {
+                values.push_back(q.row);
+                values.push_back(q.col);
+                values.push_back(q.kinds);
+            }
+
+            mRecorder.record(session_op::cursor_batch, {path}, values);
+        }
+
+        scoped_timer t(stat_op::cursor_batch);
+
+        if (pooled())
+            return mPool->cursor_batch(path, queries);
+
+        translation_unit_shared unit = find(path);
+        if (!unit)
+            return std::vector<cursor_answer>(queries.size(), cursor_answer{"", {"", 0, 0}, {"", 0, 0}});
+
+        timed_lock l(unit->mutex(), stat_op::lock_unit);
+        unit->count_query(stat_op::cursor_batch);
+        return unit->query_at(queries);
+    }
+
+    void tool::serve(int fd) {
+        std::string message;
+
+        while (worker_pool::receive(fd, message)) {
+            wire_reader r(message);
+            wire_writer w;
+
+            uint8_t op = 0;
+            std::string path, content;
+            uint32_t row = 0, col = 0;
+            uint64_t rss = 0;
+
+            r.get(op);
+            switch (static_cast<worker_op>(op)) {
+                case worker_op::arguments_set: {
+                    std::vector<std::string> args;
+                    r.get(args);
+
+                    std::vector<const char*> argv;
+                    for (auto &a : args) {
+                        argv.push_back(a.c_str());
+                    }
+
+                    arguments_set(argv.data(), argv.size());
+                } break;
+                case worker_op::arguments_set_file: {
+                    std::vector<std::string> args;
+                    r.get(path);
+                    r.get(args);
+
+                    std::vector<const char*> argv;
+                    for (auto &a : args) {
+                        argv.push_back(a.c_str());
+                    }
+
+                    arguments_set(path.c_str(), argv.data(), argv.size());
+                } break;
+                case worker_op::arguments_load:
+                    r.get(path);
+                    w.put(static_cast<uint32_t>(arguments_load(path.c_str())));
+                    break;
+                case worker_op::index_touch:
+                    r.get(path);
+                    index_touch(path.c_str());
+                    rss = worker_pool::resident_size();
+                    break;
+                case worker_op::index_touch_unsaved:
+                    r.get(path);
+                    r.get(content);
+                    index_touch_unsaved(path.c_str(), content.data(), content.size());
+                    rss = worker_pool::resident_size();
+                    break;
+                case worker_op::index_add:
+                    r.get(path);
+                    index_add(path.c_str());
+                    rss = worker_pool::resident_size();
+                    break;
+                case worker_op::index_remove:
+                    r.get(path);
+                    index_remove(path.c_str());
+                    rss = worker_pool::resident_size();
+                    break;
+                case worker_op::index_clear:
+                    index_clear();
+                    rss = worker_pool::resident_size();
+                    break;
+                case worker_op::index_status: {
+                    ressource_map status = index_status();
+                    w.put(static_cast<uint32_t>(status.size()));
+
+                    for (auto &unit : status) {
+                        w.put(unit.first);
+                        w.put(unit.second);
+                    }
+                } break;
+                case worker_op::index_hibernate: {
+                    uint64_t idle = 0;
+                    r.get(idle);
+                    index_hibernate(std::chrono::milliseconds(idle));
+                } break;
+                case worker_op::overlay_set:
+                    // content of a file owned by another worker, only our dependents care
+                    r.get(path);
+                    r.get(content);
+                    mOverlay.set(path, unsaved_buffer::copy(content.data(), content.size()));
+                    reparse_dependents(path.c_str());
+                    rss = worker_pool::resident_size();
+                    break;
+                case worker_op::overlay_remove:
+                    // also drops the content of our own unit if we own path
+                    r.get(path);
+                    index_discard_unsaved(path.c_str());
+                    rss = worker_pool::resident_size();
+                    break;
+                case worker_op::tu_ast:
+                    r.get(path);
+                    w.put(tu_ast(path.c_str()));
+                    break;
+                case worker_op::tu_tokens:
+                    r.get(path);
+                    r.get(row);
+                    r.get(col);
+                    w.put(tu_tokens(path.c_str(), row, col));
+                    break;
+                case worker_op::tu_diagnose:
+                    r.get(path);
+                    w.put(tu_diagnose(path.c_str()));
+                    break;
+                case worker_op::workspace_diagnose: {
+                    diagnostic_map map = workspace_diagnose();
+                    w.put(static_cast<uint32_t>(map.size()));
+
+                    for (auto &file : map) {
+                        w.put(file.first);
+                        w.put(file.second);
+                    }
+                } break;
+                case worker_op::cursor_complete:
+                    r.get(path);
+                    r.get(row);
+                    r.get(col);
+                    w.put(cursor_complete(path.c_str(), row, col));
+                    break;
+                case worker_op::cursor_type:
+                    r.get(path);
+                    r.get(row);
+                    r.get(col);
+                    w.put(cursor_type(path.c_str(), row, col));
+                    break;
+                case worker_op::cursor_declaration:
+                    r.get(path);
+                    r.get(row);
+                    r.get(col);
+                    w.put(cursor_declaration(path.c_str(), row, col));
+                    break;
+                case worker_op::cursor_definition:
+                    r.get(path);
+                    r.get(row);
+                    r.get(col);
+                    w.put(cursor_definition(path.c_str(), row, col));
+                    break;
+                case worker_op::cursor_info:
+                    r.get(path);
+                    r.get(row);
+                    r.get(col);
+                    w.put(cursor_info(path.c_str(), row, col));
+                    break;
+                case worker_op::cursor_batch: {
+                    std::vector<cursor_query> queries;
+                    r.get(path);
+                    r.get(queries);
+                    w.put(cursor_batch(path.c_str(), queries));
+                } break;
+            }
+
+            // the pool places new units on the worker using the least memory
+            w.put(rss);
+            if (!worker_pool::send(fd, w.buffer()))
+                return;
+        }
+    }
+
+    translation_unit_shared tool::find(const char* path) {
+        translation_unit_shared unit;
+        {
+            timed_lock l(mMutex, stat_op::lock_tool);
+
+            auto it = mCache.find(path);
+            if (it == mCache.end())
+                return nullptr;
+
+            it->second->touch();
+            unit = it->second;
+        }
+
+        if (unit->hibernated())
+            wake(path, unit);
+
+        return unit;
+    }
+
+    void tool::wake(const std::string& path, const translation_unit_shared& unit) {
+        bool warmup = false;
+        {
+            timed_lock l(unit->mutex(), stat_op::lock_unit);
+            warmup = unit->wake() && unit->needs_warmup();
+        }
+
+        // the loaded unit has no preamble, the first query pays for the load only
+        if (warmup)
+            schedule_warmup(path, unit);
+    }
+
+    void tool::hibernate_idle(std::chrono::milliseconds idle) {
+        auto now = std::chrono::steady_clock::now();
+        timed_lock l(mMutex, stat_op::lock_tool);
+
+        for (auto &unit : mCache) {
+            if (unit.second->hibernated() || now - unit.second->last_access() < idle)
+                continue;
+
+            // units with pending background work are not idle
+            if (mRebuilding.count(unit.first) || mWarming.count(unit.first))
+                continue;
+
+            // lowest priority, anything else the worker has to do comes first
+            std::string path = unit.first;
+            mWorker.push(0, [this, path, idle]{ hibernate(path, idle); });
+        }
+    }
+
+    void tool::hibernate(const std::string& path, std::chrono::milliseconds idle) {
+        translation_unit_shared unit;
+        {
+            timed_lock l(mMutex, stat_op::lock_tool);
+
+            auto it = mCache.find(path.c_str());
+            if (it == mCache.end() || std::chrono::steady_clock::now() - it->second->last_access() < idle)
+                return;
+
+            unit = it->second;
+        }
+
+        timed_lock l(unit->mutex(), stat_op::lock_unit);
+        unit->hibernate(mIndex, mHibernator.file());
+    }
+
+    translation_unit_shared tool::find_full(const char* path) {
+        translation_unit_shared unit = find(path);
+
+        if (unit && unit->tier() == parse_tier::light)
+            promote(path, unit);
+
+        return unit;
+    }
+
+    void tool::promote(const std::string& path, const translation_unit_shared& unit) {
+        argument_set_shared args;
+        shared_preamble_ptr pch;
+
+        {
+            timed_lock l(mMutex, stat_op::lock_tool);
+            args = mDatabase.find(path);
+            pch = mPreambles.find(path);
+        }
+
+        // somebody is waiting on the result, parse right away instead of queueing a rebuild
+        unsaved_files_shared files = mOverlay.snapshot();
+        uint64_t elapsed = 0;
+        CXTranslationUnit cx = translation_unit::parse(mIndex, path, *args, files, pch, parse_tier::full, &elapsed);
+        if (!cx)
+            return;
+
+        {
+            timed_lock l(unit->mutex(), stat_op::lock_unit);
+
+            // promoted by a concurrent request
+            if (unit->tier() == parse_tier::full) {
+                clang_disposeTranslationUnit(cx);
+                return;
+            }
+
+            unit->parsed(elapsed);
+            unit->replace(cx, args, pch, files->version, parse_tier::full);
+        }
+
+        mPublisher.changed(path);
+        schedule_warmup(path, unit);
+    }
+
+    diagnostic_list_shared tool::diagnostics(const std::string& path) {
+        if (pooled())
+            return std::make_shared<std::vector<diagnostic>>(mPool->tu_diagnose(path));
+
+        translation_unit_shared unit;
+        {
+            timed_lock l(mMutex, stat_op::lock_tool);
+
+            auto it = mCache.find(path.c_str());
+            if (it == mCache.end())
+                return nullptr;
+
+            unit = it->second;
+        }
+
+        timed_lock l(unit->mutex(), stat_op::lock_unit);
+        return unit->diagnostics();
+    }
+
+    std::vector<std::pair<std::string, translation_unit_shared>> tool::units() {
+        timed_lock l(mMutex, stat_op::lock_tool);
+        return std::vector<std::pair<std::string, translation_unit_shared>>(mCache.begin(), mCache.end());
+    }
+
+    void tool::invalidate_arguments() {
+        for (auto &unit : mCache) {
+            if (unit.second->arguments() == mDatabase.find(unit.first))
+                continue;
+
+            // the group depends on the arguments, it is picked again after the next warmup
+            mPreambles.remove(unit.first);
+            schedule_rebuild(unit.first, unit.second);
+        }
+    }
+
+    void tool::schedule_rebuild(const std::string& path, const translation_unit_shared& unit) {
+        if (mRebuilding.count(path))
+            return;
+
+        // keep the old unit around and rebuild in the background, open files first
+        uint64_t priority = std::chrono::duration_cast<std::chrono::milliseconds>(
+            unit->last_access().time_since_epoch()
+        ).count();
+
+        if (mOverlay.contains(path))
+            priority |= 1ull << 62;
+
+        mRebuilding.insert(path);
+        mWorker.push(priority, [this, path]{ rebuild(path); });
+    }
+
+    void tool::rebuild(const std::string& path) {
+        translation_unit_shared unit;
+        argument_set_shared args;
+        shared_preamble_ptr pch;
+        parse_tier tier;
+
+        {
+            timed_lock l(mMutex, stat_op::lock_tool);
+            mRebuilding.erase(path);
+
+            auto it = mCache.find(path.c_str());
+            if (it == mCache.end())
+                return;
+
+            unit = it->second;
+            args = mDatabase.find(path);
+            pch = mPreambles.find(path);
+            tier = unit->tier();
+
+            if (unit->arguments() == args && unit->pch() == pch)
+                return;
+        }
+
+        // parse without holding any lock, queries are served by the old unit meanwhile
+        unsaved_files_shared files = mOverlay.snapshot();
+        uint64_t elapsed = 0;
+        CXTranslationUnit cx = translation_unit::parse(mIndex, path, *args, files, pch, tier, &elapsed);
+        if (!cx)
+            return;
+
+        {
+            timed_lock l(mMutex, stat_op::lock_tool);
+            auto it = mCache.find(path.c_str());
+
+            // the unit has been removed or replaced, or arguments or preamble changed once more
+            if (it == mCache.end() || it->second != unit || mDatabase.find(path) != args || mPreambles.find(path) != pch) {
+                clang_disposeTranslationUnit(cx);
+                return;
+            }
+        }
+
+        {
+            timed_lock l(unit->mutex(), stat_op::lock_unit);
+
+            // promoted while we were parsing
+            if (unit->tier() != tier) {
+                clang_disposeTranslationUnit(cx);
+                return;
+            }
+
+            unit->parsed(elapsed);
+            unit->replace(cx, args, pch, files->version, tier);
+        }
+
+        mPublisher.changed(path);
+        schedule_warmup(path, unit);
+    }
+
+    void tool::schedule_warmup(const std::string& path, const translation_unit_shared& unit) {
+        timed_lock l(mMutex, stat_op::lock_tool);
+
+        if (mWarming.count(path))
+            return;
+
+        // warmups are for units somebody is waiting on, run them before any rebuild
+        uint64_t priority = std::chrono::duration_cast<std::chrono::milliseconds>(
+            unit->last_access().time_since_epoch()
+        ).count() | (1ull << 63);
+
+        std::weak_ptr<translation_unit> weak = unit;
+        mWarming.insert(path);
+
+        mWorker.push(priority, [this, path, weak]{
+            {
+                timed_lock l(mMutex, stat_op::lock_tool);
+                mWarming.erase(path);
+            }
+
+            translation_unit_shared unit = weak.lock();
+            if (!unit)
+                return;
+
+            preamble_key key;
+            {
+                timed_lock l(unit->mutex(), stat_op::lock_unit);
+                if (!unit->needs_warmup())
+                    return;
 
-        return {"", 0, 0};
+                unit->warmup();
+                key = unit->preamble_info();
+            }
+
+            sync_preamble(path, unit, key);
+        });
+    }
+
+    void tool::sync_preamble(const std::string& path, const translation_unit_shared& unit, const preamble_key& key) {
+        shared_preamble_ptr build;
+        shared_preamble_ptr current;
+        std::string group = preamble_group(key, path, unit->arguments()->hash());
+
+        {
+            timed_lock l(mMutex, stat_op::lock_tool);
+
+            auto it = mCache.find(path.c_str());
+            if (it == mCache.end() || it->second != unit)
+                return;
+
+            current = mPreambles.find(path);
+        }
+
+        // stats every header of the preamble, keep that out of the tool lock
+        bool stale = current && current->stale(mOverlay.snapshot());
+
+        {
+            timed_lock l(mMutex, stat_op::lock_tool);
+
+            auto it = mCache.find(path.c_str());
+            if (it == mCache.end() || it->second != unit)
+                return;
+
+            build = mPreambles.add(path, group);
+
+            // one of the headers changed since the shared preamble has been built, unless it has been replaced meanwhile
+            if (stale && current == mPreambles.find(path)) {
+                mPreambles.invalidate(path);
+                build = mPreambles.add(path, group);
+            }
+
+            // unit moved to a different group or its group has a new preamble
+            if (unit->pch() != mPreambles.find(path))
+                schedule_rebuild(path, unit);
+        }
+
+        if (build) {
+            uint64_t priority = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()
+            ).count();
+
+            mWorker.push(priority, [this, group, build]{ build_preamble(group, build); });
+        }
+    }
+
+    void tool::build_preamble(const std::string& group, const shared_preamble_ptr& preamble) {
+        std::string path;
+        argument_set_shared args;
+
+        {
+            timed_lock l(mMutex, stat_op::lock_tool);
+
+            std::vector<std::string> members = mPreambles.members(group);
+            if (members.empty())
+                return;
+
+            path = members.front();
+            args = mDatabase.find(path);
+        }
+
+        // all members share the same region, take it from any of them
+        unsaved_buffer_shared buffer;
+        for (auto &f : mOverlay.snapshot()->entries) {
+            if (f.first == path)
+                buffer = f.second;
+        }
+
+        if (!buffer)
+            buffer = unsaved_buffer::map(path.c_str());
+
+        bool ok = false;
+        if (buffer) {
+            std::string region(buffer->data(), preamble_length(buffer->data(), buffer->size()));
+            ok = preamble->build(mIndex, region, path, *args);
+        }
+
+        timed_lock l(mMutex, stat_op::lock_tool);
+
+        if (!ok) {
+            mPreambles.failed(group);
+            return;
+        }
+
+        for (auto &member : mPreambles.members(group)) {
+            auto it = mCache.find(member.c_str());
+            if (it != mCache.end())
+                schedule_rebuild(member, it->second);
+        }
+    }
+
+    void tool::reparse_dependents(const char* skip) {
+        uint64_t version = mOverlay.version();
+
+        for (auto &unit : units()) {
+            if (unit.first == skip)
+                continue;
+
+            bool warmup = false;
+            bool refreshed = false;
+            {
+                timed_lock l(unit.second->mutex(), stat_op::lock_unit);
+
+                if (unit.second->overlay_version() == version)
+                    continue;
+
+                // only reparse if one of the changed files is part of the unit
+                for (auto &file : mOverlay.changed_since(unit.second->overlay_version())) {
+                    if (unit.second->depends_on(file.c_str())) {
+                        unit.second->refresh();
+                        refreshed = true;
+                        break;
+                    }
+                }
+
+                warmup = unit.second->preamble() == preamble_state::building;
+            }
+
+            if (refreshed)
+                mPublisher.changed(unit.first);
+
+            if (warmup)
+                schedule_warmup(unit.first, unit.second);
+        }
     }
-}
\ No newline at end of file
+}
@@ -25,8 +25,12 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <functional>
 #include <mutex>
 #include <thread>
+#include <chrono>
+#include <unordered_set>
 
 #include <cstring>
 #include <clang-c/Index.h>
@@ -34,90 +38,221 @@
 #include "noncopyable.hpp"
 #include "clang_translation_unit_cache.hpp"
 #include "clang_ressource_usage.hpp"
+#include "clang_unsaved_buffer.hpp"
+#include "clang_unsaved_overlay.hpp"
+#include "clang_compilation_database.hpp"
+#include "clang_preamble_cache.hpp"
+#include "clang_background_worker.hpp"
+#include "clang_diagnostic_publisher.hpp"
+#include "clang_stats.hpp"
+#include "clang_session_log.hpp"
+#include "clang_hibernator.hpp"
+#include "clang_worker_pool.hpp"
+#include "clang_job_queue.hpp"
 #include "clang_completion_result.hpp"
 #include "clang_location.hpp"
+#include "clang_cursor_query.hpp"
+#include "clang_token.hpp"
+#include "clang_line_index.hpp"
 #include "clang_diagnostic.hpp"
 #include "clang_ast.hpp"
 
 namespace clang {
     class tool : private noncopyable {
     public:
-        tool() : mIndex(clang_createIndex(0, 0)) {}
+        tool() : mIndex(clang_createIndex(0, 0)), mPublisher([this](const std::string& path){ return diagnostics(path); }),
+            mHibernator([this](std::chrono::milliseconds idle){ hibernate_idle(idle); }) {}
 
         ~tool() {
+            mPool.reset();
+            mHibernator.stop();
+            mPublisher.unsubscribe();
+            mWorker.stop();
             mCache.clear();
             clang_disposeIndex(mIndex);
         }
 
-        /** Sets compiler arguments */
-        void arguments_set(const char** args, uint32_t size) {
-            std::lock_guard<std::mutex> l(mMutex);
+        /**
+         * Sets compiler arguments for all files without an own entry
+         *
+         * Units whose arguments changed are reparsed in the background, open files first.
+         * Until then queries are answered by the old unit.
+         */
+        void arguments_set(const char** args, uint32_t size);
 
-            if (mArgs.size() > 3) {
-                for (uint32_t i = 0; i < mArgs.size() - 3; ++i) {
-                    delete[] mArgs[i];
-                }
-            }
+        /** Sets compiler arguments for a single file */
+        void arguments_set(const char* path, const char** args, uint32_t size);
 
-            // clear vector and reserve
-            mArgs.clear();
-            mArgs.reserve(size+3);
+        /**
+         * Loads per-file compiler arguments from compile_commands.json in directory
+         *
+         * Returns the number of entries or -1 if the database could not be loaded.
+         */
+        int32_t arguments_load(const char* directory);
 
-            // copy and clear cache
-            for (uint32_t i = 0; i < size; ++i) {
-                char* c = new char[strlen(args[i])+1];
-                strcpy(c, args[i]);
-                mArgs.push_back(c);
-            }
+        /** Saves current index to the filesystem, not supported with workers */
+        void index_save(const char* path);
 
-            mArgs.push_back("-I/usr/include/clang/3.5/include");
-            mArgs.push_back("-I/usr/include/clang/3.6/include");
-            mArgs.push_back("-I/usr/include/clang/3.7/include");
-
-            mCache.clear();
-        }
-
-        /** Saves current index to the filesystem */
-        void index_save(const char* path) {
-            std::lock_guard<std::mutex> l(mMutex);
-            mCache.serialize(path, index_hash().c_str());
-        }
-
-        /** Loads current index from path */
-        void index_load(const char* path) {
-            std::lock_guard<std::mutex> l(mMutex);
-            mCache.clear();
-            mCache.unserialize(path, index_hash().c_str(), mIndex);
-        }
+        /** Loads current index from path, not supported with workers */
+        void index_load(const char* path);
 
         /** Removes all translation units from the index */
-        void index_clear() {
-            std::lock_guard<std::mutex> l(mMutex);
-            mCache.clear();
-        }
+        void index_clear();
 
-        /** Creates or updates the translation unit at path */
+        /**
+         * Creates or updates the translation unit at path
+         *
+         * The precompiled preamble of new units is built in the background right away.
+         */
         void index_touch(const char* path);
 
-        /** Adds unsaved content for a translation unit */
+        /**
+         * Adds path to the index for navigation only
+         *
+         * The unit is parsed without function bodies and completion caches and promoted to a
+         * full parse on the first completion or diagnostics request. Does nothing if path is
+         * already on the index.
+         */
+        void index_add(const char* path);
+
+        /**
+         * Adds unsaved content for a file
+         *
+         * The content is visible to every translation unit, units which include path are
+         * reparsed. Path does not need to be on the index itself, e.g. for headers.
+         */
         void index_touch_unsaved(const char* path, const char* value, uint32_t length);
 
-        /** Returns memory usage of index */
+        /** Adds unsaved content for a file without copying it, a null buffer discards it instead */
+        void index_touch_unsaved(const char* path, unsaved_buffer_shared buffer);
+
+        /**
+         * Drops unsaved content of a file, e.g. after the editor discarded its changes
+         *
+         * The unit at path and all units which include it are reparsed with the content on
+         * disk. Unlike index_touch, path is not added to the index.
+         */
+        void index_discard_unsaved(const char* path);
+
+        /** Returns memory usage and preamble state of each unit */
         ressource_map index_status();
 
+        /**
+         * Hibernates units which have not been accessed for idle, 0 disables hibernation
+         *
+         * Hibernated units are saved to disk and disposed, resident memory follows the set
+         * of recently used files. They are loaded again on their next access.
+         */
+        void index_hibernate(std::chrono::milliseconds idle);
+
         /** Removes a single translation unit from the index */
         void index_remove(const char* path);
 
-        /** Returns a unique has representing the current index */
+        /** Returns a unique hash representing the default arguments */
         std::string index_hash();
 
+        /** Returns a unique hash representing the arguments for path */
+        std::string index_hash(const char* path);
+
         /** Generates ast of given translation unit */
         ast_element tu_ast(const char* path);
 
-        /** Returns diagnostic information about a translation unit */
+        /**
+         * Returns annotated tokens of rows first to last, e.g. for semantic highlighting
+         *
+         * Tokens are cached per line, after an edit only changed lines are tokenized again.
+         */
+        std::vector<token> tu_tokens(const char* path, uint32_t first, uint32_t last);
+
+        /**
+         * Returns the line index of path's current content
+         *
+         * The index converts between offsets, rows / columns and UTF-16 columns and can be
+         * used without any locking. Returns nullptr if path is not on the index or units are
+         * kept by workers.
+         */
+        line_index_shared tu_lines(const char* path);
+
+        /** Returns diagnostic information about a translation unit, promotes light units */
         std::vector<diagnostic> tu_diagnose(const char* path);
 
-        /** Invokes clang's code completion */
+        /**
+         * Returns diagnostics of all units on the index, grouped by the file they are in
+         *
+         * Units are diagnosed in parallel, results are cached until a unit is reparsed.
+         * Diagnostics from headers included by several units are only reported once.
+         */
+        diagnostic_map workspace_diagnose();
+
+        /**
+         * Calls callback with added and removed diagnostics whenever units have been reparsed
+         *
+         * Updates are delayed by interval so bursts of reparses produce a single update, the
+         * first update contains all current diagnostics. Callback runs on its own thread.
+         */
+        void diagnostics_subscribe(diagnostic_publisher::callback_t callback,
+            std::chrono::milliseconds interval = std::chrono::milliseconds(100));
+
+        /** Stops diagnostic updates, must not be called from within the callback */
+        void diagnostics_unsubscribe();
+
+        /**
+         * Returns call counts and latency percentiles of all entry points and libclang calls
+         *
+         * Lock wait times are reported as lock_tool and lock_unit. Statistics are process
+         * wide and shared by all tool instances.
+         */
+        std::vector<stat_entry> stats();
+
+        /** Resets all statistics */
+        void stats_reset();
+
+        /**
+         * Starts recording spans of all entry points, libclang calls and lock waits
+         *
+         * Recording is process wide, earlier spans are dropped.
+         */
+        void trace_start();
+
+        /** Stops recording spans */
+        void trace_stop();
+
+        /** Writes recorded spans as Chrome trace JSON to path, returns false on failure */
+        bool trace_dump(const char* path);
+
+        /**
+         * Starts recording all calls which change or query the index into a binary log at path
+         *
+         * Unsaved content is recorded as well, so the log can be replayed without the editor.
+         * Start recording on an empty index for a faithful replay. Returns false if path could
+         * not be opened.
+         */
+        bool record_start(const char* path);
+
+        /** Stops recording calls */
+        void record_stop();
+
+        /**
+         * Moves all translation units into n worker processes
+         *
+         * Each unit is parsed by a single worker, a crash in libclang only takes down that
+         * worker. It is restarted and reparses its units, except the one it crashed on. The
+         * index is cleared, start the workers before adding files. Must not be called while
+         * other requests are running. Workers run executable, worker_pool::default_executable()
+         * if it is null. Returns false if the workers could not be started.
+         */
+        bool workers_start(uint32_t n, const char* executable = nullptr);
+
+        /** Stops all workers, their units are gone, must not be called while other requests are running */
+        void workers_stop();
+
+        /** Moves units from the worker using the most memory to the one using the least */
+        void workers_rebalance();
+
+        /** Answers requests of a worker pool on fd until it is closed, entry point of clang_tool_worker */
+        void serve(int fd);
+
+        /** Invokes clang's code completion, promotes light units */
         completion_list cursor_complete(const char* path, uint32_t row, uint32_t col);
 
         /** Returns type under cursor */
@@ -128,11 +263,99 @@ namespace clang {
 
         /** Returns where the location under the cursor is defined */
         location cursor_definition(const char* path, uint32_t row, uint32_t col);
+
+        /**
+         * Returns type, locations, usr, kind and documentation of the cursor in one call
+         *
+         * The cursor is resolved once, results are memoized until the unit is reparsed.
+         */
+        cursor_details cursor_info(const char* path, uint32_t row, uint32_t col);
+
+        /**
+         * Answers many cursor queries for path in one call
+         *
+         * Answers are in the same order as queries, each query can ask for any combination
+         * of type, declaration and definition.
+         */
+        std::vector<cursor_answer> cursor_batch(const char* path, const std::vector<cursor_query>& queries);
     private:
         CXIndex mIndex;
+        unsaved_overlay mOverlay;
         translation_unit_cache mCache;
-        std::vector<const char*> mArgs;
+        compilation_database mDatabase;
+        preamble_cache mPreambles;
+        std::unordered_set<std::string> mRebuilding;
+        std::unordered_set<std::string> mWarming;
         std::mutex mMutex;
+        diagnostic_publisher mPublisher;
+        background_worker mWorker;
+        session_recorder mRecorder;
+        hibernator mHibernator;
+        std::unique_ptr<worker_pool> mPool;
+        std::vector<std::pair<std::string, std::function<void(worker_pool&)>>> mWorkerArguments;
+        std::unique_ptr<job_queue> mDiagnoseJobs;
+
+        /*
+         * Locking: mMutex guards the cache, database and preambles, each unit has its own mutex for
+         * anything touching libclang. A unit's mutex may be acquired while holding mMutex,
+         * never the other way around.
+         */
+
+        /** Returns true if requests are handled by worker processes */
+        bool pooled() {
+            return mPool && mPool->active();
+        }
+
+        /** Keeps an argument call for workers started later, later calls with the same key replace it */
+        void remember_arguments(const std::string& key, std::function<void(worker_pool&)> call);
+
+        /** Returns the threads workspace_diagnose runs on, started by the first call */
+        job_queue& diagnose_jobs();
+
+        /** Returns unit at path and marks it as accessed, nullptr if it is not on the index */
+        translation_unit_shared find(const char* path);
+
+        /** Loads a hibernated unit and rebuilds its preamble in the background */
+        void wake(const std::string& path, const translation_unit_shared& unit);
+
+        /** Queues all units idle for longer than idle for hibernation */
+        void hibernate_idle(std::chrono::milliseconds idle);
+
+        /** Hibernates unit at path if it is still idle */
+        void hibernate(const std::string& path, std::chrono::milliseconds idle);
+
+        /** Like find, but promotes light units to a full parse first */
+        translation_unit_shared find_full(const char* path);
+
+        /** Reparses a light unit with the full tier */
+        void promote(const std::string& path, const translation_unit_shared& unit);
+
+        /** Returns diagnostics of the unit at path without marking it as accessed */
+        diagnostic_list_shared diagnostics(const std::string& path);
+
+        /** Returns a copy of all cache entries */
+        std::vector<std::pair<std::string, translation_unit_shared>> units();
+
+        /** Builds the preamble of unit in the background */
+        void schedule_warmup(const std::string& path, const translation_unit_shared& unit);
+
+        /** Schedules a rebuild for all units whose arguments differ from the ones in the database */
+        void invalidate_arguments();
+
+        /** Rebuilds unit in the background, requires mMutex */
+        void schedule_rebuild(const std::string& path, const translation_unit_shared& unit);
+
+        /** Parses path with its current arguments, tier and shared preamble and replaces the old unit */
+        void rebuild(const std::string& path);
+
+        /** Moves unit to the preamble group matching key, builds or drops shared preambles as needed */
+        void sync_preamble(const std::string& path, const translation_unit_shared& unit, const preamble_key& key);
+
+        /** Builds the shared preamble of group and rebuilds all its members */
+        void build_preamble(const std::string& group, const shared_preamble_ptr& preamble);
+
+        /** Reparses all units, except the one at skip, which include a file changed in the overlay */
+        void reparse_dependents(const char* skip);
     };
 }
 
@@ -0,0 +1,167 @@
+/**
+* @file clang_trace.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <algorithm>
+#include <fstream>
+
+#include "clang_trace.hpp"
+
+namespace clang {
+    std::atomic<bool> tracer::sEnabled(false);
+    std::atomic<uint64_t> tracer::sCleared(0);
+    std::atomic<uint32_t> tracer::sThreads(0);
+
+    void tracer::span(const char* name, std::chrono::steady_clock::time_point start,
+        std::chrono::steady_clock::time_point end)
+    {
+        ring& r = local();
+        uint64_t head = r.head.load(std::memory_order_relaxed);
+
+        event& e = r.events[head % capacity];
+        e.seq.store(2*head + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        e.name.store(name, std::memory_order_relaxed);
+        e.start.store(std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count(),
+            std::memory_order_relaxed);
+        e.duration.store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+            std::memory_order_relaxed);
+
+        // publish after the event has been written
+        e.seq.store(2*head + 2, std::memory_order_release);
+        r.head.store(head + 1, std::memory_order_release);
+    }
+
+    bool tracer::dump(const char* path) {
+        std::ofstream output(path, std::ofstream::out);
+        if (!output)
+            return false;
+
+        std::vector<std::shared_ptr<ring>> all;
+        {
+            std::lock_guard<std::mutex> l(rings_mutex());
+            all = rings();
+        }
+
+        uint64_t cleared = sCleared.load(std::memory_order_relaxed);
+        output << "{\"traceEvents\":[";
+        bool first = true;
+
+        for (auto &r : all) {
+            output << (first ? "" : ",") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << r->tid
+                   << ",\"args\":{\"name\":\"thread " << r->tid << "\"}}";
+            first = false;
+
+            uint64_t head = r->head.load(std::memory_order_acquire);
+            uint64_t begin = head > capacity ? head - capacity : 0;
+
+            for (uint64_t i = begin; i < head; ++i) {
+                const event& e = r->events[i % capacity];
+
+                // skip spans the thread is overwriting while we read them
+                if (e.seq.load(std::memory_order_acquire) != 2*i + 2)
+                    continue;
+
+                const char* name = e.name.load(std::memory_order_relaxed);
+                uint64_t start = e.start.load(std::memory_order_relaxed);
+                uint64_t duration = e.duration.load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (e.seq.load(std::memory_order_relaxed) != 2*i + 2 || start < cleared)
+                    continue;
+
+                output << ",{\"name\":\"" << name << "\",\"cat\":\"clang\",\"ph\":\"X\",\"pid\":1,\"tid\":" << r->tid
+                       << ",\"ts\":" << start / 1000 << "." << (start % 1000) / 100
+                       << ",\"dur\":" << duration / 1000 << "." << (duration % 1000) / 100 << "}";
+            }
+        }
+
+        output << "]}" << std::endl;
+        return output.good();
+    }
+
+    void tracer::clear() {
+        // rings belong to their threads, older spans are skipped on dump instead
+        sCleared.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count(), std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> l(rings_mutex());
+        prune();
+    }
+
+    tracer::ring& tracer::local() {
+        thread_local ring_owner owner;
+
+        if (!owner.r) {
+            owner.r = std::make_shared<ring>();
+            owner.r->head.store(0, std::memory_order_relaxed);
+            owner.r->finished = 0;
+            owner.r->tid = ++sThreads;
+
+            for (auto &e : owner.r->events) {
+                e.seq.store(0, std::memory_order_relaxed);
+            }
+
+            std::lock_guard<std::mutex> l(rings_mutex());
+            prune();
+            rings().push_back(owner.r);
+        }
+
+        return *owner.r;
+    }
+
+    void tracer::retire(const std::shared_ptr<ring>& r) {
+        // spans of finished threads still show up in the dump until they are cleared
+        uint64_t head = r->head.load(std::memory_order_relaxed);
+        uint64_t last = head ? r->events[(head - 1) % capacity].start.load(std::memory_order_relaxed) : 0;
+
+        std::lock_guard<std::mutex> l(rings_mutex());
+        if (last) {
+            r->finished = last;
+            prune();
+            return;
+        }
+
+        auto& all = rings();
+        all.erase(std::remove(all.begin(), all.end(), r), all.end());
+    }
+
+    void tracer::prune() {
+        uint64_t cleared = sCleared.load(std::memory_order_relaxed);
+        auto& all = rings();
+
+        all.erase(std::remove_if(all.begin(), all.end(), [&](const std::shared_ptr<ring>& r) {
+            return r->finished && r->finished <= cleared;
+        }), all.end());
+    }
+
+    std::vector<std::shared_ptr<tracer::ring>>& tracer::rings() {
+        static std::vector<std::shared_ptr<ring>> instance;
+        return instance;
+    }
+
+    std::mutex& tracer::rings_mutex() {
+        static std::mutex instance;
+        return instance;
+    }
+}
@@ -0,0 +1,121 @@
+/**
+* @file clang_trace.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_TRACE_HPP_
+#define _RD_CLANG_TRACE_HPP_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+#include "noncopyable.hpp"
+
+namespace clang {
+    /**
+     * Opt-in recorder for spans which can be dumped as Chrome trace JSON
+     *
+     * Each thread writes into its own ring buffer without any locking, only the most recent
+     * spans per thread are kept. The result can be loaded in chrome://tracing or Perfetto.
+     * While disabled, recording a span costs a single relaxed load.
+     */
+    class tracer : private noncopyable {
+    public:
+        /// Number of spans kept per thread
+        static const uint32_t capacity = 1 << 14;
+
+        /** Returns true if spans are being recorded */
+        static bool enabled() {
+            return sEnabled.load(std::memory_order_relaxed);
+        }
+
+        /** Starts or stops recording */
+        static void enable(bool enabled) {
+            sEnabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        /** Records a span on the calling thread, name must be a string literal */
+        static void span(const char* name, std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end);
+
+        /** Writes all recorded spans to path, returns false if the file could not be written */
+        static bool dump(const char* path);
+
+        /** Drops all recorded spans */
+        static void clear();
+    private:
+        /**
+         * Single span, guarded by a sequence so dump can read it while the thread writes
+         *
+         * seq is odd while event n is being written and 2*n+2 once it is complete.
+         */
+        struct event {
+            std::atomic<uint64_t> seq;
+            std::atomic<const char*> name;
+            std::atomic<uint64_t> start;
+            std::atomic<uint64_t> duration;
+        };
+
+        /** Spans of a single thread, only written by that thread */
+        struct ring {
+            uint32_t tid;
+            std::atomic<uint64_t> head;
+            /// Start of the newest span once the thread finished, 0 while it is running
+            uint64_t finished;
+            event events[capacity];
+        };
+
+        /** Owns the ring of a thread, retires it when the thread ends */
+        struct ring_owner {
+            std::shared_ptr<ring> r;
+
+            ~ring_owner() {
+                if (r)
+                    retire(r);
+            }
+        };
+
+        static std::atomic<bool> sEnabled;
+        static std::atomic<uint64_t> sCleared;
+        static std::atomic<uint32_t> sThreads;
+
+        /** Returns ring of the calling thread, registers it on first use */
+        static ring& local();
+
+        /** Marks the ring of a finished thread, it is dropped once its spans have been cleared */
+        static void retire(const std::shared_ptr<ring>& r);
+
+        /** Drops finished rings without spans newer than the last clear, rings_mutex() must be held */
+        static void prune();
+
+        /** Returns all rings of running threads and finished ones with spans left */
+        static std::vector<std::shared_ptr<ring>>& rings();
+
+        /** Mutex guarding rings() */
+        static std::mutex& rings_mutex();
+    };
+}
+
+#endif /* _RD_CLANG_TRACE_HPP_ */
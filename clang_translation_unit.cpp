@@ -20,6 +20,17 @@
 *   limitations under the License.
 */
 
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <cstdint>
+#include <ctime>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include "clang_diagnostic.hpp"
 #include "clang_location.hpp"
 #include "clang_translation_unit.hpp"
@@ -27,7 +38,221 @@
 #include "clang_ast_visitor.hpp"
 
 namespace clang {
+    namespace {
+        /** Returns type of cursor, followed by its canonical type if they differ */
+        std::string type_of(CXCursor cursor) {
+            if (clang_Cursor_isNull(cursor) || clang_isInvalid(clang_getCursorKind(cursor)))
+                return "";
+
+            CXType type = clang_getCursorType(cursor);
+            CXType real_type = clang_getCanonicalType( type );
+
+            std::string ret = cx2std(clang_getTypeSpelling(type));
+
+            if (!clang_equalTypes(type, real_type)) {
+                ret.append(" - ");
+                ret.append(cx2std(clang_getTypeSpelling(real_type)));
+            }
+
+            return ret;
+        }
+
+        /** Returns the location of ref, file names are looked up in names first if given */
+        location location_of(CXCursor ref, std::unordered_map<CXFile, std::string>* names = nullptr) {
+            if (clang_Cursor_isNull(ref) || clang_isInvalid(clang_getCursorKind(ref)))
+                return {"", 0, 0};
+
+            CXSourceLocation loc = clang_getCursorLocation(ref);
+
+            CXFile file;
+            uint32_t nrow, ncol, offset = 0;
+
+            clang_getExpansionLocation( loc, &file, &nrow, &ncol, &offset );
+
+            if (!names)
+                return { cx2std(clang_getFileName(file)), nrow, ncol };
+
+            auto it = names->find(file);
+            if (it == names->end())
+                it = names->insert(std::make_pair(file, cx2std(clang_getFileName(file)))).first;
+
+            return { it->second, nrow, ncol };
+        }
+
+        /** Collects all files of a unit, the main file included */
+        void visitor_files(CXFile file, CXSourceLocation* stack, unsigned len, CXClientData client_data) {
+            reinterpret_cast<std::vector<std::string>*>(client_data)->push_back(cx2std(clang_getFileName(file)));
+        }
+    }
+
+    CXTranslationUnit translation_unit::parse(CXIndex idx, const std::string& path, const argument_set& args,
+        const unsaved_files_shared& files, const shared_preamble_ptr& pch, parse_tier tier, uint64_t* elapsed)
+    {
+        scoped_timer t(stat_op::clang_parse);
+        std::vector<CXUnsavedFile> cxFiles;
+        cxFiles.reserve(files->entries.size());
+
+        for (auto &f : files->entries) {
+            cxFiles.push_back({f.first.c_str(), f.second->data(), f.second->size()});
+        }
+
+        CXTranslationUnit ret;
+        if (!pch) {
+            ret = clang_parseTranslationUnit(
+                idx, path.c_str(), args.data(), args.size(), cxFiles.data(), cxFiles.size(), parsing_options(tier)
+            );
+        } else {
+            // the shared header replaces our own preamble
+            std::vector<const char*> cxArgs(args.data(), args.data()+args.size());
+            cxArgs.push_back("-include-pch");
+            cxArgs.push_back(pch->pch().c_str());
+
+            ret = clang_parseTranslationUnit(
+                idx, path.c_str(), cxArgs.data(), cxArgs.size(), cxFiles.data(), cxFiles.size(),
+                parsing_options(tier) & ~CXTranslationUnit_PrecompiledPreamble
+            );
+        }
+
+        if (elapsed)
+            *elapsed = t.elapsed();
+
+        return ret;
+    }
+
+    bool translation_unit::hibernate(CXIndex idx, const std::string& file) {
+        if (mHibernated || !mUnit)
+            return false;
+
+        if (mTier == parse_tier::full) {
+            if (file.empty())
+                return false;
+
+            scoped_timer t(stat_op::clang_save);
+            if (clang_saveTranslationUnit(mUnit, file.c_str(), clang_defaultSaveOptions(mUnit)) != 0) {
+                unlink(file.c_str());
+                return false;
+            }
+
+            mHibernation = file;
+        }
+
+        clang_disposeTranslationUnit(mUnit);
+        mUnit = nullptr;
+        mIndex = idx;
+        mHibernatedAt = time(nullptr);
+        mHibernated = true;
+
+        // diagnostics are kept so publishing them does not wake the unit
+        mTokenColumns.clear();
+        mQueries.clear();
+        mInfo.clear();
+        mLineTokens.clear();
+        mStaleTokens.clear();
+        mTokenLines = nullptr;
+        mLines = nullptr;
+        mCxUnsaved.clear();
+
+        return true;
+    }
+
+    bool translation_unit::wake(bool refresh) {
+        if (!mHibernated)
+            return false;
+
+        mHibernated = false;
+        mPreambleState = preamble_state::none;
+        mPreambleStale = true;
+
+        if (!mHibernation.empty()) {
+            scoped_timer t(stat_op::clang_load);
+            mUnit = clang_createTranslationUnit(mIndex, mHibernation.c_str());
+        }
+
+        drop_hibernation();
+
+        if (!mUnit) {
+            // light units have not been saved, parse them again like a failed load
+            reload();
+        } else {
+            // good enough for queries, the first reparse or completion parses from source
+            mLoaded = true;
+
+            if (refresh && changed_while_hibernated())
+                this->refresh();
+        }
+
+        // units loaded from disk have no preamble of their own
+        mPreambleBuilt = false;
+        return true;
+    }
+
+    void translation_unit::reload() {
+        if (!mIndex)
+            return;
+
+        unsaved_files_shared files = mOverlay ? mOverlay->snapshot() : std::make_shared<unsaved_files>();
+        unsaved_files_shared parseFiles = files;
+
+        // our own unsaved content takes precedence over the overlay
+        if (mUnsaved) {
+            auto own = std::make_shared<unsaved_files>();
+            own->version = files->version;
+
+            for (auto &f : files->entries) {
+                if (f.first != mName)
+                    own->entries.push_back(f);
+            }
+
+            own->entries.push_back(std::make_pair(mName, mUnsaved));
+            parseFiles = own;
+        }
+
+        if (mUnit)
+            clang_disposeTranslationUnit(mUnit);
+
+        uint64_t elapsed = 0;
+        mUnit = parse(mIndex, mName, *arguments(), parseFiles, pch(), mTier, &elapsed);
+        parsed(elapsed);
+
+        mOverlayFiles = files;
+        mOverlayVersion = files->version;
+        mLoaded = false;
+        mPreambleBuilt = false;
+        ++mGeneration;
+    }
+
+    void translation_unit::drop_hibernation() {
+        if (mHibernation.empty())
+            return;
+
+        unlink(mHibernation.c_str());
+        mHibernation.clear();
+    }
+
+    bool translation_unit::changed_while_hibernated() {
+        std::unordered_set<std::string> changed;
+        if (mOverlay) {
+            for (auto &path : mOverlay->changed_since(mOverlayVersion)) {
+                changed.insert(std::move(path));
+            }
+        }
+
+        std::vector<std::string> files;
+        clang_getInclusions(mUnit, visitor_files, &files);
+
+        for (auto &file : files) {
+            struct stat st;
+            if (changed.count(file) || stat(file.c_str(), &st) != 0 || st.st_mtime >= mHibernatedAt)
+                return true;
+        }
+
+        return false;
+    }
+
     ast_element translation_unit::ast() {
+        wake();
+        scoped_timer t(stat_op::clang_ast_walk);
+
         // Prepare structure
         ast_element e;
         e.top_name = mName;
@@ -39,15 +264,22 @@ namespace clang {
         return e;
     }
 
-    std::vector<diagnostic> translation_unit::diagnose() {
+    diagnostic_list_shared translation_unit::diagnostics() {
+        sync_queries();
+
+        if (mDiagnostics)
+            return mDiagnostics;
+
+        wake();
+        sync_queries();
+
+        scoped_timer t(stat_op::clang_diagnose);
+
         // Get all the diagnostics
         uint32_t n = clang_getNumDiagnostics(mUnit);
 
-        if (n == 0)
-            return {};
-
-        std::vector<diagnostic> ret;
-        ret.reserve(n);
+        auto ret = std::make_shared<std::vector<diagnostic>>();
+        ret->reserve(n);
 
         for (uint32_t i = 0; i < n; ++i) {
             CXFile file;
@@ -57,7 +289,7 @@ namespace clang {
             CXSourceLocation loc = clang_getDiagnosticLocation(diag);
             clang_getExpansionLocation( loc, &file, &row, &col, &offset );
 
-            ret.push_back({
+            ret->push_back({
                 { cx2std(clang_getFileName(file)), row, col },
                 clang_getDiagnosticSeverity(diag),
                 diagnostic_text(diag),
@@ -67,18 +299,27 @@ namespace clang {
             clang_disposeDiagnostic(diag);
         }
 
-        return ret;
+        mDiagnostics = ret;
+        return mDiagnostics;
     }
 
     completion_list translation_unit::complete_at(uint32_t row, uint32_t col) {
         completion_list ret;
         CXCodeCompleteResults *res;
 
-        if (mCxUnsaved) {
-            res = clang_codeCompleteAt(mUnit, mName.c_str(), row, col, mCxUnsaved, 1, 0);
+        wake();
+        if (mLoaded)
+            reload();
+
+        // completion sees the latest overlay, but the unit is not reparsed with it, so its
+        // overlay version stays put and reparse_dependents still picks it up
+        unsaved_files_shared files = mOverlay ? mOverlay->snapshot() : mOverlayFiles;
+        std::vector<CXUnsavedFile> unsaved;
+        collect_unsaved(files, unsaved);
+        {
+            scoped_timer t(stat_op::clang_complete);
+            res = clang_codeCompleteAt(mUnit, mName.c_str(), row, col, unsaved.data(), unsaved.size(), 0);
         }
-        else
-            res = clang_codeCompleteAt(mUnit, mName.c_str(), row, col, nullptr, 0, 0);
 
         for (uint32_t i = 0; i < res->NumResults; ++i) {
             // skip all private members
@@ -143,53 +384,310 @@ namespace clang {
     }
 
     std::string translation_unit::type_at(uint32_t row, uint32_t col) {
-        CXCursor cursor = get_cursor_at(row, col);
+        query_entry& e = query_entry_at(row, col);
 
-        if (clang_Cursor_isNull(cursor) || clang_isInvalid(clang_getCursorKind(cursor)))
-            return "";
+        if (!(e.kinds & cursor_query_type)) {
+            e.answer.type = type_of(get_cursor_at(row, col));
+            e.kinds |= cursor_query_type;
+        }
 
-        CXType type = clang_getCursorType(cursor);
-        CXType real_type = clang_getCanonicalType( type );
+        return e.answer.type;
+    }
 
-        std::string ret = cx2std(clang_getTypeSpelling(type));
+    location translation_unit::declaration_location_at(uint32_t row, uint32_t col) {
+        query_entry& e = query_entry_at(row, col);
 
-        if (!clang_equalTypes(type, real_type)) {
-            ret.append(" - ");
-            ret.append(cx2std(clang_getTypeSpelling(real_type)));
+        if (!(e.kinds & cursor_query_declaration)) {
+            e.answer.declaration = location_of(clang_getCursorReferenced(get_cursor_at(row, col)));
+            e.kinds |= cursor_query_declaration;
+        }
+
+        return e.answer.declaration;
+    }
+
+    location translation_unit::definition_location_at(uint32_t row, uint32_t col) {
+        query_entry& e = query_entry_at(row, col);
+
+        if (!(e.kinds & cursor_query_definition)) {
+            e.answer.definition = location_of(clang_getCursorDefinition(get_cursor_at(row, col)));
+            e.kinds |= cursor_query_definition;
+        }
+
+        return e.answer.definition;
+    }
+
+    uint64_t translation_unit::token_key(uint32_t row, uint32_t col) {
+        auto it = mTokenColumns.find(row);
+
+        if (it == mTokenColumns.end()) {
+            // tokenize the whole line once, later queries on it only need a lookup
+            std::vector<std::pair<uint32_t, uint32_t>> columns;
+            CXFile file = clang_getFile(mUnit, mName.c_str());
+
+            if (file) {
+                CXSourceRange range = clang_getRange(
+                    clang_getLocation(mUnit, file, row, 1), clang_getLocation(mUnit, file, row+1, 1)
+                );
+
+                CXToken* tokens = nullptr;
+                uint32_t n = 0;
+                clang_tokenize(mUnit, range, &tokens, &n);
+
+                for (uint32_t i = 0; i < n; ++i) {
+                    CXSourceRange extent = clang_getTokenExtent(mUnit, tokens[i]);
+                    uint32_t srow, scol, erow, ecol;
+
+                    clang_getSpellingLocation(clang_getRangeStart(extent), nullptr, &srow, &scol, nullptr);
+                    clang_getSpellingLocation(clang_getRangeEnd(extent), nullptr, &erow, &ecol, nullptr);
+
+                    if (srow == row)
+                        columns.push_back(std::make_pair(scol, erow == row ? ecol : UINT32_MAX));
+                }
+
+                clang_disposeTokens(mUnit, tokens, n);
+            }
+
+            it = mTokenColumns.insert(std::make_pair(row, std::move(columns))).first;
+        }
+
+        // positions outside of any token are keyed by themselves
+        uint32_t start = col;
+        for (auto &token : it->second) {
+            if (token.first <= col && col < token.second) {
+                start = token.first;
+                break;
+            }
+        }
+
+        return (static_cast<uint64_t>(row) << 32) | start;
+    }
+
+    std::vector<token> translation_unit::tokens(uint32_t first, uint32_t last) {
+        wake();
+        sync_tokens();
+
+        std::vector<token> ret;
+        line_index_shared idx = lines();
+        last = std::min<uint32_t>(last, idx->rows());
+
+        if (first == 0 || first > last)
+            return ret;
+
+        // rows which are neither cached nor unchanged since the last generation
+        uint32_t missFirst = 0, missLast = 0;
+        for (uint32_t row = first; row <= last; ++row) {
+            if (mLineTokens.count(row))
+                continue;
+
+            size_t hash = line_hash(row);
+            auto stale = mStaleTokens.find(std::make_pair(hash, stale_row(row)));
+
+            if (stale != mStaleTokens.end()) {
+                mLineTokens[row] = {hash, stale->second};
+                continue;
+            }
+
+            if (!missFirst)
+                missFirst = row;
+
+            missLast = row;
+        }
+
+        if (missFirst)
+            annotate_lines(missFirst, missLast);
+
+        for (uint32_t row = first; row <= last; ++row) {
+            uint32_t begin = idx->row_begin(row);
+
+            for (auto &t : mLineTokens[row].tokens) {
+                ret.push_back({begin + t.offset, t.length, t.cursor, t.kind});
+            }
         }
 
         return ret;
     }
 
-    location translation_unit::declaration_location_at(uint32_t row, uint32_t col) {
-        CXCursor cursor = get_cursor_at(row, col);
-        CXCursor ref = clang_getCursorReferenced( cursor );
+    void translation_unit::sync_tokens() {
+        line_index_shared idx = lines();
+        if (mTokenGeneration == mGeneration) {
+            mTokenLines = idx;
+            return;
+        }
 
-        if (clang_Cursor_isNull(ref) || clang_isInvalid(clang_getCursorKind(ref)))
-            return {"", 0, 0};
+        mStaleTokens.clear();
+        mStaleHead = mStaleTail = 0;
+        mStaleDelta = 0;
+
+        if (mTokenLines && mTokenLines->buffer() && idx->buffer()) {
+            const unsaved_buffer& prev = *mTokenLines->buffer();
+            const unsaved_buffer& cur = *idx->buffer();
+            uint32_t size = std::min(prev.size(), cur.size());
+
+            // bytes in common at the start and end, the edited region lies in between
+            uint32_t head = 0;
+            while (head < size && prev.data()[head] == cur.data()[head])
+                ++head;
+
+            uint32_t tail = 0;
+            while (tail < size - head && prev.data()[prev.size()-tail-1] == cur.data()[cur.size()-tail-1])
+                ++tail;
+
+            uint32_t prevRows = mTokenLines->rows(), rows = idx->rows();
+            while (mStaleHead < std::min(prevRows, rows) && mTokenLines->row_end(mStaleHead+1) <= head)
+                ++mStaleHead;
+
+            // rows unchanged at the end, counted from the last one
+            uint32_t tailRows = 0;
+            while (tailRows < std::min(prevRows, rows) - mStaleHead &&
+                   prev.size() - mTokenLines->row_begin(prevRows - tailRows) <= tail)
+                ++tailRows;
+
+            if (tailRows) {
+                mStaleTail = rows - tailRows + 1;
+                mStaleDelta = static_cast<int64_t>(rows) - prevRows;
+            }
+
+            for (auto &line : mLineTokens) {
+                mStaleTokens[std::make_pair(line.second.hash, line.first)] = std::move(line.second.tokens);
+            }
+        }
 
-        CXSourceLocation loc = clang_getCursorLocation(ref);
+        mLineTokens.clear();
+        mTokenLines = idx;
+        mTokenGeneration = mGeneration;
+    }
 
-        CXFile file;
-        uint32_t nrow, ncol, offset = 0;
+    size_t translation_unit::line_hash(uint32_t row) {
+        line_index_shared idx = lines();
+        uint32_t begin = idx->row_begin(row);
 
-        clang_getExpansionLocation( loc, &file, &nrow, &ncol, &offset );
-        return { cx2std(clang_getFileName(file)), nrow, ncol };
+        return std::hash<std::string>()(std::string(idx->buffer()->data() + begin, idx->row_end(row) - begin));
     }
 
-    location translation_unit::definition_location_at(uint32_t row, uint32_t col) {
+    void translation_unit::annotate_lines(uint32_t first, uint32_t last) {
+        line_index_shared idx = lines();
+
+        std::unordered_map<uint32_t, line_tokens> fresh;
+        for (uint32_t row = first; row <= last; ++row) {
+            if (!mLineTokens.count(row))
+                fresh[row].hash = line_hash(row);
+        }
+
+        CXFile file = clang_getFile(mUnit, mName.c_str());
+        if (file) {
+            scoped_timer t(stat_op::clang_annotate);
+
+            CXSourceRange range = clang_getRange(
+                clang_getLocationForOffset(mUnit, file, idx->row_begin(first)),
+                clang_getLocationForOffset(mUnit, file, idx->row_end(last))
+            );
+
+            CXToken* tokens = nullptr;
+            uint32_t n = 0;
+            clang_tokenize(mUnit, range, &tokens, &n);
+
+            std::vector<CXCursor> cursors(n);
+            clang_annotateTokens(mUnit, tokens, n, cursors.data());
+
+            for (uint32_t i = 0; i < n; ++i) {
+                CXSourceRange extent = clang_getTokenExtent(mUnit, tokens[i]);
+                uint32_t row, col, offset, endOffset;
+
+                clang_getSpellingLocation(clang_getRangeStart(extent), nullptr, &row, &col, &offset);
+                clang_getSpellingLocation(clang_getRangeEnd(extent), nullptr, nullptr, nullptr, &endOffset);
+
+                auto it = fresh.find(row);
+                if (it == fresh.end())
+                    continue;
+
+                it->second.tokens.push_back({
+                    offset - idx->row_begin(row), endOffset - offset,
+                    static_cast<uint16_t>(clang_getCursorKind(cursors[i])),
+                    static_cast<uint8_t>(clang_getTokenKind(tokens[i]))
+                });
+            }
+
+            clang_disposeTokens(mUnit, tokens, n);
+        }
+
+        for (auto &line : fresh) {
+            mLineTokens[line.first] = std::move(line.second);
+        }
+    }
+
+    const cursor_details& translation_unit::info_at(uint32_t row, uint32_t col) {
+        wake();
+        sync_queries();
+
+        uint64_t key = token_key(row, col);
+        auto it = mInfo.find(key);
+        if (it != mInfo.end())
+            return it->second;
+
+        cursor_details ret{"", "", {"", 0, 0}, {"", 0, 0}, "", "", "", ""};
         CXCursor cursor = get_cursor_at(row, col);
-        CXCursor ref = clang_getCursorDefinition( cursor );
 
-        if (clang_Cursor_isNull(ref) || clang_isInvalid(clang_getCursorKind(ref)))
-            return {"", 0, 0};
+        if (!clang_Cursor_isNull(cursor) && !clang_isInvalid(clang_getCursorKind(cursor))) {
+            CXType type = clang_getCursorType(cursor);
+            ret.type = cx2std(clang_getTypeSpelling(type));
+            ret.canonical_type = cx2std(clang_getTypeSpelling(clang_getCanonicalType(type)));
+
+            CXCursor ref = clang_getCursorReferenced(cursor);
+            ret.declaration = location_of(ref);
+            ret.definition = location_of(clang_getCursorDefinition(cursor));
+
+            // usr, kind and docs belong to the referenced entity, not the use
+            CXCursor entity = clang_Cursor_isNull(ref) || clang_isInvalid(clang_getCursorKind(ref)) ? cursor : ref;
+            ret.usr = cx2std(clang_getCursorUSR(entity));
+            ret.kind = cx2std(clang_getCursorKindSpelling(clang_getCursorKind(entity)));
+            ret.brief = cx2std(clang_Cursor_getBriefCommentText(entity));
+
+            CXComment doc = clang_Cursor_getParsedComment(entity);
+            if (clang_Comment_getKind(doc) == CXComment_FullComment)
+                ret.doc = cx2std(clang_FullComment_getAsHTML(doc));
+        }
+
+        return mInfo.insert(std::make_pair(key, std::move(ret))).first->second;
+    }
+
+    std::vector<cursor_answer> translation_unit::query_at(const std::vector<cursor_query>& queries) {
+        std::vector<cursor_answer> ret(queries.size(), cursor_answer{"", {"", 0, 0}, {"", 0, 0}});
+
+        wake();
+        CXFile file = clang_getFile(mUnit, mName.c_str());
+        if (!file)
+            return ret;
+
+        // answer in source order, neighbouring positions hit the same parts of the ast
+        std::vector<uint32_t> order(queries.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return queries[a].row < queries[b].row || (queries[a].row == queries[b].row && queries[a].col < queries[b].col);
+        });
+
+        std::unordered_map<CXFile, std::string> names;
+        CXCursor cursor = clang_getNullCursor();
+        const cursor_query* last = nullptr;
+
+        for (uint32_t i : order) {
+            const cursor_query& q = queries[i];
 
-        CXSourceLocation loc = clang_getCursorLocation(ref);
+            // duplicate positions resolve the cursor only once
+            if (!last || last->row != q.row || last->col != q.col) {
+                cursor = clang_getCursor(mUnit, clang_getLocation(mUnit, file, q.row, q.col));
+                last = &q;
+            }
+
+            if (q.kinds & cursor_query_type)
+                ret[i].type = type_of(cursor);
 
-        CXFile file;
-        uint32_t nrow, ncol, offset = 0;
+            if (q.kinds & cursor_query_declaration)
+                ret[i].declaration = location_of(clang_getCursorReferenced(cursor), &names);
 
-        clang_getExpansionLocation( loc, &file, &nrow, &ncol, &offset );
-        return { cx2std(clang_getFileName(file)), nrow, ncol };
+            if (q.kinds & cursor_query_definition)
+                ret[i].definition = location_of(clang_getCursorDefinition(cursor), &names);
+        }
+
+        return ret;
     }
-}
\ No newline at end of file
+}
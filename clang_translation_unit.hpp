@@ -24,8 +24,15 @@
 #define _RD_TRANSLATION_UNIT_
 
 #include <memory>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <chrono>
+#include <mutex>
+#include <atomic>
 #include <cstddef>
 #include <cassert>
+#include <cstring>
 #include <clang-c/Index.h>
 #include <clang-c/Documentation.h>
 #include <iostream>
@@ -36,23 +43,55 @@
 
 #include "clang_ast.hpp"
 #include "clang_completion_result.hpp"
+#include "clang_cursor_query.hpp"
+#include "clang_token.hpp"
+#include "clang_line_index.hpp"
+#include "clang_diagnostic.hpp"
+#include "clang_stats.hpp"
+#include "clang_unsaved_buffer.hpp"
+#include "clang_unsaved_overlay.hpp"
+#include "clang_compilation_database.hpp"
+#include "clang_preamble.hpp"
+#include "clang_preamble_cache.hpp"
 
 namespace clang {
     // forward decl
     struct location;
-    struct diagnostic;
+
+    /** Amount of information kept for a translation unit */
+    enum class parse_tier {
+        light = 0, // function bodies skipped, no completion cache, enough for navigation
+        full = 1   // everything needed for completion and diagnostics
+    };
 
     /** Represents a single translation unit */
     class translation_unit : private noncopyable {
+    private:
+        /** Memoized answer to cursor queries, kinds tells which fields are filled */
+        struct query_entry {
+            query_entry() : kinds(0) {}
+
+            uint32_t kinds;
+            cursor_answer answer;
+        };
+
+        /** Tokens of a single line, offsets are relative to the start of the line */
+        struct line_tokens {
+            size_t hash;
+            std::vector<token> tokens;
+        };
     public:
         /** Returns the options to use when parsing a translation unit */
-        static uint32_t parsing_options() {
+        static uint32_t parsing_options(parse_tier tier = parse_tier::full) {
+            if (tier == parse_tier::light)
+                return CXTranslationUnit_Incomplete | CXTranslationUnit_SkipFunctionBodies;
+
             return CXTranslationUnit_DetailedPreprocessingRecord |
                    CXTranslationUnit_Incomplete |
                    CXTranslationUnit_IncludeBriefCommentsInCodeCompletion |
                    CXTranslationUnit_ForSerialization |
                    CXTranslationUnit_CacheCompletionResults |
-                   clang_defaultEditingTranslationUnitOptions();
+                   CXTranslationUnit_PrecompiledPreamble;
         }
 
         /** Returns the options to use when doing code completion */
@@ -61,84 +100,584 @@ namespace clang {
                    clang_defaultCodeCompleteOptions();
         }
 
+        /**
+         * Parses path with args, unsaved content is taken from files
+         *
+         * If pch is set, the unit includes it instead of building its own preamble. If elapsed
+         * is set, it receives the time the parse took in nanoseconds.
+         */
+        static CXTranslationUnit parse(CXIndex idx, const std::string& path, const argument_set& args,
+            const unsaved_files_shared& files, const shared_preamble_ptr& pch = nullptr, parse_tier tier = parse_tier::full,
+            uint64_t* elapsed = nullptr);
+
     public:
-        /** Creates a new translation unit from the given pointer */
-        translation_unit(CXTranslationUnit unit, std::string name) : mUnit(unit), mHash{'\0'}, mName(name), mCxUnsaved(nullptr) {}
+        /**
+         * Creates a new translation unit from the given pointer, unsaved files are taken from overlay
+         *
+         * idx is the index the unit has been parsed with, it is needed to parse the unit again if
+         * libclang fails to reparse it.
+         */
+        translation_unit(CXTranslationUnit unit, std::string name, argument_set_shared args = nullptr,
+            unsaved_overlay* overlay = nullptr, parse_tier tier = parse_tier::full, CXIndex idx = nullptr)
+            : mUnit(unit), mHash{'\0'}, mName(name), mArgs(std::move(args)), mOverlay(overlay), mOverlayVersion(0),
+              mTier(tier), mGeneration(0), mQueryGeneration(0), mTokenGeneration(0), mLinesGeneration(0), mStaleHead(0), mStaleTail(0), mStaleDelta(0),
+              mPreambleState(preamble_state::none), mPreamble{"", "", 0, 0, false},
+              mPreambleStale(true), mPreambleBuilt(false), mRegionUnsaved(false),
+              mParses(0), mReparses(0), mParseTime(0), mLastParseTime(0), mQueryCounts{0},
+              mIndex(idx), mLoaded(false), mHibernated(false), mHibernatedAt(0)
+        {
+            if (mOverlay)
+                mOverlayVersion = mOverlay->version();
+
+            touch();
+        }
 
         /** Cleans up */
         ~translation_unit() {
             if (mUnit)
                 clang_disposeTranslationUnit(mUnit);
 
-            if (mCxUnsaved)
-                delete mCxUnsaved;
+            drop_hibernation();
         }
 
-        /** Retruns pointer to stored unit */
+        /** Retruns pointer to stored unit, nullptr while hibernated */
         CXTranslationUnit ptr() {
             return mUnit;
         }
 
+        /** Mutex guarding the libclang unit, needs to be held for every other method */
+        std::mutex& mutex() {
+            return mMutex;
+        }
+
         /** Returns the name as stored by clang */
         const char* name() {
             return mName.c_str();
         }
 
+        /** Returns the arguments this unit has been parsed with, safe to call without holding mutex() */
+        argument_set_shared arguments() {
+            return std::atomic_load(&mArgs);
+        }
+
+        /** Returns the shared precompiled header this unit has been parsed with, safe to call without holding mutex() */
+        shared_preamble_ptr pch() {
+            return std::atomic_load(&mPch);
+        }
+
+        /** Returns the tier this unit has been parsed with, safe to call without holding mutex() */
+        parse_tier tier() {
+            return mTier.load();
+        }
+
+        /** Returns our own unsaved content, nullptr if there is none */
+        unsaved_buffer_shared unsaved() {
+            return mUnsaved;
+        }
+
+        /** Marks this unit as accessed, safe to call without holding mutex() */
+        void touch() {
+            mLastAccess.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        }
+
+        /** Returns time of last access, safe to call without holding mutex() */
+        std::chrono::steady_clock::time_point last_access() {
+            return std::chrono::steady_clock::time_point(
+                std::chrono::steady_clock::duration(mLastAccess.load(std::memory_order_relaxed)));
+        }
+
+        /**
+         * Replaces the libclang unit, e.g. after a parse with different arguments
+         *
+         * The new unit reflects the overlay at version, if anything changed in between
+         * it is reparsed again.
+         */
+        void replace(CXTranslationUnit unit, argument_set_shared args, shared_preamble_ptr pch, uint64_t version, parse_tier tier) {
+            if (mUnit)
+                clang_disposeTranslationUnit(mUnit);
+
+            drop_hibernation();
+
+            mUnit = unit;
+            std::atomic_store(&mArgs, std::move(args));
+            std::atomic_store(&mPch, std::move(pch));
+            mTier = tier;
+            ++mGeneration;
+            mOverlayVersion = version;
+            mPreambleState = preamble_state::none;
+            mPreambleStale = true;
+            mPreambleBuilt = false;
+            mLoaded = false;
+
+            if (mOverlay && mOverlay->version() != version)
+                refresh();
+        }
+
+        /** Accounts for a parse of this unit done outside of it, e.g. before construction or replace */
+        void parsed(uint64_t elapsed) {
+            ++mParses;
+            mParseTime += elapsed;
+            mLastParseTime = elapsed;
+        }
+
+        /** Marks the unit as loaded from disk, it is parsed from source before its first reparse */
+        void loaded() {
+            mLoaded = true;
+        }
+
+        /** Counts a query answered by this unit, op is the tool entry point */
+        void count_query(stat_op op) {
+            ++mQueryCounts[static_cast<uint32_t>(op)];
+        }
+
+        /** Returns the number of queries answered through op */
+        uint64_t query_count(stat_op op) {
+            return mQueryCounts[static_cast<uint32_t>(op)];
+        }
+
+        /** Returns the number of full parses */
+        uint64_t parses() {
+            return mParses;
+        }
+
+        /** Returns the number of reparses */
+        uint64_t reparses() {
+            return mReparses;
+        }
+
+        /** Returns the time spent in parses and reparses in nanoseconds */
+        uint64_t parse_time() {
+            return mParseTime;
+        }
+
+        /** Returns the duration of the most recent parse or reparse in nanoseconds */
+        uint64_t last_parse_time() {
+            return mLastParseTime;
+        }
+
+        /** Returns a number which changes every time the unit has been reparsed or replaced */
+        uint64_t generation() {
+            return mGeneration;
+        }
+
+        /** Returns the overlay version this unit has been parsed with */
+        uint64_t overlay_version() {
+            return mOverlayVersion;
+        }
+
+        /** Returns true if path is the main file or included by this unit, hibernated units check on wake */
+        bool depends_on(const char* path) {
+            return !mHibernated && clang_getFile(mUnit, path) != nullptr;
+        }
+
+        /** Returns true if the unit has been saved to disk and disposed, safe to call without holding mutex() */
+        bool hibernated() {
+            return mHibernated.load();
+        }
+
+        /**
+         * Saves the unit to file and disposes it, memoized results except diagnostics are dropped
+         *
+         * Light units are not saved but parsed again on wake. Returns false if the unit could
+         * not be saved, it stays resident in that case.
+         */
+        bool hibernate(CXIndex idx, const std::string& file);
+
+        /**
+         * Loads a hibernated unit, returns false if it was not hibernated
+         *
+         * If refresh is set and one of the included files changed while hibernated, the unit
+         * is reparsed.
+         */
+        bool wake(bool refresh = true);
+
         /** Reparses the current tu */
         void reparse() {
-            if (mCxUnsaved) {
-                delete mCxUnsaved;
-                mCxUnsaved = nullptr;
-            }
-
-            clang_reparseTranslationUnit(mUnit, 0, nullptr, parsing_options());
+            mUnsaved.reset();
+            reparse_unit(parsing_options(mTier), true);
         }
 
-        /** Reindexes the current tu, useful to for def / decl updates */
-        void reindex() {
-            clang_reparseTranslationUnit(
-                mUnit, 0, nullptr, CXTranslationUnit_PrecompiledPreamble | CXTranslationUnit_SkipFunctionBodies
-            );
+        /** Reparses the current tu with the latest overlay, keeps unsaved content */
+        void refresh() {
+            reparse_unit(parsing_options(mTier));
         }
 
-        /** Sets unsaved content of current tu */
+        /** Sets unsaved content of current tu, content is copied */
         void set_unsaved(const char* content, uint32_t length) {
-            mUnsaved = std::string(content, length);
+            set_unsaved(unsaved_buffer::copy(content, length));
+        }
+
+        /** Sets unsaved content of current tu, buffer is referenced until the next reparse, nullptr reverts to disk */
+        void set_unsaved(unsaved_buffer_shared buffer) {
+            mUnsaved = std::move(buffer);
+            reparse_unit(parsing_options(mTier));
+        }
+
+        /** Returns state of the precompiled preamble */
+        preamble_state preamble() {
+            return mPreambleState;
+        }
+
+        /** Returns true if the preamble has not been built since the last change, light units have none */
+        bool needs_warmup() {
+            return mTier == parse_tier::full && (mPreambleState == preamble_state::none || mPreambleState == preamble_state::building);
+        }
 
-            if (mCxUnsaved)
-                delete mCxUnsaved;
+        /** Returns the key of the current preamble, calculated on demand */
+        const preamble_key& preamble_info() {
+            if (mPreambleStale)
+                update_key();
 
-            mCxUnsaved = new CXUnsavedFile();
-            mCxUnsaved->Length = length;
-            mCxUnsaved->Filename = mName.c_str();
-            mCxUnsaved->Contents = mUnsaved.c_str();
+            return mPreamble;
+        }
 
-            clang_reparseTranslationUnit(mUnit, 1, mCxUnsaved, parsing_options());
+        /** Returns the size of the preamble region in bytes as of the last key */
+        uint32_t preamble_size() {
+            return mPreamble.size;
+        }
+
+        /** Returns the number of headers covered by the preamble as of the last key */
+        uint32_t preamble_headers() {
+            return mPreamble.headers;
+        }
+
+        /**
+         * Builds the precompiled preamble
+         *
+         * libclang only creates the preamble when a unit is reparsed, doing it right away
+         * means the first completion does not have to pay for it. Units using a shared header
+         * have no preamble of their own.
+         */
+        void warmup() {
+            wake(false);
+
+            if (mPch) {
+                mPreambleState = preamble_state::shared;
+            } else {
+                // reparses after an edit rebuild the preamble right away, only fresh parses have none
+                if (!mPreambleBuilt)
+                    reparse_unit(parsing_options());
+
+                mPreambleState = preamble_state::ready;
+            }
         }
 
         /** Returns ast of this unit */
         ast_element ast();
 
         /** Returns diagnostic information about this translation unit */
-        std::vector<diagnostic> diagnose();
+        std::vector<diagnostic> diagnose() {
+            return *diagnostics();
+        }
+
+        /** Returns diagnostics without copying them, memoized until the next reparse */
+        diagnostic_list_shared diagnostics();
 
         /** Runs clang's code completion */
         completion_list complete_at(uint32_t row, uint32_t col);
 
-        /** Returns type at given position */
+        /** Returns type at given position, memoized until the next reparse */
         std::string type_at(uint32_t row, uint32_t col);
 
-        /** Returns location of declaration at given position */
+        /** Returns location of declaration at given position, memoized until the next reparse */
         location declaration_location_at(uint32_t row, uint32_t col);
 
-        /** Returns location of definition at given position */
+        /** Returns location of definition at given position, memoized until the next reparse */
         location definition_location_at(uint32_t row, uint32_t col);
+
+        /** Returns everything known about the cursor at given position, memoized until the next reparse */
+        const cursor_details& info_at(uint32_t row, uint32_t col);
+
+        /** Returns the line index of the content this unit has been parsed with, rebuilt after each reparse */
+        line_index_shared lines() {
+            if (!mLines || mLinesGeneration != mGeneration) {
+                mLines = std::make_shared<line_index>(content());
+                mLinesGeneration = mGeneration;
+            }
+
+            return mLines;
+        }
+
+        /**
+         * Returns the annotated tokens of rows first to last
+         *
+         * Tokens are cached per line. After a reparse, lines whose text did not change keep
+         * their tokens, only edited lines are tokenized again.
+         */
+        std::vector<token> tokens(uint32_t first, uint32_t last);
+
+        /** Answers many cursor queries at once, results are in the same order as queries */
+        std::vector<cursor_answer> query_at(const std::vector<cursor_query>& queries);
     private:
         CXTranslationUnit mUnit;
         char mHash[20];
         std::string mName;
-        std::string mUnsaved;
-        CXUnsavedFile* mCxUnsaved;
+        argument_set_shared mArgs;
+        shared_preamble_ptr mPch;
+        unsaved_buffer_shared mUnsaved;
+        unsaved_overlay* mOverlay;
+        unsaved_files_shared mOverlayFiles;
+        uint64_t mOverlayVersion;
+        std::atomic<parse_tier> mTier;
+        uint64_t mGeneration;
+        uint64_t mQueryGeneration;
+        std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>> mTokenColumns;
+        std::unordered_map<uint64_t, query_entry> mQueries;
+        std::unordered_map<uint64_t, cursor_details> mInfo;
+        diagnostic_list_shared mDiagnostics;
+        uint64_t mTokenGeneration;
+        uint64_t mLinesGeneration;
+        line_index_shared mLines;
+        std::unordered_map<uint32_t, line_tokens> mLineTokens;
+        line_index_shared mTokenLines;
+        std::map<std::pair<size_t, uint32_t>, std::vector<token>> mStaleTokens;
+        uint32_t mStaleHead;
+        uint32_t mStaleTail;
+        int64_t mStaleDelta;
+        std::vector<CXUnsavedFile> mCxUnsaved;
+        std::atomic<int64_t> mLastAccess;
+        preamble_state mPreambleState;
+        preamble_key mPreamble;
+        bool mPreambleStale;
+        bool mPreambleBuilt;
+        bool mRegionUnsaved;
+        std::string mRegion;
+        unsaved_files_shared mPreambleFiles;
+        uint64_t mParses;
+        uint64_t mReparses;
+        uint64_t mParseTime;
+        uint64_t mLastParseTime;
+        uint64_t mQueryCounts[static_cast<uint32_t>(stat_op::count)];
+        CXIndex mIndex;
+        bool mLoaded;
+        std::atomic<bool> mHibernated;
+        std::string mHibernation;
+        time_t mHibernatedAt;
+        std::mutex mMutex;
+
+        /**
+         * Reparses the unit with all unsaved files, keeps track of preamble changes
+         *
+         * Rekey recalculates the preamble key right away, otherwise only the region and the
+         * included unsaved files are compared, which is cheap enough for every keystroke.
+         */
+        void reparse_unit(uint32_t options, bool rekey = false) {
+            wake(false);
+
+            // units loaded from disk have no compiler invocation and can't be reparsed
+            if (mLoaded) {
+                reload();
+            } else {
+                update_unsaved();
+                int err;
+                {
+                    scoped_timer t(stat_op::clang_reparse);
+                    err = clang_reparseTranslationUnit(mUnit, mCxUnsaved.size(), mCxUnsaved.data(), options);
+
+                    mLastParseTime = t.elapsed();
+                    mParseTime += mLastParseTime;
+                    ++mReparses;
+                }
+                ++mGeneration;
+
+                // libclang keeps the preamble up to date on reparses with the full options
+                mPreambleBuilt = !err && (options & CXTranslationUnit_PrecompiledPreamble) && !mPch;
+
+                // a unit which failed to reparse may only be disposed
+                if (err)
+                    reload();
+            }
+
+            if (rekey)
+                update_preamble();
+            else
+                check_preamble();
+        }
+
+        /** Recalculates the preamble key, e.g. after headers on disk may have changed */
+        void update_preamble() {
+            // the preamble only needs to be rebuild if its region or one of the headers changed
+            std::string hash = mPreamble.hash;
+            bool stale = mPreambleStale;
+
+            update_key();
+            if ((stale || mPreamble.hash != hash) && (mPreambleState == preamble_state::ready || mPreambleState == preamble_state::shared))
+                mPreambleState = preamble_state::building;
+        }
+
+        /** Marks the preamble for a rebuild if the region or an included unsaved file changed */
+        void check_preamble() {
+            if (!mPreambleStale && !preamble_changed())
+                return;
+
+            // the key itself is calculated during warmup
+            mPreambleStale = true;
+            if (mPreambleState == preamble_state::ready || mPreambleState == preamble_state::shared)
+                mPreambleState = preamble_state::building;
+        }
+
+        /** Returns true if the content or overlay differ from the ones the key was calculated with */
+        bool preamble_changed() {
+            unsaved_buffer_shared own = unsaved_content();
+            if (!own) {
+                if (mRegionUnsaved)
+                    return true;
+            } else {
+                uint32_t size = preamble_length(own->data(), own->size());
+                if (size != mRegion.size() || memcmp(own->data(), mRegion.data(), size) != 0)
+                    return true;
+            }
+
+            if (mOverlayFiles == mPreambleFiles)
+                return false;
+
+            // unsaved headers are compared by content, only those this unit includes matter
+            std::unordered_map<std::string, const unsaved_buffer*> previous;
+            if (mPreambleFiles) {
+                for (auto &f : mPreambleFiles->entries) {
+                    previous[f.first] = f.second.get();
+                }
+            }
+
+            if (mOverlayFiles) {
+                for (auto &f : mOverlayFiles->entries) {
+                    auto it = previous.find(f.first);
+                    bool same = it != previous.end() && (it->second == f.second.get() || (
+                        it->second->size() == f.second->size() &&
+                        memcmp(it->second->data(), f.second->data(), f.second->size()) == 0));
+
+                    if (it != previous.end())
+                        previous.erase(it);
+
+                    if (!same && f.first != mName && clang_getFile(mUnit, f.first.c_str()))
+                        return true;
+                }
+            }
+
+            for (auto &f : previous) {
+                if (f.first != mName && clang_getFile(mUnit, f.first.c_str()))
+                    return true;
+            }
+
+            return false;
+        }
+
+        /** Calculates the preamble key from the content and overlay the unit has been parsed with */
+        void update_key() {
+            if (!mUnit)
+                return;
+
+            unsaved_buffer_shared own = unsaved_content();
+            unsaved_buffer_shared main = own ? own : unsaved_buffer::map(mName.c_str());
+
+            mPreamble = preamble_key_from_unit(mUnit, mName, main, mOverlayFiles);
+            mRegion.assign(main ? main->data() : "", main ? mPreamble.size : 0);
+            mRegionUnsaved = own != nullptr;
+            mPreambleFiles = mOverlayFiles;
+            mPreambleStale = false;
+        }
+
+        /** Collects our own unsaved buffer and the current overlay into mCxUnsaved, only before a reparse */
+        void update_unsaved() {
+            if (mOverlay) {
+                mOverlayFiles = mOverlay->snapshot();
+                mOverlayVersion = mOverlayFiles->version;
+            }
+
+            collect_unsaved(mOverlayFiles, mCxUnsaved);
+        }
+
+        /** Fills out with our own unsaved buffer and files, which need to outlive out */
+        void collect_unsaved(const unsaved_files_shared& files, std::vector<CXUnsavedFile>& out) {
+            out.clear();
+
+            if (files) {
+                for (auto &f : files->entries) {
+                    if (f.first != mName)
+                        out.push_back({f.first.c_str(), f.second->data(), f.second->size()});
+                }
+            }
+
+            if (mUnsaved)
+                out.push_back({mName.c_str(), mUnsaved->data(), mUnsaved->size()});
+        }
+
+        /** Drops all memoized query results if the unit changed since they were computed */
+        void sync_queries() {
+            if (mQueryGeneration == mGeneration)
+                return;
+
+            mTokenColumns.clear();
+            mQueries.clear();
+            mInfo.clear();
+            mDiagnostics = nullptr;
+            mQueryGeneration = mGeneration;
+        }
+
+        /** Returns the unsaved content this unit has been parsed with, nullptr if it used the file on disk */
+        unsaved_buffer_shared unsaved_content() {
+            if (mUnsaved)
+                return mUnsaved;
+
+            if (mOverlayFiles) {
+                for (auto &f : mOverlayFiles->entries) {
+                    if (f.first == mName)
+                        return f.second;
+                }
+            }
+
+            return nullptr;
+        }
+
+        /** Returns the content this unit has been parsed with */
+        unsaved_buffer_shared content() {
+            unsaved_buffer_shared ret = unsaved_content();
+            return ret ? ret : unsaved_buffer::map(mName.c_str());
+        }
+
+        /**
+         * Keeps the token cache of the previous generation around to reuse unchanged lines
+         *
+         * Only the unchanged rows before and after the edited region are reused, moved by the
+         * number of rows the edit added or removed.
+         */
+        void sync_tokens();
+
+        /** Returns the row of the previous generation row moved from, 0 if row was edited */
+        uint32_t stale_row(uint32_t row) {
+            if (row <= mStaleHead)
+                return row;
+
+            if (mStaleTail && row >= mStaleTail)
+                return row - mStaleDelta;
+
+            return 0;
+        }
+
+        /** Returns hash of the text of row */
+        size_t line_hash(uint32_t row);
+
+        /** Tokenizes and annotates rows first to last, skipping rows which are cached already */
+        void annotate_lines(uint32_t first, uint32_t last);
+
+        /** Returns a key shared by all positions within the same token */
+        uint64_t token_key(uint32_t row, uint32_t col);
+
+        /** Removes the file of a hibernated unit */
+        void drop_hibernation();
+
+        /** Replaces the unit by a parse from source with all unsaved files, keeps the unit if there is no index */
+        void reload();
+
+        /** Returns true if an included file changed on disk or in the overlay since hibernation */
+        bool changed_while_hibernated();
+
+        /** Returns the memoized query entry for the token at the given position */
+        query_entry& query_entry_at(uint32_t row, uint32_t col) {
+            wake();
+            sync_queries();
+            return mQueries[token_key(row, col)];
+        }
 
         /** Returns CXCursor at given location */
         CXCursor get_cursor_at(uint64_t row, uint64_t col) {
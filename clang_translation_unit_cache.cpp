@@ -23,16 +23,21 @@
 #include "clang_translation_unit_cache.hpp"
 
 namespace clang {
-    void translation_unit_cache::serialize(const char* path, const char* hash) {
+    void translation_unit_cache::serialize(const char* path) {
         std::string p(path);
 
         std::ofstream output(std::string(p+"db.idx").c_str(), std::ofstream::out);
         output << mContainer.size() << std::endl; // number of .unit files
-        output << hash << std::endl; // sha1 of argument set
 
         uint32_t idx = 0;
         for (auto &unit : mContainer) {
+            std::lock_guard<std::mutex> l(unit.second->mutex());
+            unit.second->wake();
+
             output << unit.first << std::endl;
+            output << unit.second->arguments()->hash() << std::endl; // sha1 of argument set
+
+            scoped_timer t(stat_op::clang_save);
             unsigned error = clang_saveTranslationUnit(unit.second->ptr(), std::string(p+std::to_string(idx++)+".unit").c_str(), 0);
             if (error != 0) {
                 std::cout << "Error: " << error << std::endl;
@@ -42,29 +47,34 @@ namespace clang {
         output.close();
     }
 
-    void translation_unit_cache::unserialize(const char* path, const char* hash, CXIndex idx) {
+    void translation_unit_cache::unserialize(const char* path, CXIndex idx, compilation_database& db, unsaved_overlay* overlay) {
         std::string p(path);
 
         std::ifstream input(std::string(p+"db.idx").c_str(), std::ifstream::in);
-        size_type size;
-        std::string n_hash;
+        size_type size = 0;
 
         input >> size;
-        input >> n_hash;
-
-        if (n_hash.compare(hash) != 0) {
-            input.close();
-            return; // compiler arguments have changed, all tu's are invalid
-        }
+        input.ignore(); // trailing newline
 
         std::string key;
-        for (size_type i = 0; i < size; ++i) {
-            input >> key;
+        std::string hash;
+        for (size_type i = 0; i < size && std::getline(input, key) && std::getline(input, hash); ++i) {
+            argument_set_shared args = db.find(key);
+
+            if (args->hash().compare(hash) != 0)
+                continue; // compiler arguments have changed, tu is invalid
+
+            CXTranslationUnit unit;
+            {
+                scoped_timer t(stat_op::clang_load);
+                unit = clang_createTranslationUnit(idx, std::string(p+std::to_string(i)+".unit").c_str());
+            }
 
-            mContainer[key] = std::make_shared<translation_unit>(clang_createTranslationUnit(idx, std::string(p+std::to_string(i)+".unit").c_str()), key);
+            mContainer[key] = std::make_shared<translation_unit>(unit, key, args, overlay, parse_tier::full, idx);
+            mContainer[key]->loaded();
             mContainer[key]->reparse();
         }
 
         input.close();
     }
-}
\ No newline at end of file
+}
@@ -79,11 +79,11 @@ namespace clang {
             mContainer.clear();
         }
 
-        /** Serializes cache to path with a unique id identifying the changes */
-        void serialize(const char* path, const char* hash);
+        /** Serializes cache to path, each unit is stored with the hash of its arguments */
+        void serialize(const char* path);
 
-        /** Loads cache from path */
-        void unserialize(const char* path, const char* hash, CXIndex idx);
+        /** Loads all units from path whose arguments did not change, units read unsaved files from overlay */
+        void unserialize(const char* path, CXIndex idx, compilation_database& db, unsaved_overlay* overlay = nullptr);
     private:
         container_t mContainer;
     };
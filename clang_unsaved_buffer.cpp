@@ -0,0 +1,74 @@
+/**
+* @file clang_unsaved_buffer.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "clang_unsaved_buffer.hpp"
+
+namespace clang {
+    unsaved_buffer_shared unsaved_buffer::copy(const char* content, uint32_t length) {
+        char* c = new char[length+1];
+        memcpy(c, content, length);
+        c[length] = '\0';
+
+        return adopt(c, length);
+    }
+
+    unsaved_buffer_shared unsaved_buffer::adopt(char* content, uint32_t length) {
+        return std::make_shared<unsaved_buffer>(content, length, [](const char* data, uint32_t) {
+            delete[] data;
+        });
+    }
+
+    unsaved_buffer_shared unsaved_buffer::map(const char* path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size > UINT32_MAX) {
+            close(fd);
+            return nullptr;
+        }
+
+        // mmap refuses zero sized mappings
+        if (st.st_size == 0) {
+            close(fd);
+            return std::make_shared<unsaved_buffer>("", 0, nullptr);
+        }
+
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // the mapping stays valid
+
+        if (data == MAP_FAILED)
+            return nullptr;
+
+        return std::make_shared<unsaved_buffer>(static_cast<const char*>(data), st.st_size, [](const char* data, uint32_t length) {
+            munmap(const_cast<char*>(data), length);
+        });
+    }
+}
@@ -0,0 +1,82 @@
+/**
+* @file clang_unsaved_buffer.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_UNSAVED_BUFFER_HPP_
+#define _RD_CLANG_UNSAVED_BUFFER_HPP_
+
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#include "noncopyable.hpp"
+
+namespace clang {
+    /**
+     * Unsaved file content which is handed to libclang as is.
+     *
+     * The buffer is referenced directly by CXUnsavedFile::Contents, translation units
+     * keep a reference until they are reparsed with different content.
+     */
+    class unsaved_buffer : private noncopyable {
+    public:
+        /// Function invoked once the last reference to the buffer is gone
+        typedef std::function<void(const char*, uint32_t)> release_t;
+
+        /** Wraps memory owned by the caller, release is called on destruction */
+        unsaved_buffer(const char* data, uint32_t length, release_t release)
+            : mData(data), mLength(length), mRelease(std::move(release)) {}
+
+        /** Releases the memory */
+        ~unsaved_buffer() {
+            if (mRelease)
+                mRelease(mData, mLength);
+        }
+
+        /** Returns pointer to the content */
+        const char* data() const {
+            return mData;
+        }
+
+        /** Returns content length in bytes */
+        uint32_t size() const {
+            return mLength;
+        }
+
+        /** Creates a buffer holding a copy of content */
+        static std::shared_ptr<unsaved_buffer> copy(const char* content, uint32_t length);
+
+        /** Takes ownership of content, which must have been allocated with new[] */
+        static std::shared_ptr<unsaved_buffer> adopt(char* content, uint32_t length);
+
+        /** Maps the file at path read-only into memory, returns nullptr on failure */
+        static std::shared_ptr<unsaved_buffer> map(const char* path);
+    private:
+        const char* mData;
+        uint32_t mLength;
+        release_t mRelease;
+    };
+
+    /// Type for a shared unsaved buffer
+    typedef std::shared_ptr<unsaved_buffer> unsaved_buffer_shared;
+}
+
+#endif /* _RD_CLANG_UNSAVED_BUFFER_HPP_ */
@@ -0,0 +1,109 @@
+/**
+* @file clang_unsaved_overlay.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "clang_unsaved_overlay.hpp"
+
+namespace clang {
+    uint64_t unsaved_overlay::set(const std::string& path, unsaved_buffer_shared buffer) {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        entry& e = mEntries[path];
+        e.buffer = std::move(buffer);
+        e.version = ++mVersion;
+
+        mSnapshot = nullptr;
+        return mVersion;
+    }
+
+    uint64_t unsaved_overlay::remove(const std::string& path) {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        auto it = mEntries.find(path);
+        if (it == mEntries.end() || !it->second.buffer)
+            return 0;
+
+        // keep the entry so changed_since reports the removal
+        it->second.buffer = nullptr;
+        it->second.version = ++mVersion;
+
+        mSnapshot = nullptr;
+        return mVersion;
+    }
+
+    void unsaved_overlay::clear() {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        for (auto &e : mEntries) {
+            if (e.second.buffer) {
+                e.second.buffer = nullptr;
+                e.second.version = mVersion+1;
+            }
+        }
+
+        ++mVersion;
+        mSnapshot = nullptr;
+    }
+
+    bool unsaved_overlay::contains(const std::string& path) {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        auto it = mEntries.find(path);
+        return it != mEntries.end() && it->second.buffer;
+    }
+
+    uint64_t unsaved_overlay::version() {
+        std::lock_guard<std::mutex> l(mMutex);
+        return mVersion;
+    }
+
+    unsaved_files_shared unsaved_overlay::snapshot() {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        if (mSnapshot)
+            return mSnapshot;
+
+        // rebuild snapshot lazily, unchanged overlays share the same one
+        auto s = std::make_shared<unsaved_files>();
+        s->version = mVersion;
+        s->entries.reserve(mEntries.size());
+
+        for (auto &e : mEntries) {
+            if (e.second.buffer)
+                s->entries.push_back(std::make_pair(e.first, e.second.buffer));
+        }
+
+        mSnapshot = s;
+        return mSnapshot;
+    }
+
+    std::vector<std::string> unsaved_overlay::changed_since(uint64_t version) {
+        std::lock_guard<std::mutex> l(mMutex);
+        std::vector<std::string> ret;
+
+        for (auto &e : mEntries) {
+            if (e.second.version > version)
+                ret.push_back(e.first);
+        }
+
+        return ret;
+    }
+}
@@ -0,0 +1,93 @@
+/**
+* @file clang_unsaved_overlay.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_UNSAVED_OVERLAY_HPP_
+#define _RD_CLANG_UNSAVED_OVERLAY_HPP_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+#include "noncopyable.hpp"
+#include "clang_unsaved_buffer.hpp"
+
+namespace clang {
+    /** Immutable snapshot of all unsaved files at a given overlay version */
+    struct unsaved_files {
+        /// Overlay version this snapshot was taken at
+        uint64_t version;
+        /// Filename / content pairs
+        std::vector<std::pair<std::string, unsaved_buffer_shared>> entries;
+    };
+
+    /// Type for a shared snapshot
+    typedef std::shared_ptr<const unsaved_files> unsaved_files_shared;
+
+    /**
+     * Tool-wide set of unsaved files, passed to every parse and code completion.
+     *
+     * Each change increments the overlay version, translation units remember the version
+     * they were parsed with so only those including a changed file need to be reparsed.
+     */
+    class unsaved_overlay : private noncopyable {
+    public:
+        /** Constructor */
+        unsaved_overlay() : mVersion(0), mSnapshot(nullptr) {}
+
+        /** Sets unsaved content for path, returns the new version */
+        uint64_t set(const std::string& path, unsaved_buffer_shared buffer);
+
+        /** Removes unsaved content for path, returns the new version or 0 if path had no content */
+        uint64_t remove(const std::string& path);
+
+        /** Removes all unsaved content */
+        void clear();
+
+        /** Returns true if there is unsaved content for path */
+        bool contains(const std::string& path);
+
+        /** Returns the current version */
+        uint64_t version();
+
+        /** Returns a snapshot of all unsaved files */
+        unsaved_files_shared snapshot();
+
+        /** Returns all files which changed after the given version */
+        std::vector<std::string> changed_since(uint64_t version);
+    private:
+        /** Single overlay entry, buffer is null if content has been removed */
+        struct entry {
+            unsaved_buffer_shared buffer;
+            uint64_t version;
+        };
+
+        std::unordered_map<std::string, entry> mEntries;
+        uint64_t mVersion;
+        unsaved_files_shared mSnapshot;
+        std::mutex mMutex;
+    };
+}
+
+#endif /* _RD_CLANG_UNSAVED_OVERLAY_HPP_ */
@@ -0,0 +1,147 @@
+/**
+* @file clang_wire.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "clang_wire.hpp"
+
+namespace clang {
+    void wire_writer::put(const location& value) {
+        put(value.file);
+        put(value.row);
+        put(value.col);
+    }
+
+    void wire_writer::put(const diagnostic& value) {
+        put(value.loc);
+        put(value.severity);
+        put(value.text);
+        put(value.summary);
+    }
+
+    void wire_writer::put(const completion_result& value) {
+        put(static_cast<uint8_t>(value.type));
+        put(value.name);
+        put(value.args);
+        put(value.return_type);
+        put(value.brief);
+        put(static_cast<uint32_t>(value.priority));
+    }
+
+    void wire_writer::put(const token& value) {
+        put(value.offset);
+        put(value.length);
+        put(value.cursor);
+        put(value.kind);
+    }
+
+    void wire_writer::put(const cursor_query& value) {
+        put(value.row);
+        put(value.col);
+        put(value.kinds);
+    }
+
+    void wire_writer::put(const cursor_answer& value) {
+        put(value.type);
+        put(value.declaration);
+        put(value.definition);
+    }
+
+    void wire_writer::put(const cursor_details& value) {
+        put(value.type);
+        put(value.canonical_type);
+        put(value.declaration);
+        put(value.definition);
+        put(value.usr);
+        put(value.kind);
+        put(value.brief);
+        put(value.doc);
+    }
+
+    void wire_writer::put(const ast_element& value) {
+        put(value.name);
+        put(value.type);
+        put(value.typedefType);
+        put(static_cast<uint8_t>(value.cursor));
+        put(value.loc);
+        put(static_cast<uint8_t>(value.access));
+        put(value.doc);
+        put(value.children);
+    }
+
+    bool wire_reader::get(std::string& value) {
+        uint32_t length = 0;
+        if (!get(length) || length > static_cast<size_t>(mEnd - mPos))
+            return fail();
+
+        value.assign(mPos, length);
+        mPos += length;
+        return true;
+    }
+
+    bool wire_reader::get(location& value) {
+        return get(value.file) && get(value.row) && get(value.col);
+    }
+
+    bool wire_reader::get(diagnostic& value) {
+        return get(value.loc) && get(value.severity) && get(value.text) && get(value.summary);
+    }
+
+    bool wire_reader::get(completion_result& value) {
+        uint8_t type = 0;
+        uint32_t priority = 0;
+
+        if (!(get(type) && get(value.name) && get(value.args) && get(value.return_type) && get(value.brief) && get(priority)))
+            return false;
+
+        value.type = static_cast<completion_type>(type);
+        value.priority = priority;
+        return true;
+    }
+
+    bool wire_reader::get(token& value) {
+        return get(value.offset) && get(value.length) && get(value.cursor) && get(value.kind);
+    }
+
+    bool wire_reader::get(cursor_query& value) {
+        return get(value.row) && get(value.col) && get(value.kinds);
+    }
+
+    bool wire_reader::get(cursor_answer& value) {
+        return get(value.type) && get(value.declaration) && get(value.definition);
+    }
+
+    bool wire_reader::get(cursor_details& value) {
+        return get(value.type) && get(value.canonical_type) && get(value.declaration) && get(value.definition)
+            && get(value.usr) && get(value.kind) && get(value.brief) && get(value.doc);
+    }
+
+    bool wire_reader::get(ast_element& value) {
+        uint8_t cursor = 0, access = 0;
+
+        if (!(get(value.name) && get(value.type) && get(value.typedefType) && get(cursor) && get(value.loc)
+            && get(access) && get(value.doc) && get(value.children)))
+            return false;
+
+        value.cursor = static_cast<completion_type>(cursor);
+        value.access = static_cast<ast_access>(access);
+        return true;
+    }
+}
@@ -0,0 +1,154 @@
+/**
+* @file clang_wire.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_WIRE_HPP_
+#define _RD_CLANG_WIRE_HPP_
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+#include "clang_location.hpp"
+#include "clang_diagnostic.hpp"
+#include "clang_completion_result.hpp"
+#include "clang_cursor_query.hpp"
+#include "clang_token.hpp"
+#include "clang_ast.hpp"
+
+namespace clang {
+    /**
+     * Appends values to a binary message
+     *
+     * Integers are written in host byte order, strings and lists are prefixed with their
+     * length. Messages never leave the machine, so there is no need for a portable format.
+     */
+    class wire_writer {
+    public:
+        /** Returns the message */
+        const std::string& buffer() const {
+            return mBuffer;
+        }
+
+        /** Appends an integer */
+        template <typename T>
+        void put_int(T value) {
+            mBuffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        void put(uint8_t value) { put_int(value); }
+        void put(uint16_t value) { put_int(value); }
+        void put(uint32_t value) { put_int(value); }
+        void put(uint64_t value) { put_int(value); }
+
+        /** Appends length prefixed data */
+        void put(const char* data, uint32_t length) {
+            put(length);
+            mBuffer.append(data, length);
+        }
+
+        void put(const std::string& value) { put(value.data(), value.size()); }
+        void put(const location& value);
+        void put(const diagnostic& value);
+        void put(const completion_result& value);
+        void put(const token& value);
+        void put(const cursor_query& value);
+        void put(const cursor_answer& value);
+        void put(const cursor_details& value);
+        void put(const ast_element& value);
+
+        /** Appends a length prefixed list */
+        template <typename T>
+        void put(const std::vector<T>& values) {
+            put(static_cast<uint32_t>(values.size()));
+            for (auto &v : values) {
+                put(v);
+            }
+        }
+    private:
+        std::string mBuffer;
+    };
+
+    /** Reads values written by wire_writer, all reads fail once the message is exhausted */
+    class wire_reader {
+    public:
+        /** Reads from buffer, which needs to outlive the reader */
+        wire_reader(const std::string& buffer) : mPos(buffer.data()), mEnd(buffer.data()+buffer.size()) {}
+
+        /** Returns false if a read went past the end of the message */
+        bool ok() const {
+            return mPos != nullptr;
+        }
+
+        /** Reads an integer */
+        template <typename T>
+        bool get_int(T& value) {
+            if (!mPos || static_cast<size_t>(mEnd - mPos) < sizeof(T))
+                return fail();
+
+            memcpy(&value, mPos, sizeof(T));
+            mPos += sizeof(T);
+            return true;
+        }
+
+        bool get(uint8_t& value) { return get_int(value); }
+        bool get(uint16_t& value) { return get_int(value); }
+        bool get(uint32_t& value) { return get_int(value); }
+        bool get(uint64_t& value) { return get_int(value); }
+        bool get(std::string& value);
+        bool get(location& value);
+        bool get(diagnostic& value);
+        bool get(completion_result& value);
+        bool get(token& value);
+        bool get(cursor_query& value);
+        bool get(cursor_answer& value);
+        bool get(cursor_details& value);
+        bool get(ast_element& value);
+
+        /** Reads a list written by wire_writer::put */
+        template <typename T>
+        bool get(std::vector<T>& values) {
+            uint32_t size = 0;
+            if (!get(size) || size > static_cast<size_t>(mEnd - mPos))
+                return fail(); // every element takes at least one byte
+
+            values.resize(size);
+            for (auto &v : values) {
+                if (!get(v))
+                    return false;
+            }
+
+            return true;
+        }
+    private:
+        const char* mPos;
+        const char* mEnd;
+
+        /** Marks the message as broken */
+        bool fail() {
+            mPos = nullptr;
+            return false;
+        }
+    };
+}
+
+#endif /* _RD_CLANG_WIRE_HPP_ */
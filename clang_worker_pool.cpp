@@ -0,0 +1,805 @@
+/**
+* @file clang_worker_pool.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+
+#include <climits>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "clang_worker_pool.hpp"
+
+namespace clang {
+    namespace {
+        /** Returns a request for op */
+        wire_writer request(worker_op op) {
+            wire_writer ret;
+            ret.put(static_cast<uint8_t>(op));
+            return ret;
+        }
+    }
+
+    bool worker_pool::start(uint32_t n) {
+        stop();
+
+        for (uint32_t i = 0; i < n; ++i) {
+            mWorkers.emplace_back(new worker());
+        }
+
+        bool ok = n > 0;
+        for (uint32_t i = 0; i < n && ok; ++i) {
+            std::lock_guard<std::mutex> l(mWorkers[i]->mutex);
+
+            // an executable which could not be started only shows up as a closed socket
+            std::string failed, response;
+            ok = spawn(i) && restore(i, failed) && send(mWorkers[i]->fd, request(worker_op::index_status).buffer())
+                && receive(mWorkers[i]->fd, response);
+        }
+
+        if (!ok) {
+            stop();
+            return false;
+        }
+
+        mActive = true;
+        return true;
+    }
+
+    void worker_pool::stop() {
+        mActive = false;
+
+        for (auto &w : mWorkers) {
+            std::lock_guard<std::mutex> l(w->mutex);
+
+            // closing the socket makes the worker exit on its own
+            if (w->fd >= 0)
+                close(w->fd);
+
+            if (w->pid > 0)
+                waitpid(w->pid, nullptr, 0);
+        }
+
+        std::lock_guard<std::mutex> l(mMutex);
+        mWorkers.clear();
+        mOwners.clear();
+        mUnsaved.clear();
+    }
+
+    bool worker_pool::send(int fd, const std::string& message) {
+        uint32_t length = message.size();
+        std::string frame(reinterpret_cast<const char*>(&length), sizeof(length));
+        frame.append(message);
+
+        for (size_t sent = 0; sent < frame.size();) {
+            // MSG_NOSIGNAL, a dead peer must not kill us with SIGPIPE
+            ssize_t n = ::send(fd, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+
+            sent += n;
+        }
+
+        return true;
+    }
+
+    bool worker_pool::receive(int fd, std::string& message) {
+        auto read_all = [fd](char* data, size_t size) {
+            for (size_t got = 0; got < size;) {
+                ssize_t n = ::recv(fd, data + got, size - got, 0);
+                if (n <= 0)
+                    return false;
+
+                got += n;
+            }
+
+            return true;
+        };
+
+        // the length comes from the peer, daemon clients included, don't allocate whatever it claims
+        uint32_t length = 0;
+        if (!read_all(reinterpret_cast<char*>(&length), sizeof(length)) || length > max_message)
+            return false;
+
+        message.resize(length);
+        return length == 0 || read_all(&message[0], length);
+    }
+
+    std::string worker_pool::default_executable() {
+        const char* env = getenv("CLANG_TOOL_WORKER");
+        if (env && *env)
+            return env;
+
+        char self[PATH_MAX];
+        ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+        if (n > 0) {
+            std::string path(self, n);
+            path = path.substr(0, path.find_last_of('/')+1) + "clang_tool_worker";
+
+            struct stat st;
+            if (stat(path.c_str(), &st) == 0)
+                return path;
+        }
+
+        return "clang_tool_worker";
+    }
+
+    uint64_t worker_pool::resident_size() {
+        std::ifstream statm("/proc/self/statm");
+        uint64_t size = 0, resident = 0;
+
+        statm >> size >> resident;
+        return resident * sysconf(_SC_PAGESIZE);
+    }
+
+    void worker_pool::arguments_set(const std::vector<std::string>& args) {
+        wire_writer r = request(worker_op::arguments_set);
+        r.put(args);
+
+        remember("default", r);
+        if (active())
+            broadcast([&](uint32_t){ return r; });
+    }
+
+    void worker_pool::arguments_set(const std::string& path, const std::vector<std::string>& args) {
+        wire_writer r = request(worker_op::arguments_set_file);
+        r.put(path);
+        r.put(args);
+
+        remember("file:"+path, r);
+        if (active())
+            broadcast([&](uint32_t){ return r; });
+    }
+
+    int32_t worker_pool::arguments_load(const std::string& directory) {
+        wire_writer r = request(worker_op::arguments_load);
+        r.put(directory);
+
+        remember("load:"+directory, r);
+        if (!active())
+            return 0;
+
+        auto responses = broadcast([&](uint32_t){ return r; });
+
+        uint32_t ret = 0;
+        wire_reader(responses[0]).get(ret);
+        return static_cast<int32_t>(ret);
+    }
+
+    void worker_pool::index_touch(const std::string& path) {
+        bool unsaved;
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            unsaved = mUnsaved.erase(path) != 0;
+        }
+
+        wire_writer r = request(worker_op::index_touch);
+        r.put(path);
+
+        std::string response;
+        call(path, r, response, true);
+
+        // the owner dropped the content already, everybody else still has it
+        if (unsaved) {
+            wire_writer remove = request(worker_op::overlay_remove);
+            remove.put(path);
+            broadcast([&](uint32_t){ return remove; });
+        }
+    }
+
+    void worker_pool::index_touch_unsaved(const std::string& path, const unsaved_buffer_shared& buffer) {
+        int64_t owner = -1;
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            mUnsaved[path] = buffer;
+
+            auto it = mOwners.find(path);
+            if (it != mOwners.end())
+                owner = it->second.worker;
+        }
+
+        // headers may be included by units of any worker
+        broadcast([&](uint32_t w) {
+            wire_writer r = request(w == owner ? worker_op::index_touch_unsaved : worker_op::overlay_set);
+            r.put(path);
+            r.put(buffer->data(), buffer->size());
+            return r;
+        });
+    }
+
+    void worker_pool::index_add(const std::string& path) {
+        wire_writer r = request(worker_op::index_add);
+        r.put(path);
+
+        std::string response;
+        call(path, r, response, true, true);
+    }
+
+    void worker_pool::index_discard_unsaved(const std::string& path) {
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            if (mUnsaved.erase(path) == 0)
+                return;
+        }
+
+        wire_writer r = request(worker_op::overlay_remove);
+        r.put(path);
+        broadcast([&](uint32_t){ return r; });
+    }
+
+    void worker_pool::index_remove(const std::string& path) {
+        wire_writer r = request(worker_op::index_remove);
+        r.put(path);
+
+        std::string response;
+        call(path, r, response);
+
+        std::lock_guard<std::mutex> l(mMutex);
+        mOwners.erase(path);
+    }
+
+    void worker_pool::index_clear() {
+        broadcast([](uint32_t){ return request(worker_op::index_clear); });
+
+        std::lock_guard<std::mutex> l(mMutex);
+        mOwners.clear();
+        mUnsaved.clear();
+    }
+
+    void worker_pool::index_hibernate(uint64_t idle) {
+        wire_writer r = request(worker_op::index_hibernate);
+        r.put(idle);
+
+        broadcast([&](uint32_t){ return r; });
+    }
+
+    ressource_map worker_pool::index_status() {
+        ressource_map ret;
+
+        for (auto &response : broadcast([](uint32_t){ return request(worker_op::index_status); })) {
+            wire_reader r(response);
+            uint32_t n = 0;
+            r.get(n);
+
+            for (uint32_t i = 0; i < n && r.ok(); ++i) {
+                std::string path;
+                ressource_usage usage;
+
+                if (r.get(path) && r.get(usage))
+                    ret[path] = std::move(usage);
+            }
+        }
+
+        return ret;
+    }
+
+    ast_element worker_pool::tu_ast(const std::string& path) {
+        wire_writer r = request(worker_op::tu_ast);
+        r.put(path);
+
+        return query(path, r, ast_element());
+    }
+
+    std::vector<token> worker_pool::tu_tokens(const std::string& path, uint32_t first, uint32_t last) {
+        wire_writer r = request(worker_op::tu_tokens);
+        r.put(path);
+        r.put(first);
+        r.put(last);
+
+        return query(path, r, std::vector<token>());
+    }
+
+    std::vector<diagnostic> worker_pool::tu_diagnose(const std::string& path) {
+        wire_writer r = request(worker_op::tu_diagnose);
+        r.put(path);
+
+        auto ret = query(path, r, std::vector<diagnostic>());
+        promoted(path);
+        return ret;
+    }
+
+    std::vector<diagnostic_map> worker_pool::workspace_diagnose() {
+        std::vector<diagnostic_map> ret;
+
+        for (auto &response : broadcast([](uint32_t){ return request(worker_op::workspace_diagnose); })) {
+            wire_reader r(response);
+            uint32_t n = 0;
+            r.get(n);
+
+            diagnostic_map map;
+            for (uint32_t i = 0; i < n && r.ok(); ++i) {
+                std::string file;
+                std::vector<diagnostic> diagnostics;
+
+                if (r.get(file) && r.get(diagnostics))
+                    map[file] = std::move(diagnostics);
+            }
+
+            ret.push_back(std::move(map));
+        }
+
+        return ret;
+    }
+
+    completion_list worker_pool::cursor_complete(const std::string& path, uint32_t row, uint32_t col) {
+        wire_writer r = request(worker_op::cursor_complete);
+        r.put(path);
+        r.put(row);
+        r.put(col);
+
+        auto ret = query(path, r, completion_list());
+        promoted(path);
+        return ret;
+    }
+
+    std::string worker_pool::cursor_type(const std::string& path, uint32_t row, uint32_t col) {
+        wire_writer r = request(worker_op::cursor_type);
+        r.put(path);
+        r.put(row);
+        r.put(col);
+
+        return query(path, r, std::string());
+    }
+
+    location worker_pool::cursor_declaration(const std::string& path, uint32_t row, uint32_t col) {
+        wire_writer r = request(worker_op::cursor_declaration);
+        r.put(path);
+        r.put(row);
+        r.put(col);
+
+        return query(path, r, location{"", 0, 0});
+    }
+
+    location worker_pool::cursor_definition(const std::string& path, uint32_t row, uint32_t col) {
+        wire_writer r = request(worker_op::cursor_definition);
+        r.put(path);
+        r.put(row);
+        r.put(col);
+
+        return query(path, r, location{"", 0, 0});
+    }
+
+    cursor_details worker_pool::cursor_info(const std::string& path, uint32_t row, uint32_t col) {
+        wire_writer r = request(worker_op::cursor_info);
+        r.put(path);
+        r.put(row);
+        r.put(col);
+
+        return query(path, r, cursor_details{"", "", {"", 0, 0}, {"", 0, 0}, "", "", "", ""});
+    }
+
+    std::vector<cursor_answer> worker_pool::cursor_batch(const std::string& path, const std::vector<cursor_query>& queries) {
+        wire_writer r = request(worker_op::cursor_batch);
+        r.put(path);
+        r.put(queries);
+
+        auto ret = query(path, r, std::vector<cursor_answer>());
+        if (ret.size() != queries.size())
+            ret.assign(queries.size(), cursor_answer{"", {"", 0, 0}, {"", 0, 0}});
+
+        return ret;
+    }
+
+    void worker_pool::rebalance() {
+        if (!active())
+            return;
+
+        // memory of each unit, as reported by the worker owning it
+        std::unordered_map<std::string, uint64_t> sizes;
+        for (auto &unit : index_status()) {
+            if (!unit.second.empty())
+                sizes[unit.first] = unit.second[CXTUResourceUsage_Combined];
+        }
+
+        std::vector<uint64_t> totals(mWorkers.size(), 0);
+        std::vector<std::vector<std::pair<std::string, uint64_t>>> units(mWorkers.size());
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+
+            for (auto &o : mOwners) {
+                uint64_t size = sizes[o.first];
+                totals[o.second.worker] += size;
+                units[o.second.worker].push_back(std::make_pair(o.first, size));
+            }
+        }
+
+        for (size_t moves = 0; moves < sizes.size(); ++moves) {
+            uint32_t hi = std::max_element(totals.begin(), totals.end()) - totals.begin();
+            // units only move to live workers, dead ones have none left
+            uint32_t lo = totals.size();
+            for (uint32_t i = 0; i < totals.size(); ++i) {
+                if (!mWorkers[i]->dead && (lo == totals.size() || totals[i] < totals[lo]))
+                    lo = i;
+            }
+
+            if (lo == totals.size() || hi == lo || totals[hi] * 2 < totals[lo] * 3)
+                return;
+
+            // the unit closest to half the difference evens out both workers best
+            uint64_t diff = totals[hi] - totals[lo];
+            auto best = units[hi].end();
+
+            for (auto it = units[hi].begin(); it != units[hi].end(); ++it) {
+                if (it->second == 0 || it->second >= diff)
+                    continue;
+
+                if (best == units[hi].end() || (std::max(it->second, diff/2) - std::min(it->second, diff/2))
+                    < (std::max(best->second, diff/2) - std::min(best->second, diff/2)))
+                    best = it;
+            }
+
+            if (best == units[hi].end())
+                return;
+
+            move(best->first, hi, lo);
+
+            totals[hi] -= best->second;
+            totals[lo] += best->second;
+            units[lo].push_back(*best);
+            units[hi].erase(best);
+        }
+    }
+
+    bool worker_pool::spawn(uint32_t w) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+            return false;
+
+        // everything the child needs is prepared up front, it must not allocate after fork
+        std::string fd = std::to_string(worker_fd);
+        const char* argv[] = {mExecutable.c_str(), fd.c_str(), nullptr};
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+
+        if (pid == 0) {
+            // other threads may hold any lock, only async-signal-safe calls until exec
+            if (fds[1] == worker_fd)
+                fcntl(worker_fd, F_SETFD, 0);
+            else
+                dup2(fds[1], worker_fd);
+
+            // all other sockets are close-on-exec, other workers still see their parent go away
+            execvp(argv[0], const_cast<char* const*>(argv));
+            _exit(127);
+        }
+
+        close(fds[1]);
+
+        worker& wk = *mWorkers[w];
+        wk.pid = pid;
+        wk.fd = fds[0];
+
+        std::lock_guard<std::mutex> l(mMutex);
+        wk.rss = 0;
+        return true;
+    }
+
+    void worker_pool::terminate(uint32_t w) {
+        worker& wk = *mWorkers[w];
+
+        if (wk.fd >= 0)
+            close(wk.fd);
+
+        if (wk.pid > 0) {
+            kill(wk.pid, SIGKILL);
+            waitpid(wk.pid, nullptr, 0);
+        }
+
+        wk.fd = -1;
+        wk.pid = -1;
+    }
+
+    void worker_pool::restart(uint32_t w, const std::string& path) {
+        worker& wk = *mWorkers[w];
+        std::string failed = path;
+        bool restored = false;
+
+        while (!wk.dead) {
+            terminate(w);
+
+            // whatever we crashed on would most likely crash the new worker as well
+            {
+                std::lock_guard<std::mutex> l(mMutex);
+
+                auto it = mOwners.find(failed);
+                if (it != mOwners.end() && it->second.worker == w)
+                    mOwners.erase(it);
+
+                if (restored)
+                    mUnsaved.erase(failed);
+            }
+
+            failed.clear();
+            if (spawn(w) && restore(w, failed)) {
+                wk.failures = 0;
+                return;
+            }
+
+            restored = true;
+
+            // a worker which can't be executed or keeps crashing on its arguments is given up
+            if (++wk.failures >= max_restarts) {
+                terminate(w);
+                wk.dead = true;
+
+                std::lock_guard<std::mutex> l(mMutex);
+                for (auto it = mOwners.begin(); it != mOwners.end();) {
+                    if (it->second.worker == w)
+                        it = mOwners.erase(it);
+                    else
+                        ++it;
+                }
+            }
+        }
+    }
+
+    bool worker_pool::restore(uint32_t w, std::string& failed) {
+        std::vector<std::string> arguments;
+        std::vector<std::pair<std::string, unsaved_buffer_shared>> unsaved;
+        std::vector<std::pair<std::string, bool>> units;
+
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+
+            for (auto &a : mArguments) {
+                arguments.push_back(a.second);
+            }
+
+            unsaved.assign(mUnsaved.begin(), mUnsaved.end());
+
+            for (auto &o : mOwners) {
+                if (o.second.worker == w)
+                    units.push_back(std::make_pair(o.first, o.second.light));
+            }
+        }
+
+        int fd = mWorkers[w]->fd;
+        std::string response;
+
+        for (auto &a : arguments) {
+            if (!send(fd, a) || !receive(fd, response))
+                return false;
+        }
+
+        for (auto &u : unsaved) {
+            wire_writer r = request(worker_op::overlay_set);
+            r.put(u.first);
+            r.put(u.second->data(), u.second->size());
+
+            failed = u.first;
+            if (!send(fd, r.buffer()) || !receive(fd, response))
+                return false;
+        }
+
+        // overlay_set does not create units, touch them first and add unsaved content again
+        for (auto &u : units) {
+            wire_writer r = request(u.second ? worker_op::index_add : worker_op::index_touch);
+            r.put(u.first);
+
+            failed = u.first;
+            if (!send(fd, r.buffer()) || !receive(fd, response))
+                return false;
+
+            auto content = std::find_if(unsaved.begin(), unsaved.end(), [&](const std::pair<std::string, unsaved_buffer_shared>& e) {
+                return e.first == u.first;
+            });
+
+            if (content == unsaved.end())
+                continue;
+
+            wire_writer t = request(worker_op::index_touch_unsaved);
+            t.put(u.first);
+            t.put(content->second->data(), content->second->size());
+
+            if (!send(fd, t.buffer()) || !receive(fd, response))
+                return false;
+        }
+
+        failed.clear();
+        return true;
+    }
+
+    bool worker_pool::exchange(uint32_t w, const std::string& path, const std::string& request, std::string& response) {
+        worker& wk = *mWorkers[w];
+
+        if (wk.fd < 0 || !send(wk.fd, request) || !receive(wk.fd, response) || response.size() < sizeof(uint64_t)) {
+            restart(w, path);
+            response.clear();
+            return false;
+        }
+
+        // every response ends with the rss of the worker, 0 if it has not been measured
+        uint64_t rss;
+        memcpy(&rss, response.data() + response.size() - sizeof(rss), sizeof(rss));
+        response.resize(response.size() - sizeof(rss));
+
+        if (rss) {
+            std::lock_guard<std::mutex> l(mMutex);
+            wk.rss = rss;
+        }
+
+        return true;
+    }
+
+    bool worker_pool::call(const std::string& path, const wire_writer& request, std::string& response, bool assign, bool light) {
+        uint32_t w;
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+
+            auto it = mOwners.find(path);
+            if (it != mOwners.end()) {
+                w = it->second.worker;
+            } else {
+                if (!assign || mWorkers.empty())
+                    return false;
+
+                // new units go to the live worker using the least memory
+                w = mWorkers.size();
+                for (uint32_t i = 0; i < mWorkers.size(); ++i) {
+                    if (!mWorkers[i]->dead && (w == mWorkers.size() || mWorkers[i]->rss < mWorkers[w]->rss))
+                        w = i;
+                }
+
+                if (w == mWorkers.size())
+                    return false;
+
+                mOwners[path] = owner{w, light};
+            }
+        }
+
+        std::lock_guard<std::mutex> l(mWorkers[w]->mutex);
+        return exchange(w, path, request.buffer(), response);
+    }
+
+    std::vector<std::string> worker_pool::broadcast(const std::function<wire_writer(uint32_t w)>& make) {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (auto &w : mWorkers) {
+            locks.emplace_back(w->mutex);
+        }
+
+        // send everything first so all workers run in parallel
+        std::vector<std::string> requests;
+        std::vector<std::string> responses(mWorkers.size());
+        std::vector<bool> sent(mWorkers.size());
+
+        for (uint32_t w = 0; w < mWorkers.size(); ++w) {
+            requests.push_back(make(w).buffer());
+            sent[w] = mWorkers[w]->fd >= 0 && send(mWorkers[w]->fd, requests[w]);
+        }
+
+        for (uint32_t w = 0; w < mWorkers.size(); ++w) {
+            if (sent[w] && receive(mWorkers[w]->fd, responses[w]) && responses[w].size() >= sizeof(uint64_t)) {
+                responses[w].resize(responses[w].size() - sizeof(uint64_t));
+                continue;
+            }
+
+            restart(w, "");
+            responses[w].clear();
+        }
+
+        return responses;
+    }
+
+    void worker_pool::remember(const std::string& key, const wire_writer& request) {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        auto it = std::find_if(mArguments.begin(), mArguments.end(), [&](const std::pair<std::string, std::string>& a) {
+            return a.first == key;
+        });
+
+        // later requests may override earlier ones, keep them in order
+        if (it != mArguments.end())
+            mArguments.erase(it);
+
+        mArguments.push_back(std::make_pair(key, request.buffer()));
+    }
+
+    template <typename T>
+    T worker_pool::query(const std::string& path, const wire_writer& request, T def) {
+        std::string response;
+        if (!call(path, request, response))
+            return def;
+
+        T ret;
+        wire_reader r(response);
+
+        if (!r.get(ret))
+            return def;
+
+        return ret;
+    }
+
+    void worker_pool::promoted(const std::string& path) {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        auto it = mOwners.find(path);
+        if (it != mOwners.end())
+            it->second.light = false;
+    }
+
+    void worker_pool::move(const std::string& path, uint32_t from, uint32_t to) {
+        bool light = false;
+        unsaved_buffer_shared unsaved;
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+
+            auto it = mOwners.find(path);
+            if (it == mOwners.end() || it->second.worker != from)
+                return;
+
+            light = it->second.light;
+
+            auto content = mUnsaved.find(path);
+            if (content != mUnsaved.end())
+                unsaved = content->second;
+        }
+
+        std::string response;
+        {
+            std::lock_guard<std::mutex> l(mWorkers[to]->mutex);
+
+            // parse on the new worker first, queries keep going to the old one meanwhile
+            wire_writer r = request(light ? worker_op::index_add : worker_op::index_touch);
+            r.put(path);
+
+            if (!exchange(to, path, r.buffer(), response))
+                return;
+
+            if (unsaved) {
+                wire_writer t = request(worker_op::index_touch_unsaved);
+                t.put(path);
+                t.put(unsaved->data(), unsaved->size());
+
+                if (!exchange(to, path, t.buffer(), response))
+                    return;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+
+            auto it = mOwners.find(path);
+            if (it == mOwners.end() || it->second.worker != from)
+                return;
+
+            it->second.worker = to;
+        }
+
+        wire_writer r = request(worker_op::index_remove);
+        r.put(path);
+
+        std::lock_guard<std::mutex> l(mWorkers[from]->mutex);
+        exchange(from, path, r.buffer(), response);
+    }
+}
@@ -0,0 +1,243 @@
+/**
+* @file clang_worker_pool.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_CLANG_WORKER_POOL_HPP_
+#define _RD_CLANG_WORKER_POOL_HPP_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+#include <sys/types.h>
+
+#include "noncopyable.hpp"
+#include "clang_wire.hpp"
+#include "clang_unsaved_buffer.hpp"
+#include "clang_translation_unit.hpp"
+#include "clang_ressource_usage.hpp"
+
+namespace clang {
+    /** Requests understood by worker processes */
+    enum class worker_op : uint8_t {
+        arguments_set = 0,
+        arguments_set_file,
+        arguments_load,
+        index_touch,
+        index_touch_unsaved,
+        index_add,
+        index_remove,
+        index_clear,
+        index_status,
+        index_hibernate,
+        overlay_set,
+        overlay_remove,
+        tu_ast,
+        tu_tokens,
+        tu_diagnose,
+        workspace_diagnose,
+        cursor_complete,
+        cursor_type,
+        cursor_declaration,
+        cursor_definition,
+        cursor_info,
+        cursor_batch
+    };
+
+    /**
+     * Shards translation units across worker processes
+     *
+     * Each worker is a clang_tool_worker process running its own tool, connected through a
+     * Unix domain socket passed as file descriptor 3. Workers are started with fork and exec
+     * so they do not inherit locks held by other threads of the client. Messages are framed
+     * by a 32 bit length and encoded with wire_writer. Every unit belongs to a single worker,
+     * new units go to the worker using the least memory. Unsaved content and arguments are
+     * sent to all workers since any unit may include the file.
+     *
+     * A worker which dies is restarted, gets all arguments and unsaved content again and
+     * reparses its units, except the one whose request it crashed on. That request returns
+     * an empty result. Unsaved content or units crashing the restarted worker are dropped as
+     * well. After max_restarts failed restarts in a row the worker is given up, its units
+     * go to the remaining workers when they are touched again.
+     */
+    class worker_pool : private noncopyable {
+    public:
+        /// File descriptor of the socket in the worker process
+        static const int worker_fd = 3;
+
+        /// Number of failed restarts in a row after which a worker is given up
+        static const uint32_t max_restarts = 3;
+
+        /// Largest message receive accepts, longer frames are treated as a broken connection
+        static const uint32_t max_message = 256 << 20;
+
+        /** Constructor, executable is the worker binary, looked up in PATH if it contains no slash */
+        worker_pool(std::string executable) : mExecutable(std::move(executable)), mActive(false) {}
+
+        /** Stops all workers */
+        ~worker_pool() {
+            stop();
+        }
+
+        /** Starts n workers, returns false if not all of them could be started */
+        bool start(uint32_t n);
+
+        /** Stops all workers, their units are gone */
+        void stop();
+
+        /** Returns true if requests are handled by workers */
+        bool active() const {
+            return mActive.load();
+        }
+
+        /** Sends a length prefixed message, returns false if the socket is broken */
+        static bool send(int fd, const std::string& message);
+
+        /** Receives a message sent with send, returns false if the socket is broken, closed or the message too long */
+        static bool receive(int fd, std::string& message);
+
+        /**
+         * Returns the worker binary to use by default
+         *
+         * That is $CLANG_TOOL_WORKER if set, otherwise clang_tool_worker next to the running
+         * executable if it exists there, otherwise clang_tool_worker from PATH.
+         */
+        static std::string default_executable();
+
+        /** Returns resident set size of the calling process in bytes */
+        static uint64_t resident_size();
+
+        /** Sets default arguments, kept for workers started later */
+        void arguments_set(const std::vector<std::string>& args);
+
+        /** Sets arguments for path, kept for workers started later */
+        void arguments_set(const std::string& path, const std::vector<std::string>& args);
+
+        /** Loads a compilation database in all workers, returns the result of the first one */
+        int32_t arguments_load(const std::string& directory);
+
+        void index_touch(const std::string& path);
+        void index_touch_unsaved(const std::string& path, const unsaved_buffer_shared& buffer);
+        void index_add(const std::string& path);
+        void index_discard_unsaved(const std::string& path);
+        void index_remove(const std::string& path);
+        void index_clear();
+        void index_hibernate(uint64_t idle);
+
+        /** Returns resource usage of all units of all workers */
+        ressource_map index_status();
+
+        ast_element tu_ast(const std::string& path);
+        std::vector<token> tu_tokens(const std::string& path, uint32_t first, uint32_t last);
+        std::vector<diagnostic> tu_diagnose(const std::string& path);
+
+        /** Returns the workspace diagnostics of each worker, collected in parallel */
+        std::vector<diagnostic_map> workspace_diagnose();
+
+        completion_list cursor_complete(const std::string& path, uint32_t row, uint32_t col);
+        std::string cursor_type(const std::string& path, uint32_t row, uint32_t col);
+        location cursor_declaration(const std::string& path, uint32_t row, uint32_t col);
+        location cursor_definition(const std::string& path, uint32_t row, uint32_t col);
+        cursor_details cursor_info(const std::string& path, uint32_t row, uint32_t col);
+        std::vector<cursor_answer> cursor_batch(const std::string& path, const std::vector<cursor_query>& queries);
+
+        /**
+         * Moves units from the worker using the most memory to the one using the least
+         *
+         * Stops once the heaviest worker uses less than 1.5 times the memory of the lightest
+         * one, or moving another unit would not reduce the difference.
+         */
+        void rebalance();
+    private:
+        /** A single worker process */
+        struct worker {
+            worker() : pid(-1), fd(-1), rss(0), failures(0), dead(false) {}
+
+            pid_t pid;
+            int fd;
+            uint64_t rss;
+            uint32_t failures;
+            std::atomic<bool> dead;
+            std::mutex mutex;
+        };
+
+        /** Unit owned by a worker */
+        struct owner {
+            uint32_t worker;
+            bool light;
+        };
+
+        std::string mExecutable;
+        std::atomic<bool> mActive;
+        std::vector<std::unique_ptr<worker>> mWorkers;
+        std::unordered_map<std::string, owner> mOwners;
+        std::unordered_map<std::string, unsaved_buffer_shared> mUnsaved;
+        std::vector<std::pair<std::string, std::string>> mArguments;
+        std::mutex mMutex;
+
+        /*
+         * Locking: mMutex guards owners, unsaved content, arguments and the rss of all workers.
+         * A worker's mutex is held for a whole request, mMutex may be acquired while holding
+         * it, never the other way around. Worker mutexes are acquired in index order.
+         */
+
+        /** Starts process of worker w, requires its mutex */
+        bool spawn(uint32_t w);
+
+        /** Kills the process of worker w, requires its mutex */
+        void terminate(uint32_t w);
+
+        /** Kills worker w and starts it again, requires its mutex, path is not reparsed */
+        void restart(uint32_t w, const std::string& path);
+
+        /** Sends all arguments, unsaved content and units to a fresh worker, returns the path it crashed on */
+        bool restore(uint32_t w, std::string& failed);
+
+        /** Sends request to worker w, restarts it if it died, requires its mutex */
+        bool exchange(uint32_t w, const std::string& path, const std::string& request, std::string& response);
+
+        /** Sends request to the owner of path, assigns one if assign is set, returns false if there is none */
+        bool call(const std::string& path, const wire_writer& request, std::string& response, bool assign = false, bool light = false);
+
+        /** Sends request, or the one built by make for each worker, to all workers in parallel */
+        std::vector<std::string> broadcast(const std::function<wire_writer(uint32_t w)>& make);
+
+        /** Remembers an argument request so it can be sent to restarted workers */
+        void remember(const std::string& key, const wire_writer& request);
+
+        /** Sends a query to the owner of path and decodes the answer, returns def on failure */
+        template <typename T>
+        T query(const std::string& path, const wire_writer& request, T def);
+
+        /** Marks path as parsed with the full tier after a request which promotes light units */
+        void promoted(const std::string& path);
+
+        /** Moves path from worker from to worker to */
+        void move(const std::string& path, uint32_t from, uint32_t to);
+    };
+}
+
+#endif /* _RD_CLANG_WORKER_POOL_HPP_ */
@@ -0,0 +1,762 @@
+/**
+* @file daemon/daemon.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <unordered_map>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "noncopyable.hpp"
+#include "clang_tool.hpp"
+#include "clang_job_queue.hpp"
+#include "clang_worker_pool.hpp"
+#include "rpc.hpp"
+
+namespace {
+    using clang::rpc_op;
+    using clang::rpc_status;
+    using clang::wire_reader;
+    using clang::wire_writer;
+    using clang::worker_pool;
+    using clang::job_queue;
+
+    struct project;
+
+    /**
+     * Lock held shared by requests and exclusively by those replacing the state of a tool
+     *
+     * Waiting exclusive owners block new shared ones, so a steady stream of queries can't
+     * starve them.
+     */
+    class shared_mutex : private clang::noncopyable {
+    public:
+        /** Constructor */
+        shared_mutex() : mShared(0), mExclusive(false), mWaiting(0) {}
+
+        /** Acquires the lock exclusively */
+        void lock() {
+            std::unique_lock<std::mutex> l(mMutex);
+            ++mWaiting;
+            mCond.wait(l, [this]{ return !mExclusive && mShared == 0; });
+            --mWaiting;
+            mExclusive = true;
+        }
+
+        /** Releases exclusive ownership */
+        void unlock() {
+            std::lock_guard<std::mutex> l(mMutex);
+            mExclusive = false;
+            mCond.notify_all();
+        }
+
+        /** Acquires the lock shared */
+        void lock_shared() {
+            std::unique_lock<std::mutex> l(mMutex);
+            mCond.wait(l, [this]{ return !mExclusive && mWaiting == 0; });
+            ++mShared;
+        }
+
+        /** Releases shared ownership */
+        void unlock_shared() {
+            std::lock_guard<std::mutex> l(mMutex);
+            if (--mShared == 0)
+                mCond.notify_all();
+        }
+    private:
+        uint32_t mShared;
+        bool mExclusive;
+        uint32_t mWaiting;
+        std::mutex mMutex;
+        std::condition_variable mCond;
+    };
+
+    /** Holds a shared_mutex for the current scope, shared unless exclusive is set */
+    class project_lock : private clang::noncopyable {
+    public:
+        /** Acquires m */
+        project_lock(shared_mutex& m, bool exclusive) : mMutex(m), mExclusive(exclusive) {
+            if (mExclusive)
+                mMutex.lock();
+            else
+                mMutex.lock_shared();
+        }
+
+        /** Releases m */
+        ~project_lock() {
+            if (mExclusive)
+                mMutex.unlock();
+            else
+                mMutex.unlock_shared();
+        }
+    private:
+        shared_mutex& mMutex;
+        bool mExclusive;
+    };
+
+    /** A client connection, requests are read by its own thread */
+    struct connection : private clang::noncopyable {
+        connection(int f) : fd(f), proj(nullptr), running(0) {}
+
+        ~connection() {
+            close(fd);
+        }
+
+        /** Sends a response, returns false if the client is gone */
+        bool respond(uint64_t id, rpc_status status, const wire_writer& payload) {
+            wire_writer header;
+            header.put(id);
+            header.put(static_cast<uint8_t>(status));
+
+            std::lock_guard<std::mutex> l(write);
+            return worker_pool::send(fd, header.buffer()+payload.buffer());
+        }
+
+        /** Waits until no concurrent request of this connection is running */
+        void wait_idle() {
+            std::unique_lock<std::mutex> l(mutex);
+            idle.wait(l, [this]{ return running == 0; });
+        }
+
+        int fd;
+        /// Project of this connection, only changed by ordered requests
+        project* proj;
+        /// Serializes responses
+        std::mutex write;
+        /// Guards running
+        std::mutex mutex;
+        std::condition_variable idle;
+        uint32_t running;
+    };
+
+    /** One tool per project root, shared by all connections which opened it */
+    struct project : private clang::noncopyable {
+        project(std::string r) : root(std::move(r)), entries(0) {}
+
+        std::string root;
+        clang::tool tool;
+        /// Result of loading the compilation database in root
+        int32_t entries;
+        /// Held shared by requests on tool, exclusively by those replacing its units or workers
+        shared_mutex state;
+        /// Serializes subscribing and unsubscribing the tool
+        std::mutex subscription;
+        /// Guards snapshot and subscribers
+        std::mutex mutex;
+        /// Diagnostics published so far, by unit and diagnostic key
+        std::unordered_map<std::string, std::unordered_map<std::string, clang::diagnostic>> snapshot;
+        std::vector<connection*> subscribers;
+    };
+
+    /**
+     * Serves all projects on a Unix domain socket
+     *
+     * Each connection has a reader thread, requests which do not change state are handed
+     * to a shared job queue so a connection can have many of them in flight. Their
+     * responses are sent as soon as they are done, clients match them by id.
+     */
+    class server : private clang::noncopyable {
+    public:
+        /** Constructor, threads is the number of concurrently running requests */
+        server(uint32_t threads) : mListen(-1), mReaders(0), mJobs(threads) {}
+
+        /** Stops serving, waits for all connections */
+        ~server() {
+            std::unique_lock<std::mutex> l(mMutex);
+
+            for (auto &fd : mConnections) {
+                shutdown(fd, SHUT_RDWR);
+            }
+
+            mCond.wait(l, [this]{ return mReaders == 0; });
+
+            if (mListen >= 0) {
+                close(mListen);
+                unlink(mPath.c_str());
+            }
+        }
+
+        /** Starts listening on path, returns false if it is in use or cannot be bound */
+        bool listen(const std::string& path);
+
+        /** Accepts connections until stop is called */
+        void run();
+
+        /** Makes run return, may be called from any thread */
+        void stop() {
+            shutdown(mListen, SHUT_RDWR);
+        }
+    private:
+        std::string mPath;
+        int mListen;
+        std::unordered_map<std::string, std::unique_ptr<project>> mProjects;
+        std::vector<int> mConnections;
+        uint32_t mReaders;
+        std::mutex mMutex;
+        std::condition_variable mCond;
+        // declared last so running jobs finish before projects go away
+        job_queue mJobs;
+
+        /** Reads requests of c until it disconnects */
+        void serve(connection& c);
+
+        /** Executes a single request and responds to it */
+        void handle(connection& c, const std::string& message);
+
+        /** Executes op with arguments from r, writes the return value to w */
+        rpc_status execute(connection& c, rpc_op op, wire_reader& r, wire_writer& w);
+
+        /** Returns the project at root, creates it and loads its compilation database if needed */
+        project* open(const std::string& root);
+
+        /** Sends diagnostic updates of c's project to c */
+        void subscribe(connection& c, uint32_t interval);
+
+        /** Stops diagnostic updates to c */
+        void unsubscribe(connection& c);
+
+        /** Applies an update to the snapshot of p and forwards it to all subscribers */
+        void publish(project& p, const std::string& path, const std::vector<clang::diagnostic>& added,
+            const std::vector<clang::diagnostic>& removed);
+    };
+
+    bool server::listen(const std::string& path) {
+        // a socket nobody answers on is left over from a daemon which did not exit cleanly
+        clang::rpc_client probe;
+        if (probe.connect(path)) {
+            std::cerr << "A daemon is already listening on " << path << std::endl;
+            return false;
+        }
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+
+        if (path.size() >= sizeof(addr.sun_path))
+            return false;
+
+        strcpy(addr.sun_path, path.c_str());
+        unlink(path.c_str());
+
+        mListen = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (mListen < 0)
+            return false;
+
+        if (bind(mListen, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(mListen, SOMAXCONN) != 0) {
+            close(mListen);
+            mListen = -1;
+            return false;
+        }
+
+        mPath = path;
+        return true;
+    }
+
+    void server::run() {
+        while (true) {
+            int fd = accept4(mListen, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> l(mMutex);
+                mConnections.push_back(fd);
+                ++mReaders;
+            }
+
+            std::thread([this, fd]{
+                {
+                    connection c(fd);
+                    serve(c);
+
+                    std::lock_guard<std::mutex> l(mMutex);
+                    mConnections.erase(std::find(mConnections.begin(), mConnections.end(), fd));
+                }
+
+                // notify after the connection has been closed so the server can go away
+                std::lock_guard<std::mutex> l(mMutex);
+                --mReaders;
+                mCond.notify_all();
+            }).detach();
+        }
+    }
+
+    void server::serve(connection& c) {
+        std::string message;
+
+        while (worker_pool::receive(c.fd, message)) {
+            wire_reader r(message);
+            uint64_t id = 0;
+            uint8_t op = 0;
+
+            if (!r.get(id) || !r.get(op) || op >= static_cast<uint8_t>(rpc_op::count)) {
+                c.respond(id, rpc_status::bad_request, wire_writer());
+                continue;
+            }
+
+            // state changes are a barrier, everything before them has to be done
+            if (clang::rpc_ordered(static_cast<rpc_op>(op))) {
+                c.wait_idle();
+                handle(c, message);
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> l(c.mutex);
+                ++c.running;
+            }
+
+            auto shared = std::make_shared<std::string>(std::move(message));
+            mJobs.push([this, &c, shared]{
+                handle(c, *shared);
+
+                std::lock_guard<std::mutex> l(c.mutex);
+                if (--c.running == 0)
+                    c.idle.notify_all();
+            });
+        }
+
+        // jobs reference the connection
+        c.wait_idle();
+        unsubscribe(c);
+    }
+
+    void server::handle(connection& c, const std::string& message) {
+        wire_reader r(message);
+        uint64_t id = 0;
+        uint8_t op = 0;
+
+        r.get(id);
+        r.get(op);
+
+        wire_writer w;
+        rpc_status status = execute(c, static_cast<rpc_op>(op), r, w);
+
+        c.respond(id, status, status == rpc_status::ok ? w : wire_writer());
+    }
+
+    rpc_status server::execute(connection& c, rpc_op op, wire_reader& r, wire_writer& w) {
+        std::string path, content;
+        uint32_t row = 0, col = 0;
+
+        if (op == rpc_op::project_open) {
+            if (!r.get(path))
+                return rpc_status::bad_request;
+
+            if (c.proj)
+                unsubscribe(c);
+
+            c.proj = open(path);
+            w.put(static_cast<uint32_t>(c.proj->entries));
+            return rpc_status::ok;
+        }
+
+        if (!c.proj)
+            return rpc_status::no_project;
+
+        clang::tool& t = c.proj->tool;
+        auto position = [&]{ return r.get(path) && r.get(row) && r.get(col); };
+
+        // ordering only covers this connection, others may be querying the same tool
+        project_lock lock(c.proj->state, op == rpc_op::workers_start || op == rpc_op::workers_stop
+            || op == rpc_op::index_load || op == rpc_op::index_clear);
+
+        switch (op) {
+            case rpc_op::arguments_set:
+            case rpc_op::arguments_set_file: {
+                std::vector<std::string> args;
+                if ((op == rpc_op::arguments_set_file && !r.get(path)) || !r.get(args))
+                    return rpc_status::bad_request;
+
+                std::vector<const char*> argv;
+                for (auto &a : args) {
+                    argv.push_back(a.c_str());
+                }
+
+                if (op == rpc_op::arguments_set_file)
+                    t.arguments_set(path.c_str(), argv.data(), argv.size());
+                else
+                    t.arguments_set(argv.data(), argv.size());
+            } break;
+            case rpc_op::arguments_load:
+                if (!r.get(path))
+                    return rpc_status::bad_request;
+
+                w.put(static_cast<uint32_t>(t.arguments_load(path.c_str())));
+                break;
+            case rpc_op::index_save:
+                if (!r.get(path))
+                    return rpc_status::bad_request;
+
+                t.index_save(path.c_str());
+                break;
+            case rpc_op::index_load:
+                if (!r.get(path))
+                    return rpc_status::bad_request;
+
+                t.index_load(path.c_str());
+                break;
+            case rpc_op::index_clear:
+                t.index_clear();
+                break;
+            case rpc_op::index_touch:
+                if (!r.get(path))
+                    return rpc_status::bad_request;
+
+                t.index_touch(path.c_str());
+                break;
+            case rpc_op::index_add:
+                if (!r.get(path))
+                    return rpc_status::bad_request;
+
+                t.index_add(path.c_str());
+                break;
+            case rpc_op::index_touch_unsaved:
+                if (!r.get(path) || !r.get(content))
+                    return rpc_status::bad_request;
+
+                t.index_touch_unsaved(path.c_str(), content.data(), content.size());
+                break;
+            case rpc_op::index_discard_unsaved:
+                if (!r.get(path))
+                    return rpc_status::bad_request;
+
+                t.index_discard_unsaved(path.c_str());
+                break;
+            case rpc_op::index_status:
+                clang::rpc_put(w, t.index_status());
+                break;
+            case rpc_op::index_hibernate: {
+                uint64_t idle = 0;
+                if (!r.get(idle))
+                    return rpc_status::bad_request;
+
+                t.index_hibernate(std::chrono::milliseconds(idle));
+            } break;
+            case rpc_op::index_remove:
+                if (!r.get(path))
+                    return rpc_status::bad_request;
+
+                t.index_remove(path.c_str());
+                break;
+            case rpc_op::index_hash:
+                w.put(t.index_hash());
+                break;
+            case rpc_op::index_hash_file:
+                if (!r.get(path))
+                    return rpc_status::bad_request;
+
+                w.put(t.index_hash(path.c_str()));
+                break;
+            case rpc_op::tu_ast:
+                if (!r.get(path))
+                    return rpc_status::bad_request;
+
+                w.put(t.tu_ast(path.c_str()));
+                break;
+            case rpc_op::tu_tokens:
+                if (!position())
+                    return rpc_status::bad_request;
+
+                w.put(t.tu_tokens(path.c_str(), row, col));
+                break;
+            case rpc_op::tu_diagnose:
+                if (!r.get(path))
+                    return rpc_status::bad_request;
+
+                w.put(t.tu_diagnose(path.c_str()));
+                break;
+            case rpc_op::workspace_diagnose:
+                clang::rpc_put(w, t.workspace_diagnose());
+                break;
+            case rpc_op::diagnostics_subscribe: {
+                uint32_t interval = 0;
+                if (!r.get(interval))
+                    return rpc_status::bad_request;
+
+                subscribe(c, interval);
+            } break;
+            case rpc_op::diagnostics_unsubscribe:
+                unsubscribe(c);
+                break;
+            case rpc_op::stats:
+                clang::rpc_put(w, t.stats());
+                break;
+            case rpc_op::stats_reset:
+                t.stats_reset();
+                break;
+            case rpc_op::trace_start:
+                t.trace_start();
+                break;
+            case rpc_op::trace_stop:
+                t.trace_stop();
+                break;
+            case rpc_op::trace_dump:
+                if (!r.get(path))
+                    return rpc_status::bad_request;
+
+                w.put(static_cast<uint8_t>(t.trace_dump(path.c_str())));
+                break;
+            case rpc_op::record_start:
+                if (!r.get(path))
+                    return rpc_status::bad_request;
+
+                w.put(static_cast<uint8_t>(t.record_start(path.c_str())));
+                break;
+            case rpc_op::record_stop:
+                t.record_stop();
+                break;
+            case rpc_op::workers_start: {
+                uint32_t n = 0;
+                if (!r.get(n))
+                    return rpc_status::bad_request;
+
+                w.put(static_cast<uint8_t>(t.workers_start(n)));
+            } break;
+            case rpc_op::workers_stop:
+                t.workers_stop();
+                break;
+            case rpc_op::workers_rebalance:
+                t.workers_rebalance();
+                break;
+            case rpc_op::cursor_complete:
+                if (!position())
+                    return rpc_status::bad_request;
+
+                w.put(t.cursor_complete(path.c_str(), row, col));
+                break;
+            case rpc_op::cursor_type:
+                if (!position())
+                    return rpc_status::bad_request;
+
+                w.put(t.cursor_type(path.c_str(), row, col));
+                break;
+            case rpc_op::cursor_declaration:
+                if (!position())
+                    return rpc_status::bad_request;
+
+                w.put(t.cursor_declaration(path.c_str(), row, col));
+                break;
+            case rpc_op::cursor_definition:
+                if (!position())
+                    return rpc_status::bad_request;
+
+                w.put(t.cursor_definition(path.c_str(), row, col));
+                break;
+            case rpc_op::cursor_info:
+                if (!position())
+                    return rpc_status::bad_request;
+
+                w.put(t.cursor_info(path.c_str(), row, col));
+                break;
+            case rpc_op::cursor_batch: {
+                std::vector<clang::cursor_query> queries;
+                if (!r.get(path) || !r.get(queries))
+                    return rpc_status::bad_request;
+
+                w.put(t.cursor_batch(path.c_str(), queries));
+            } break;
+            case rpc_op::project_open:
+            case rpc_op::count:
+                return rpc_status::bad_request;
+        }
+
+        return rpc_status::ok;
+    }
+
+    project* server::open(const std::string& root) {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        std::unique_ptr<project>& p = mProjects[root];
+        if (!p) {
+            p.reset(new project(root));
+            p->entries = p->tool.arguments_load(root.c_str());
+        }
+
+        return p.get();
+    }
+
+    void server::subscribe(connection& c, uint32_t interval) {
+        project& p = *c.proj;
+        std::lock_guard<std::mutex> s(p.subscription);
+
+        bool first = false;
+        {
+            std::lock_guard<std::mutex> l(p.mutex);
+            if (std::find(p.subscribers.begin(), p.subscribers.end(), &c) != p.subscribers.end())
+                return;
+
+            first = p.subscribers.empty();
+
+            // the tool sends everything again to its first subscriber, later ones get the snapshot
+            if (first) {
+                p.snapshot.clear();
+            } else {
+                for (auto &unit : p.snapshot) {
+                    std::vector<clang::diagnostic> added;
+                    for (auto &d : unit.second) {
+                        added.push_back(d.second);
+                    }
+
+                    wire_writer w;
+                    w.put(unit.first);
+                    w.put(added);
+                    w.put(std::vector<clang::diagnostic>());
+                    c.respond(0, rpc_status::ok, w);
+                }
+            }
+
+            p.subscribers.push_back(&c);
+        }
+
+        if (first) {
+            p.tool.diagnostics_subscribe([this, &p](const std::string& path, const std::vector<clang::diagnostic>& added,
+                const std::vector<clang::diagnostic>& removed) {
+                publish(p, path, added, removed);
+            }, std::chrono::milliseconds(interval));
+        }
+    }
+
+    void server::unsubscribe(connection& c) {
+        if (!c.proj)
+            return;
+
+        project& p = *c.proj;
+        std::lock_guard<std::mutex> s(p.subscription);
+
+        bool last = false;
+        {
+            std::lock_guard<std::mutex> l(p.mutex);
+
+            auto it = std::find(p.subscribers.begin(), p.subscribers.end(), &c);
+            if (it == p.subscribers.end())
+                return;
+
+            p.subscribers.erase(it);
+            last = p.subscribers.empty();
+        }
+
+        // joins the publisher thread, which may be waiting for p.mutex
+        if (last)
+            p.tool.diagnostics_unsubscribe();
+    }
+
+    void server::publish(project& p, const std::string& path, const std::vector<clang::diagnostic>& added,
+        const std::vector<clang::diagnostic>& removed)
+    {
+        std::lock_guard<std::mutex> l(p.mutex);
+
+        auto &unit = p.snapshot[path];
+        for (auto &d : removed) {
+            unit.erase(clang::diagnostic_key(d));
+        }
+
+        for (auto &d : added) {
+            unit[clang::diagnostic_key(d)] = d;
+        }
+
+        if (unit.empty())
+            p.snapshot.erase(path);
+
+        wire_writer w;
+        w.put(path);
+        w.put(added);
+        w.put(removed);
+
+        for (auto &c : p.subscribers) {
+            c->respond(0, rpc_status::ok, w);
+        }
+    }
+}
+
+/**
+ * Serves clang::tool to many clients over a Unix domain socket
+ *
+ * Usage: clang_tool_daemon <socket> [--threads=N]. Clients open a project by its root
+ * directory, all clients opening the same root share one index. Runs until SIGINT or
+ * SIGTERM, see daemon/rpc.hpp for the protocol.
+ */
+int main(int argc, char** argv) {
+    const char* path = nullptr;
+    uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--threads=", 10) == 0)
+            threads = std::max(1ul, strtoul(argv[i]+10, nullptr, 10));
+        else if (strncmp(argv[i], "--", 2) != 0)
+            path = argv[i];
+    }
+
+    if (!path) {
+        std::cerr << "Usage: " << argv[0] << " <socket> [--threads=N]" << std::endl;
+        return 1;
+    }
+
+    // all threads inherit the mask, signals are only taken by sigwait below
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    server s(threads);
+    if (!s.listen(path)) {
+        std::cerr << "Unable to listen on " << path << std::endl;
+        return 1;
+    }
+
+    std::thread waiter([&]{
+        int sig = 0;
+        do {
+            sigwait(&signals, &sig);
+        } while (sig == SIGPIPE);
+
+        s.stop();
+    });
+
+    s.run();
+
+    // run only returns after stop, unless accept failed
+    pthread_kill(waiter.native_handle(), SIGTERM);
+    waiter.join();
+    return 0;
+}
@@ -0,0 +1,205 @@
+/**
+* @file daemon/load.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cstdlib>
+
+#include "clang_stats.hpp"
+#include "rpc.hpp"
+
+namespace {
+    /// Latencies of all requests in nanoseconds
+    clang::histogram latencies;
+
+    /// Requests which failed or did not get a response
+    std::atomic<uint64_t> errors(0);
+
+    /** Returns the value of --name=value, or def */
+    std::string option(int argc, char** argv, const char* name, const char* def) {
+        size_t len = strlen(name);
+
+        for (int i = 1; i < argc; ++i) {
+            if (strncmp(argv[i], "--", 2) == 0 && strncmp(argv[i]+2, name, len) == 0 && argv[i][2+len] == '=')
+                return argv[i]+3+len;
+        }
+
+        return def;
+    }
+
+    /** Returns the request named name, rpc_op::count if it is not a query */
+    clang::rpc_op find_op(const std::string& name) {
+        for (uint32_t i = 0; i < static_cast<uint32_t>(clang::rpc_op::count); ++i) {
+            clang::rpc_op op = static_cast<clang::rpc_op>(i);
+
+            if (name == clang::rpc2str(op) && !clang::rpc_ordered(op) && op != clang::rpc_op::cursor_batch)
+                return op;
+        }
+
+        return clang::rpc_op::count;
+    }
+
+    /** Sends requests on a single connection, keeping depth of them in flight */
+    void connection(const std::string& socket, const std::string& project, clang::rpc_op op,
+        const clang::wire_writer& args, uint32_t requests, uint32_t depth)
+    {
+        clang::rpc_client client;
+        clang::wire_writer open;
+        open.put(project);
+
+        std::string payload;
+        if (!client.connect(socket) || !client.call(clang::rpc_op::project_open, open, payload)) {
+            errors += requests;
+            return;
+        }
+
+        std::unordered_map<uint64_t, std::chrono::steady_clock::time_point> inflight;
+        uint32_t sent = 0;
+        uint32_t done = 0;
+
+        while (done < requests) {
+            while (sent < requests && inflight.size() < depth) {
+                uint64_t id = client.send(op, args);
+                if (!id)
+                    break;
+
+                inflight[id] = std::chrono::steady_clock::now();
+                ++sent;
+            }
+
+            uint64_t id = 0;
+            clang::rpc_status status;
+
+            if (inflight.empty() || !client.receive(id, status, payload)) {
+                errors += requests - done;
+                return;
+            }
+
+            // diagnostic updates are not ours
+            auto it = inflight.find(id);
+            if (it == inflight.end())
+                continue;
+
+            latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - it->second).count());
+
+            if (status != clang::rpc_status::ok)
+                ++errors;
+
+            inflight.erase(it);
+            ++done;
+        }
+    }
+}
+
+/**
+ * Measures throughput of a daemon with many concurrent, pipelined connections
+ *
+ * Usage: clang_tool_load <socket> --file=<path> [--project=<dir>] [--op=cursor_type]
+ * [--row=1] [--col=1] [--connections=8] [--depth=16] [--requests=1000]. The file is
+ * touched once, then each connection sends requests with depth of them in flight. Prints
+ * one JSON object per line, like the benchmark.
+ */
+int main(int argc, char** argv) {
+    const char* socket = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--", 2) != 0)
+            socket = argv[i];
+    }
+
+    std::string file = option(argc, argv, "file", "");
+    std::string project = option(argc, argv, "project", "");
+    std::string name = option(argc, argv, "op", "cursor_type");
+    uint32_t row = strtoul(option(argc, argv, "row", "1").c_str(), nullptr, 10);
+    uint32_t col = strtoul(option(argc, argv, "col", "1").c_str(), nullptr, 10);
+    uint32_t connections = std::max(1ul, strtoul(option(argc, argv, "connections", "8").c_str(), nullptr, 10));
+    uint32_t depth = std::max(1ul, strtoul(option(argc, argv, "depth", "16").c_str(), nullptr, 10));
+    uint32_t requests = strtoul(option(argc, argv, "requests", "1000").c_str(), nullptr, 10);
+
+    clang::rpc_op op = find_op(name);
+    if (!socket || file.empty() || op == clang::rpc_op::count) {
+        std::cerr << "Usage: " << argv[0] << " <socket> --file=<path> [--project=<dir>] [--op=cursor_type]"
+                  << " [--row=1] [--col=1] [--connections=8] [--depth=16] [--requests=1000]" << std::endl;
+        return 1;
+    }
+
+    if (project.empty())
+        project = file.substr(0, file.find_last_of('/'));
+
+    clang::wire_writer args;
+    if (op != clang::rpc_op::index_status && op != clang::rpc_op::index_hash && op != clang::rpc_op::workspace_diagnose
+        && op != clang::rpc_op::stats)
+        args.put(file);
+
+    if (op == clang::rpc_op::tu_tokens || (op >= clang::rpc_op::cursor_complete && op <= clang::rpc_op::cursor_info)) {
+        args.put(row);
+        args.put(col);
+    }
+
+    // parse once up front so the first requests do not measure the parse
+    {
+        clang::rpc_client client;
+        clang::wire_writer open, touch;
+        open.put(project);
+        touch.put(file);
+
+        std::string payload;
+        if (!client.connect(socket) || !client.call(clang::rpc_op::project_open, open, payload)
+            || !client.call(clang::rpc_op::index_touch, touch, payload)) {
+            std::cerr << "Unable to open " << file << " on " << socket << std::endl;
+            return 1;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < connections; ++i) {
+        threads.emplace_back(connection, std::string(socket), project, op, std::cref(args), requests, depth);
+    }
+
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "{\"config\":{\"socket\":\"" << socket << "\",\"file\":\"" << file << "\",\"op\":\"" << name
+              << "\",\"connections\":" << connections << ",\"depth\":" << depth << ",\"requests\":" << requests << "}}" << std::endl;
+
+    std::cout << "{\"op\":\"" << name << "\",\"count\":" << latencies.count() << ",\"errors\":" << errors.load()
+              << ",\"wall_s\":" << wall << ",\"rps\":" << (wall > 0 ? latencies.count() / wall : 0)
+              << ",\"mean_us\":" << (latencies.count() ? latencies.sum() / latencies.count() / 1000.0 : 0)
+              << ",\"p50_us\":" << latencies.percentile(50) / 1000.0
+              << ",\"p90_us\":" << latencies.percentile(90) / 1000.0
+              << ",\"p99_us\":" << latencies.percentile(99) / 1000.0
+              << ",\"max_us\":" << latencies.max() / 1000.0 << "}" << std::endl;
+
+    return errors.load() ? 1 : 0;
+}
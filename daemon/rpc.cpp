@@ -0,0 +1,220 @@
+/**
+* @file daemon/rpc.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "clang_worker_pool.hpp"
+#include "rpc.hpp"
+
+namespace clang {
+    bool rpc_ordered(rpc_op op) {
+        switch (op) {
+            case rpc_op::index_status:
+            case rpc_op::index_hash:
+            case rpc_op::index_hash_file:
+            case rpc_op::tu_ast:
+            case rpc_op::tu_tokens:
+            case rpc_op::tu_diagnose:
+            case rpc_op::workspace_diagnose:
+            case rpc_op::stats:
+            case rpc_op::cursor_complete:
+            case rpc_op::cursor_type:
+            case rpc_op::cursor_declaration:
+            case rpc_op::cursor_definition:
+            case rpc_op::cursor_info:
+            case rpc_op::cursor_batch:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    void rpc_put(wire_writer& w, const ressource_map& value) {
+        w.put(static_cast<uint32_t>(value.size()));
+
+        for (auto &unit : value) {
+            w.put(unit.first);
+            w.put(unit.second);
+        }
+    }
+
+    void rpc_put(wire_writer& w, const diagnostic_map& value) {
+        w.put(static_cast<uint32_t>(value.size()));
+
+        for (auto &file : value) {
+            w.put(file.first);
+            w.put(file.second);
+        }
+    }
+
+    void rpc_put(wire_writer& w, const std::vector<stat_entry>& value) {
+        w.put(static_cast<uint32_t>(value.size()));
+
+        for (auto &e : value) {
+            w.put(static_cast<uint32_t>(e.op));
+            w.put(e.count);
+            w.put(e.total);
+            w.put(e.p50);
+            w.put(e.p90);
+            w.put(e.p99);
+            w.put(e.max);
+        }
+    }
+
+    bool rpc_get(wire_reader& r, ressource_map& value) {
+        uint32_t n = 0;
+        if (!r.get(n))
+            return false;
+
+        for (uint32_t i = 0; i < n; ++i) {
+            std::string path;
+            ressource_usage usage;
+
+            if (!r.get(path) || !r.get(usage))
+                return false;
+
+            value[path] = std::move(usage);
+        }
+
+        return true;
+    }
+
+    bool rpc_get(wire_reader& r, diagnostic_map& value) {
+        uint32_t n = 0;
+        if (!r.get(n))
+            return false;
+
+        for (uint32_t i = 0; i < n; ++i) {
+            std::string file;
+            std::vector<diagnostic> diagnostics;
+
+            if (!r.get(file) || !r.get(diagnostics))
+                return false;
+
+            value[file] = std::move(diagnostics);
+        }
+
+        return true;
+    }
+
+    bool rpc_get(wire_reader& r, std::vector<stat_entry>& value) {
+        uint32_t n = 0;
+        if (!r.get(n))
+            return false;
+
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t op = 0;
+            stat_entry e;
+
+            if (!r.get(op) || !r.get(e.count) || !r.get(e.total) || !r.get(e.p50) || !r.get(e.p90)
+                || !r.get(e.p99) || !r.get(e.max))
+                return false;
+
+            e.op = static_cast<stat_op>(op);
+            value.push_back(e);
+        }
+
+        return true;
+    }
+
+    bool rpc_client::connect(const std::string& socket) {
+        close();
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+
+        if (socket.size() >= sizeof(addr.sun_path))
+            return false;
+
+        strcpy(addr.sun_path, socket.c_str());
+
+        mFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (mFd < 0)
+            return false;
+
+        if (::connect(mFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void rpc_client::close() {
+        if (mFd >= 0)
+            ::close(mFd);
+
+        mFd = -1;
+    }
+
+    uint64_t rpc_client::send(rpc_op op, const wire_writer& args) {
+        uint64_t id = mNext++;
+
+        wire_writer w;
+        w.put(id);
+        w.put(static_cast<uint8_t>(op));
+
+        if (mFd < 0 || !worker_pool::send(mFd, w.buffer()+args.buffer()))
+            return 0;
+
+        return id;
+    }
+
+    bool rpc_client::receive(uint64_t& id, rpc_status& status, std::string& payload) {
+        std::string message;
+        uint8_t s = 0;
+
+        status = rpc_status::bad_request;
+        if (mFd < 0 || !worker_pool::receive(mFd, message))
+            return false;
+
+        wire_reader r(message);
+        if (!r.get(id) || !r.get(s))
+            return false;
+
+        // header is a fixed 9 bytes
+        status = static_cast<rpc_status>(s);
+        payload.assign(message, sizeof(uint64_t) + sizeof(uint8_t), std::string::npos);
+        return true;
+    }
+
+    bool rpc_client::call(rpc_op op, const wire_writer& args, std::string& payload) {
+        uint64_t id = send(op, args);
+        if (!id)
+            return false;
+
+        uint64_t got = 0;
+        rpc_status status;
+
+        while (receive(got, status, payload)) {
+            if (got == id)
+                return status == rpc_status::ok;
+        }
+
+        return false;
+    }
+}
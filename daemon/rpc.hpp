@@ -0,0 +1,203 @@
+/**
+* @file daemon/rpc.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_DAEMON_RPC_HPP_
+#define _RD_DAEMON_RPC_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "clang_wire.hpp"
+#include "clang_stats.hpp"
+#include "clang_diagnostic.hpp"
+#include "clang_translation_unit.hpp"
+#include "clang_ressource_usage.hpp"
+
+#define R2SMACRO(op__) case rpc_op::op__: return #op__;
+
+namespace clang {
+    /**
+     * Requests understood by the daemon
+     *
+     * Each request is a message framed like worker_pool::send, starting with a 64 bit id
+     * chosen by the client and the op, followed by the arguments of the tool method of the
+     * same name. Responses start with the id of their request and an rpc_status, followed by
+     * the return value. Diagnostic updates are pushed with id 0.
+     */
+    enum class rpc_op : uint8_t {
+        project_open = 0,
+        arguments_set,
+        arguments_set_file,
+        arguments_load,
+        index_save,
+        index_load,
+        index_clear,
+        index_touch,
+        index_add,
+        index_touch_unsaved,
+        index_status,
+        index_hibernate,
+        index_remove,
+        index_hash,
+        index_hash_file,
+        tu_ast,
+        tu_tokens,
+        tu_diagnose,
+        workspace_diagnose,
+        diagnostics_subscribe,
+        diagnostics_unsubscribe,
+        stats,
+        stats_reset,
+        trace_start,
+        trace_stop,
+        trace_dump,
+        record_start,
+        record_stop,
+        workers_start,
+        workers_stop,
+        workers_rebalance,
+        cursor_complete,
+        cursor_type,
+        cursor_declaration,
+        cursor_definition,
+        cursor_info,
+        cursor_batch,
+        index_discard_unsaved,
+        // number of requests, keep last
+        count
+    };
+
+    /** Converts a request to a string */
+    inline const char* rpc2str(rpc_op op) {
+        switch (op) {
+            R2SMACRO(project_open)
+            R2SMACRO(arguments_set)
+            R2SMACRO(arguments_set_file)
+            R2SMACRO(arguments_load)
+            R2SMACRO(index_save)
+            R2SMACRO(index_load)
+            R2SMACRO(index_clear)
+            R2SMACRO(index_touch)
+            R2SMACRO(index_add)
+            R2SMACRO(index_touch_unsaved)
+            R2SMACRO(index_status)
+            R2SMACRO(index_hibernate)
+            R2SMACRO(index_remove)
+            R2SMACRO(index_hash)
+            R2SMACRO(index_hash_file)
+            R2SMACRO(tu_ast)
+            R2SMACRO(tu_tokens)
+            R2SMACRO(tu_diagnose)
+            R2SMACRO(workspace_diagnose)
+            R2SMACRO(diagnostics_subscribe)
+            R2SMACRO(diagnostics_unsubscribe)
+            R2SMACRO(stats)
+            R2SMACRO(stats_reset)
+            R2SMACRO(trace_start)
+            R2SMACRO(trace_stop)
+            R2SMACRO(trace_dump)
+            R2SMACRO(record_start)
+            R2SMACRO(record_stop)
+            R2SMACRO(workers_start)
+            R2SMACRO(workers_stop)
+            R2SMACRO(workers_rebalance)
+            R2SMACRO(cursor_complete)
+            R2SMACRO(cursor_type)
+            R2SMACRO(cursor_declaration)
+            R2SMACRO(cursor_definition)
+            R2SMACRO(cursor_info)
+            R2SMACRO(cursor_batch)
+            R2SMACRO(index_discard_unsaved)
+            R2SMACRO(count)
+        }
+
+        return "";
+    }
+
+    /**
+     * Returns true if op changes the state of the project or the connection
+     *
+     * These requests wait for all earlier requests of their connection and the connection's
+     * later requests wait for them. All other requests run concurrently and may be answered
+     * in any order.
+     */
+    bool rpc_ordered(rpc_op op);
+
+    /** Result of a request */
+    enum class rpc_status : uint8_t {
+        ok = 0,
+        /// No project_open on this connection yet
+        no_project,
+        /// Unknown op or malformed arguments
+        bad_request
+    };
+
+    /** Appends values which have no wire_writer overload */
+    void rpc_put(wire_writer& w, const ressource_map& value);
+    void rpc_put(wire_writer& w, const diagnostic_map& value);
+    void rpc_put(wire_writer& w, const std::vector<stat_entry>& value);
+
+    /** Reads values written by rpc_put */
+    bool rpc_get(wire_reader& r, ressource_map& value);
+    bool rpc_get(wire_reader& r, diagnostic_map& value);
+    bool rpc_get(wire_reader& r, std::vector<stat_entry>& value);
+
+    /** Blocking connection to a daemon, requests may be pipelined */
+    class rpc_client : private noncopyable {
+    public:
+        /** Constructor */
+        rpc_client() : mFd(-1), mNext(1) {}
+
+        /** Closes the connection */
+        ~rpc_client() {
+            close();
+        }
+
+        /** Connects to the daemon listening at socket, returns false on failure */
+        bool connect(const std::string& socket);
+
+        /** Closes the connection */
+        void close();
+
+        /** Sends a request without waiting for the response, returns its id or 0 on failure */
+        uint64_t send(rpc_op op, const wire_writer& args = wire_writer());
+
+        /**
+         * Receives the next response or diagnostic update, in the order the daemon sends them
+         *
+         * Payload is the return value of the request, status is rpc_status::bad_request if
+         * the connection broke.
+         */
+        bool receive(uint64_t& id, rpc_status& status, std::string& payload);
+
+        /** Sends a request and waits for its response, skipping responses to other requests */
+        bool call(rpc_op op, const wire_writer& args, std::string& payload);
+    private:
+        int mFd;
+        uint64_t mNext;
+    };
+}
+
+#undef R2SMACRO
+
+#endif /* _RD_DAEMON_RPC_HPP_ */
@@ -0,0 +1,381 @@
+/**
+* @file lsp/json.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <cstdio>
+#include <cstring>
+
+#include "json.hpp"
+
+namespace clang {
+    namespace {
+        /** Appends code point cp as UTF-8 */
+        void append_utf8(std::string& out, uint32_t cp) {
+            if (cp < 0x80) {
+                out += static_cast<char>(cp);
+            } else if (cp < 0x800) {
+                out += static_cast<char>(0xC0 | (cp >> 6));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            } else if (cp < 0x10000) {
+                out += static_cast<char>(0xE0 | (cp >> 12));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            } else {
+                out += static_cast<char>(0xF0 | (cp >> 18));
+                out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+        }
+
+        /** Parses 4 hex digits at p, returns false if they are not */
+        bool parse_hex(const char* p, uint32_t& value) {
+            value = 0;
+
+            for (int i = 0; i < 4; ++i) {
+                char c = p[i];
+                value <<= 4;
+
+                if (c >= '0' && c <= '9')
+                    value |= c - '0';
+                else if (c >= 'a' && c <= 'f')
+                    value |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F')
+                    value |= c - 'A' + 10;
+                else
+                    return false;
+            }
+
+            return true;
+        }
+    }
+
+    json_writer& json_writer::key(const char* k) {
+        string(k);
+        mBuffer += ':';
+        mComma = false;
+        return *this;
+    }
+
+    json_writer& json_writer::string(const char* data, size_t size) {
+        separate();
+        mBuffer += '"';
+
+        // copy runs of characters which need no escaping at once
+        const char* run = data;
+        const char* end = data + size;
+
+        for (const char* p = data; p < end; ++p) {
+            unsigned char c = *p;
+            if (c >= 0x20 && c != '"' && c != '\\')
+                continue;
+
+            mBuffer.append(run, p - run);
+            run = p + 1;
+
+            switch (c) {
+                case '"': mBuffer += "\\\""; break;
+                case '\\': mBuffer += "\\\\"; break;
+                case '\n': mBuffer += "\\n"; break;
+                case '\r': mBuffer += "\\r"; break;
+                case '\t': mBuffer += "\\t"; break;
+                default: {
+                    char escape[8];
+                    snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    mBuffer += escape;
+                }
+            }
+        }
+
+        mBuffer.append(run, end - run);
+        mBuffer += '"';
+        mComma = true;
+        return *this;
+    }
+
+    json_writer& json_writer::string(const char* value) {
+        return string(value, strlen(value));
+    }
+
+    json_writer& json_writer::number(int64_t value) {
+        separate();
+        mBuffer += std::to_string(value);
+        mComma = true;
+        return *this;
+    }
+
+    json_writer& json_writer::boolean(bool value) {
+        separate();
+        mBuffer += value ? "true" : "false";
+        mComma = true;
+        return *this;
+    }
+
+    json_writer& json_writer::null() {
+        separate();
+        mBuffer += "null";
+        mComma = true;
+        return *this;
+    }
+
+    json_writer& json_writer::raw(const char* data, size_t size) {
+        separate();
+        mBuffer.append(data, size);
+        mComma = true;
+        return *this;
+    }
+
+    char json_reader::next() {
+        if (!mPos)
+            return 0;
+
+        while (mPos < mEnd && (*mPos == ' ' || *mPos == '\t' || *mPos == '\n' || *mPos == '\r'))
+            ++mPos;
+
+        return mPos < mEnd ? *mPos : 0;
+    }
+
+    bool json_reader::consume(char c) {
+        if (next() != c)
+            return false;
+
+        ++mPos;
+        return true;
+    }
+
+    json_type json_reader::peek() {
+        switch (next()) {
+            case 'n': return json_type::null_t;
+            case 't':
+            case 'f': return json_type::bool_t;
+            case '"': return json_type::string_t;
+            case '[': return json_type::array_t;
+            case '{': return json_type::object_t;
+            case '-':
+            case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9':
+                return json_type::number_t;
+            default:
+                return json_type::invalid_t;
+        }
+    }
+
+    bool json_reader::begin_object() {
+        return consume('{') || fail();
+    }
+
+    bool json_reader::next_key(std::string& key) {
+        // separators are optional, the input comes from a well-behaved client
+        consume(',');
+
+        if (!mPos || consume('}'))
+            return false;
+
+        return (string(key) && consume(':')) || fail();
+    }
+
+    bool json_reader::begin_array() {
+        return consume('[') || fail();
+    }
+
+    bool json_reader::next_element() {
+        consume(',');
+
+        if (!mPos || consume(']'))
+            return false;
+
+        return next() != 0 || fail();
+    }
+
+    bool json_reader::string(std::string& value) {
+        if (!consume('"'))
+            return fail();
+
+        value.clear();
+        const char* run = mPos;
+
+        while (mPos < mEnd && *mPos != '"') {
+            if (*mPos != '\\') {
+                ++mPos;
+                continue;
+            }
+
+            value.append(run, mPos - run);
+            if (mEnd - mPos < 2)
+                return fail();
+
+            char c = mPos[1];
+            mPos += 2;
+
+            switch (c) {
+                case 'n': value += '\n'; break;
+                case 'r': value += '\r'; break;
+                case 't': value += '\t'; break;
+                case 'b': value += '\b'; break;
+                case 'f': value += '\f'; break;
+                case 'u': {
+                    uint32_t cp = 0;
+                    if (mEnd - mPos < 4 || !parse_hex(mPos, cp))
+                        return fail();
+
+                    mPos += 4;
+
+                    // surrogate pairs encode code points above the BMP
+                    uint32_t low = 0;
+                    if (cp >= 0xD800 && cp < 0xDC00 && mEnd - mPos >= 6 && mPos[0] == '\\' && mPos[1] == 'u'
+                        && parse_hex(mPos+2, low) && low >= 0xDC00 && low < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        mPos += 6;
+                    }
+
+                    append_utf8(value, cp);
+                } break;
+                default:
+                    value += c;
+            }
+
+            run = mPos;
+        }
+
+        if (mPos >= mEnd)
+            return fail();
+
+        value.append(run, mPos - run);
+        ++mPos;
+        return true;
+    }
+
+    bool json_reader::number(int64_t& value) {
+        if (peek() != json_type::number_t)
+            return fail();
+
+        bool negative = *mPos == '-';
+        if (negative)
+            ++mPos;
+
+        value = 0;
+        while (mPos < mEnd && *mPos >= '0' && *mPos <= '9') {
+            value = value * 10 + (*mPos - '0');
+            ++mPos;
+        }
+
+        // fractions and exponents are truncated, the protocol only uses integers
+        while (mPos < mEnd && (*mPos == '.' || *mPos == 'e' || *mPos == 'E' || *mPos == '+' || *mPos == '-'
+            || (*mPos >= '0' && *mPos <= '9')))
+            ++mPos;
+
+        if (negative)
+            value = -value;
+
+        return true;
+    }
+
+    bool json_reader::boolean(bool& value) {
+        next();
+
+        if (mPos && mEnd - mPos >= 4 && strncmp(mPos, "true", 4) == 0) {
+            value = true;
+            mPos += 4;
+            return true;
+        }
+
+        if (mPos && mEnd - mPos >= 5 && strncmp(mPos, "false", 5) == 0) {
+            value = false;
+            mPos += 5;
+            return true;
+        }
+
+        return fail();
+    }
+
+    bool json_reader::null() {
+        next();
+
+        if (mPos && mEnd - mPos >= 4 && strncmp(mPos, "null", 4) == 0) {
+            mPos += 4;
+            return true;
+        }
+
+        return fail();
+    }
+
+    bool json_reader::skip() {
+        switch (peek()) {
+            case json_type::null_t:
+                return null();
+            case json_type::bool_t: {
+                bool b;
+                return boolean(b);
+            }
+            case json_type::number_t: {
+                int64_t n;
+                return number(n);
+            }
+            case json_type::string_t: {
+                // no need to unescape, just find the closing quote
+                for (++mPos; mPos < mEnd; ++mPos) {
+                    if (*mPos == '\\')
+                        ++mPos;
+                    else if (*mPos == '"')
+                        break;
+                }
+
+                if (mPos >= mEnd)
+                    return fail();
+
+                ++mPos;
+                return true;
+            }
+            case json_type::array_t:
+                begin_array();
+                while (next_element()) {
+                    if (!skip())
+                        return false;
+                }
+
+                return ok();
+            case json_type::object_t: {
+                std::string key;
+
+                begin_object();
+                while (next_key(key)) {
+                    if (!skip())
+                        return false;
+                }
+
+                return ok();
+            }
+            default:
+                return fail();
+        }
+    }
+
+    bool json_reader::span(const char*& begin, size_t& size) {
+        next();
+        begin = mPos;
+
+        if (!skip())
+            return false;
+
+        size = mPos - begin;
+        return true;
+    }
+}
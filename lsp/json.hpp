@@ -0,0 +1,153 @@
+/**
+* @file lsp/json.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_LSP_JSON_HPP_
+#define _RD_LSP_JSON_HPP_
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace clang {
+    /**
+     * Appends JSON to a buffer as it is produced, without building a document first
+     *
+     * Commas are inserted automatically, the caller is responsible for balancing objects
+     * and arrays and for calling key before each value inside an object.
+     */
+    class json_writer {
+    public:
+        /** Constructor */
+        json_writer() : mComma(false) {}
+
+        /** Returns the JSON written so far */
+        const std::string& buffer() const {
+            return mBuffer;
+        }
+
+        json_writer& begin_object() { separate(); mBuffer += '{'; mComma = false; return *this; }
+        json_writer& end_object() { mBuffer += '}'; mComma = true; return *this; }
+        json_writer& begin_array() { separate(); mBuffer += '['; mComma = false; return *this; }
+        json_writer& end_array() { mBuffer += ']'; mComma = true; return *this; }
+
+        /** Writes the key of the next value */
+        json_writer& key(const char* k);
+
+        json_writer& string(const char* data, size_t size);
+        json_writer& string(const std::string& value) { return string(value.data(), value.size()); }
+        json_writer& string(const char* value);
+        json_writer& number(int64_t value);
+        json_writer& boolean(bool value);
+        json_writer& null();
+
+        /** Writes value, which needs to be valid JSON, as is */
+        json_writer& raw(const char* data, size_t size);
+        json_writer& raw(const std::string& value) { return raw(value.data(), value.size()); }
+    private:
+        std::string mBuffer;
+        bool mComma;
+
+        /** Writes a comma if a value came before */
+        void separate() {
+            if (mComma)
+                mBuffer += ',';
+        }
+    };
+
+    /// Types of JSON values
+    enum class json_type {
+        null_t = 0,
+        bool_t,
+        number_t,
+        string_t,
+        array_t,
+        object_t,
+        invalid_t
+    };
+
+    /**
+     * Pull parser reading values in the order they appear
+     *
+     * Values which are not needed are skipped without allocating anything. All reads fail
+     * once the input turned out to be malformed, like wire_reader.
+     *
+     * @code
+     * r.begin_object();
+     * while (r.next_key(key)) {
+     *     if (key == "id") r.number(id); else r.skip();
+     * }
+     * @endcode
+     */
+    class json_reader {
+    public:
+        /** Reads from data, which needs to outlive the reader */
+        json_reader(const char* data, size_t size) : mPos(data), mEnd(data+size) {}
+
+        /** Returns false if the input is malformed */
+        bool ok() const {
+            return mPos != nullptr;
+        }
+
+        /** Returns the type of the next value */
+        json_type peek();
+
+        /** Enters an object */
+        bool begin_object();
+
+        /** Reads the next key of the current object, returns false once the object ended */
+        bool next_key(std::string& key);
+
+        /** Enters an array */
+        bool begin_array();
+
+        /** Moves to the next element of the current array, returns false once the array ended */
+        bool next_element();
+
+        bool string(std::string& value);
+        bool number(int64_t& value);
+        bool boolean(bool& value);
+        bool null();
+
+        /** Skips the next value, including all nested ones */
+        bool skip();
+
+        /** Skips the next value and returns where its text starts and its size */
+        bool span(const char*& begin, size_t& size);
+    private:
+        const char* mPos;
+        const char* mEnd;
+
+        /** Skips whitespace, returns the next character or 0 at the end */
+        char next();
+
+        /** Consumes c if it is the next character */
+        bool consume(char c);
+
+        /** Marks the input as malformed */
+        bool fail() {
+            mPos = nullptr;
+            return false;
+        }
+    };
+}
+
+#endif /* _RD_LSP_JSON_HPP_ */
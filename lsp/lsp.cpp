@@ -0,0 +1,945 @@
+/**
+* @file lsp/lsp.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+#include <ctime>
+
+#include <unistd.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "noncopyable.hpp"
+#include "clang_tool.hpp"
+#include "clang_job_queue.hpp"
+#include "clang_line_index.hpp"
+#include "json.hpp"
+
+namespace {
+    using clang::json_reader;
+    using clang::json_writer;
+    using clang::json_type;
+    using clang::completion_type;
+
+    /// JSON-RPC error codes
+    const int64_t parse_error = -32700;
+    const int64_t method_not_found = -32601;
+    const int64_t invalid_params = -32602;
+    const int64_t request_cancelled = -32800;
+
+    /// Maximum number of line indexes kept for files which are not open
+    const size_t file_cache_size = 256;
+
+    /** Reads messages framed with Content-Length headers from stdin */
+    class input {
+    public:
+        /** Constructor */
+        input() : mPos(0) {}
+
+        /** Reads the body of the next message, returns false at the end of the input */
+        bool read(std::string& body) {
+            size_t length = std::string::npos;
+
+            while (true) {
+                size_t eol = mBuffer.find("\r\n", mPos);
+                if (eol == std::string::npos) {
+                    if (!fill())
+                        return false;
+
+                    continue;
+                }
+
+                const char* line = mBuffer.data() + mPos;
+                size_t size = eol - mPos;
+                mPos = eol + 2;
+
+                // an empty line ends the headers, messages without a length are dropped
+                if (size == 0) {
+                    if (length != std::string::npos)
+                        break;
+
+                    continue;
+                }
+
+                if (size > 15 && strncasecmp(line, "Content-Length:", 15) == 0)
+                    length = strtoul(line+15, nullptr, 10);
+            }
+
+            while (mBuffer.size() - mPos < length) {
+                if (!fill())
+                    return false;
+            }
+
+            body.assign(mBuffer, mPos, length);
+            mPos += length;
+            return true;
+        }
+    private:
+        std::string mBuffer;
+        size_t mPos;
+
+        /** Reads more input, drops everything consumed so far */
+        bool fill() {
+            mBuffer.erase(0, mPos);
+            mPos = 0;
+
+            char chunk[65536];
+            ssize_t n = ::read(STDIN_FILENO, chunk, sizeof(chunk));
+            if (n <= 0)
+                return false;
+
+            mBuffer.append(chunk, n);
+            return true;
+        }
+    };
+
+    /// Serializes messages on stdout
+    std::mutex output;
+
+    /** Writes a message to stdout */
+    void send(const json_writer& w) {
+        const std::string header = "Content-Length: "+std::to_string(w.buffer().size())+"\r\n\r\n";
+
+        std::lock_guard<std::mutex> l(output);
+        for (const std::string* s : {&header, &w.buffer()}) {
+            for (size_t written = 0; written < s->size();) {
+                ssize_t n = ::write(STDOUT_FILENO, s->data() + written, s->size() - written);
+                if (n <= 0)
+                    return;
+
+                written += n;
+            }
+        }
+    }
+
+    /** Converts a file:// uri to a path */
+    std::string uri2path(const std::string& uri) {
+        size_t start = uri.compare(0, 7, "file://") == 0 ? 7 : 0;
+        std::string ret;
+        ret.reserve(uri.size() - start);
+
+        for (size_t i = start; i < uri.size(); ++i) {
+            if (uri[i] == '%' && i + 2 < uri.size()) {
+                ret += static_cast<char>(strtoul(uri.substr(i+1, 2).c_str(), nullptr, 16));
+                i += 2;
+            } else {
+                ret += uri[i];
+            }
+        }
+
+        return ret;
+    }
+
+    /** Converts a path to a file:// uri */
+    std::string path2uri(const std::string& path) {
+        static const char* hex = "0123456789ABCDEF";
+        std::string ret = "file://";
+
+        for (unsigned char c : path) {
+            if (isalnum(c) || strchr("/-._~", c)) {
+                ret += c;
+            } else {
+                ret += '%';
+                ret += hex[c >> 4];
+                ret += hex[c & 15];
+            }
+        }
+
+        return ret;
+    }
+
+    /** Returns the LSP SymbolKind of t, 0 if it should not be listed */
+    int64_t symbol_kind(completion_type t) {
+        switch (t) {
+            case completion_type::namespace_t: return 3;
+            case completion_type::class_t: return 5;
+            case completion_type::attribute_t: return 8;
+            case completion_type::method_t: return 6;
+            case completion_type::struct_t: return 23;
+            case completion_type::function_t: return 12;
+            case completion_type::enum_t: return 10;
+            case completion_type::enum_static_t: return 22;
+            case completion_type::union_t: return 23;
+            case completion_type::typedef_t: return 5;
+            case completion_type::variable_t: return 13;
+            case completion_type::macro_t: return 14;
+            default: return 0;
+        }
+    }
+
+    /** Returns the LSP CompletionItemKind of t */
+    int64_t completion_kind(completion_type t) {
+        switch (t) {
+            case completion_type::namespace_t: return 9;
+            case completion_type::class_t: return 7;
+            case completion_type::attribute_t: return 5;
+            case completion_type::method_t: return 2;
+            case completion_type::parameter_t: return 6;
+            case completion_type::struct_t: return 22;
+            case completion_type::function_t: return 3;
+            case completion_type::enum_t: return 13;
+            case completion_type::enum_static_t: return 20;
+            case completion_type::union_t: return 22;
+            case completion_type::typedef_t: return 7;
+            case completion_type::variable_t: return 6;
+            case completion_type::macro_t: return 21;
+            case completion_type::include_t: return 17;
+            default: return 1;
+        }
+    }
+
+    /** Returns the LSP DiagnosticSeverity of a CXDiagnosticSeverity */
+    int64_t lsp_severity(uint32_t severity) {
+        switch (severity) {
+            case CXDiagnostic_Error:
+            case CXDiagnostic_Fatal:
+                return 1;
+            case CXDiagnostic_Warning:
+                return 2;
+            case CXDiagnostic_Note:
+                return 3;
+            default:
+                return 4;
+        }
+    }
+
+    /** Returns offset of a 0-based line and UTF-16 character in the indexed buffer */
+    uint32_t lsp_offset(const clang::line_index& lines, uint32_t line, uint32_t character) {
+        if (line >= lines.rows())
+            return lines.buffer() ? lines.buffer()->size() : 0;
+
+        return lines.offset(line+1, lines.byte_column(line+1, character+1));
+    }
+
+    /** An open document */
+    struct document {
+        /// Current content, shared with the tool's overlay
+        clang::unsaved_buffer_shared text;
+        /// Line table of text, used for all position conversions until the next change
+        clang::line_index_shared lines;
+    };
+
+    /** A single entry of contentChanges */
+    struct content_change {
+        bool ranged;
+        uint32_t start_line, start_character;
+        uint32_t end_line, end_character;
+        std::string text;
+    };
+
+    /** Reads {"line": .., "character": ..} */
+    bool read_position(json_reader& r, uint32_t& line, uint32_t& character) {
+        std::string key;
+        int64_t value = 0;
+
+        r.begin_object();
+        while (r.next_key(key)) {
+            if (key == "line" && r.number(value))
+                line = value;
+            else if (key == "character" && r.number(value))
+                character = value;
+            else if (key != "line" && key != "character")
+                r.skip();
+        }
+
+        return r.ok();
+    }
+
+    /** Reads {"start": .., "end": ..} */
+    bool read_range(json_reader& r, content_change& c) {
+        std::string key;
+
+        r.begin_object();
+        while (r.next_key(key)) {
+            if (key == "start")
+                read_position(r, c.start_line, c.start_character);
+            else if (key == "end")
+                read_position(r, c.end_line, c.end_character);
+            else
+                r.skip();
+        }
+
+        return r.ok();
+    }
+
+    /** Reads textDocument.uri and position of params, either may be missing */
+    bool read_document(json_reader& r, std::string& path, uint32_t* line = nullptr, uint32_t* character = nullptr) {
+        std::string key, uri;
+
+        r.begin_object();
+        while (r.next_key(key)) {
+            if (key == "textDocument") {
+                r.begin_object();
+                while (r.next_key(key)) {
+                    if (key == "uri")
+                        r.string(uri);
+                    else
+                        r.skip();
+                }
+            } else if (key == "position" && line && character) {
+                read_position(r, *line, *character);
+            } else {
+                r.skip();
+            }
+        }
+
+        path = uri2path(uri);
+        return r.ok() && !uri.empty();
+    }
+
+    /**
+     * Language server on stdin / stdout
+     *
+     * Notifications are handled in order on the reading thread, requests run on a job
+     * queue and are answered as soon as they are done. Positions are converted with the
+     * line table of the document version the request was made for.
+     */
+    class server : private clang::noncopyable {
+    public:
+        /** Constructor, threads is the number of concurrently running requests */
+        server(uint32_t threads) : mShutdown(false), mJobs(threads) {}
+
+        /** Destructor, stops publishing before the members go away */
+        ~server() {
+            mTool.diagnostics_unsubscribe();
+        }
+
+        /** Serves until exit, returns the process exit code */
+        int run();
+    private:
+        clang::tool mTool;
+        std::unordered_map<std::string, document> mDocuments;
+        std::unordered_map<std::string, std::pair<time_t, clang::line_index_shared>> mFiles;
+        std::unordered_map<std::string, bool> mPending;
+        std::unordered_map<std::string, std::unordered_map<std::string, clang::diagnostic>> mDiagnostics;
+        bool mShutdown;
+        std::mutex mMutex;
+        std::mutex mDiagnosticsMutex;
+        // declared last so running jobs finish before everything else goes away
+        clang::job_queue mJobs;
+
+        /*
+         * Locking: mMutex guards documents, the file cache and pending requests,
+         * mDiagnosticsMutex the published diagnostics. mMutex may be acquired while holding
+         * mDiagnosticsMutex, never the other way around.
+         */
+
+        /** Handles a single message */
+        void dispatch(const std::string& method, const std::string& id, json_reader& params);
+
+        /** Answers initialize, loads the compilation database of the workspace */
+        void initialize(const std::string& id, json_reader& params);
+
+        void open(json_reader& params);
+        void change(json_reader& params);
+        void close(json_reader& params);
+        void cancel(json_reader& params);
+
+        /** Runs request id on the job queue, result writes its return value */
+        void queue(const std::string& id, std::function<void(json_writer& w)> result);
+
+        /** Sends an error response */
+        void error(const std::string& id, int64_t code, const char* message);
+
+        /** Returns the line table of path, from the open document or the file on disk */
+        clang::line_index_shared lines(const std::string& path);
+
+        /** Writes a location as an LSP Position */
+        void position(json_writer& w, const clang::line_index_shared& lines, uint32_t row, uint32_t col);
+
+        /** Writes a document symbol and its children */
+        void symbol(json_writer& w, const clang::ast_element& e, const clang::line_index_shared& lines);
+
+        /** Publishes all diagnostics of path after an update from the tool */
+        void publish(const std::string& path, const std::vector<clang::diagnostic>& added,
+            const std::vector<clang::diagnostic>& removed);
+    };
+
+    int server::run() {
+        input in;
+        std::string body, key, method, id;
+
+        while (in.read(body)) {
+            json_reader r(body.data(), body.size());
+            const char* params = "{}";
+            size_t params_size = 2;
+
+            method.clear();
+            id.clear();
+
+            r.begin_object();
+            while (r.next_key(key)) {
+                const char* begin = nullptr;
+                size_t size = 0;
+
+                if (key == "method") {
+                    r.string(method);
+                } else if (key == "id" && r.span(begin, size)) {
+                    id.assign(begin, size);
+                } else if (key == "params" && r.span(begin, size)) {
+                    params = begin;
+                    params_size = size;
+                } else if (key != "id" && key != "params") {
+                    r.skip();
+                }
+            }
+
+            if (!r.ok()) {
+                error("null", parse_error, "Malformed message");
+                continue;
+            }
+
+            if (method == "exit")
+                return mShutdown ? 0 : 1;
+
+            json_reader p(params, params_size);
+            dispatch(method, id, p);
+        }
+
+        return 1;
+    }
+
+    void server::dispatch(const std::string& method, const std::string& id, json_reader& params) {
+        if (method == "initialize") {
+            initialize(id, params);
+        } else if (method == "initialized") {
+            // nothing to do
+        } else if (method == "shutdown") {
+            mShutdown = true;
+            queue(id, [](json_writer& w){ w.null(); });
+        } else if (method == "textDocument/didOpen") {
+            open(params);
+        } else if (method == "textDocument/didChange") {
+            change(params);
+        } else if (method == "textDocument/didClose") {
+            close(params);
+        } else if (method == "$/cancelRequest") {
+            cancel(params);
+        } else if (method == "textDocument/completion" || method == "textDocument/definition") {
+            std::string path;
+            uint32_t line = 0, character = 0;
+
+            if (!read_document(params, path, &line, &character)) {
+                error(id, invalid_params, "Missing textDocument or position");
+                return;
+            }
+
+            // convert now, later changes must not shift the position
+            clang::line_index_shared l = lines(path);
+            uint32_t row = line + 1;
+            uint32_t col = l ? l->byte_column(row, character+1) : character+1;
+
+            if (method == "textDocument/completion") {
+                queue(id, [this, path, row, col](json_writer& w) {
+                    clang::completion_list items = mTool.cursor_complete(path.c_str(), row, col);
+
+                    w.begin_object().key("isIncomplete").boolean(false).key("items").begin_array();
+                    for (auto &item : items) {
+                        std::string signature = item.name;
+                        if (item.type == completion_type::function_t || item.type == completion_type::method_t) {
+                            signature += '(';
+                            for (size_t i = 0; i < item.args.size(); ++i) {
+                                signature += (i ? ", " : "") + item.args[i];
+                            }
+                            signature += ')';
+                        }
+
+                        // clang prefers lower priorities, so do editors with sortText
+                        char sort[16];
+                        snprintf(sort, sizeof(sort), "%08u", item.priority);
+
+                        w.begin_object()
+                            .key("label").string(item.name)
+                            .key("kind").number(completion_kind(item.type))
+                            .key("detail").string(item.return_type.empty() ? signature : item.return_type+" "+signature)
+                            .key("sortText").string(sort)
+                            .key("insertText").string(item.name);
+
+                        if (!item.brief.empty())
+                            w.key("documentation").string(item.brief);
+
+                        w.end_object();
+                    }
+                    w.end_array().end_object();
+                });
+            } else {
+                queue(id, [this, path, row, col](json_writer& w) {
+                    clang::location loc = mTool.cursor_definition(path.c_str(), row, col);
+                    if (loc.file.empty())
+                        loc = mTool.cursor_declaration(path.c_str(), row, col);
+
+                    if (loc.file.empty()) {
+                        w.null();
+                        return;
+                    }
+
+                    clang::line_index_shared l = lines(loc.file);
+
+                    w.begin_object().key("uri").string(path2uri(loc.file)).key("range").begin_object();
+                    w.key("start");
+                    position(w, l, loc.row, loc.col);
+                    w.key("end");
+                    position(w, l, loc.row, loc.col);
+                    w.end_object().end_object();
+                });
+            }
+        } else if (method == "textDocument/documentSymbol") {
+            std::string path;
+            if (!read_document(params, path)) {
+                error(id, invalid_params, "Missing textDocument");
+                return;
+            }
+
+            queue(id, [this, path](json_writer& w) {
+                clang::ast_element root = mTool.tu_ast(path.c_str());
+                clang::line_index_shared l = lines(path);
+
+                w.begin_array();
+                for (auto &e : root.children) {
+                    symbol(w, e, l);
+                }
+                w.end_array();
+            });
+        } else if (!id.empty()) {
+            error(id, method_not_found, "Method not supported");
+        }
+    }
+
+    void server::initialize(const std::string& id, json_reader& params) {
+        std::string key, root;
+        std::vector<std::string> args;
+
+        params.begin_object();
+        while (params.next_key(key)) {
+            if ((key == "rootUri" || key == "rootPath") && params.peek() == json_type::string_t) {
+                std::string value;
+                params.string(value);
+
+                // rootUri takes precedence, rootPath is deprecated
+                if (key == "rootUri" || root.empty())
+                    root = uri2path(value);
+            } else if (key == "initializationOptions" && params.peek() == json_type::object_t) {
+                params.begin_object();
+                while (params.next_key(key)) {
+                    if (key == "arguments") {
+                        params.begin_array();
+                        while (params.next_element()) {
+                            std::string arg;
+                            params.string(arg);
+                            args.push_back(arg);
+                        }
+                    } else {
+                        params.skip();
+                    }
+                }
+            } else {
+                params.skip();
+            }
+        }
+
+        if (!args.empty()) {
+            std::vector<const char*> argv;
+            for (auto &a : args) {
+                argv.push_back(a.c_str());
+            }
+
+            mTool.arguments_set(argv.data(), argv.size());
+        }
+
+        if (!root.empty())
+            mTool.arguments_load(root.c_str());
+
+        mTool.diagnostics_subscribe([this](const std::string& path, const std::vector<clang::diagnostic>& added,
+            const std::vector<clang::diagnostic>& removed) {
+            publish(path, added, removed);
+        });
+
+        json_writer w;
+        w.begin_object().key("jsonrpc").string("2.0").key("id").raw(id).key("result").begin_object()
+            .key("capabilities").begin_object()
+                .key("positionEncoding").string("utf-16")
+                .key("textDocumentSync").begin_object()
+                    .key("openClose").boolean(true)
+                    .key("change").number(2)
+                .end_object()
+                .key("completionProvider").begin_object()
+                    .key("triggerCharacters").begin_array().string(".").string(">").string(":").end_array()
+                .end_object()
+                .key("definitionProvider").boolean(true)
+                .key("documentSymbolProvider").boolean(true)
+            .end_object()
+            .key("serverInfo").begin_object().key("name").string("clang_tool_lsp").end_object()
+        .end_object().end_object();
+
+        send(w);
+    }
+
+    void server::open(json_reader& params) {
+        std::string key, uri, text;
+
+        params.begin_object();
+        while (params.next_key(key)) {
+            if (key != "textDocument") {
+                params.skip();
+                continue;
+            }
+
+            params.begin_object();
+            while (params.next_key(key)) {
+                if (key == "uri")
+                    params.string(uri);
+                else if (key == "text")
+                    params.string(text);
+                else
+                    params.skip();
+            }
+        }
+
+        if (!params.ok() || uri.empty())
+            return;
+
+        std::string path = uri2path(uri);
+        clang::unsaved_buffer_shared buffer = clang::unsaved_buffer::copy(text.data(), text.size());
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            mDocuments[path] = document{buffer, std::make_shared<clang::line_index>(buffer)};
+        }
+
+        // a light parse makes navigation available right away, the full one follows
+        mTool.index_touch_unsaved(path.c_str(), buffer);
+        mTool.index_add(path.c_str());
+
+        mJobs.push([this, path]{
+            mTool.tu_diagnose(path.c_str());
+        });
+    }
+
+    void server::change(json_reader& params) {
+        std::string key, uri;
+        std::vector<content_change> changes;
+
+        // the changes may come before the document, keep them until both are known
+        params.begin_object();
+        while (params.next_key(key)) {
+            if (key == "textDocument") {
+                params.begin_object();
+                while (params.next_key(key)) {
+                    if (key == "uri")
+                        params.string(uri);
+                    else
+                        params.skip();
+                }
+            } else if (key == "contentChanges") {
+                params.begin_array();
+                while (params.next_element()) {
+                    content_change c{false, 0, 0, 0, 0, ""};
+
+                    params.begin_object();
+                    while (params.next_key(key)) {
+                        if (key == "range" && params.peek() == json_type::object_t)
+                            c.ranged = read_range(params, c);
+                        else if (key == "text")
+                            params.string(c.text);
+                        else
+                            params.skip();
+                    }
+
+                    changes.push_back(std::move(c));
+                }
+            } else {
+                params.skip();
+            }
+        }
+
+        if (!params.ok() || uri.empty())
+            return;
+
+        std::string path = uri2path(uri);
+        clang::unsaved_buffer_shared buffer;
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+
+            auto it = mDocuments.find(path);
+            if (it == mDocuments.end())
+                return;
+
+            document& doc = it->second;
+            for (auto &c : changes) {
+                if (!c.ranged) {
+                    doc.text = clang::unsaved_buffer::copy(c.text.data(), c.text.size());
+                } else {
+                    // later changes refer to the content after the earlier ones
+                    uint32_t begin = lsp_offset(*doc.lines, c.start_line, c.start_character);
+                    uint32_t end = lsp_offset(*doc.lines, c.end_line, c.end_character);
+                    if (end < begin)
+                        std::swap(begin, end);
+
+                    const char* old = doc.text->data();
+                    uint32_t size = doc.text->size() - (end - begin) + c.text.size();
+
+                    char* data = new char[size+1];
+                    memcpy(data, old, begin);
+                    memcpy(data+begin, c.text.data(), c.text.size());
+                    memcpy(data+begin+c.text.size(), old+end, doc.text->size() - end);
+                    data[size] = '\0';
+
+                    doc.text = clang::unsaved_buffer::adopt(data, size);
+                }
+
+                doc.lines = std::make_shared<clang::line_index>(doc.text);
+            }
+
+            buffer = doc.text;
+        }
+
+        mTool.index_touch_unsaved(path.c_str(), buffer);
+    }
+
+    void server::close(json_reader& params) {
+        std::string path;
+        if (!read_document(params, path))
+            return;
+
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            mDocuments.erase(path);
+        }
+
+        // units including the file see its content on disk again
+        mTool.index_remove(path.c_str());
+        mTool.index_discard_unsaved(path.c_str());
+    }
+
+    void server::cancel(json_reader& params) {
+        std::string key, id;
+
+        params.begin_object();
+        while (params.next_key(key)) {
+            const char* begin = nullptr;
+            size_t size = 0;
+
+            if (key == "id" && params.span(begin, size))
+                id.assign(begin, size);
+            else if (key != "id")
+                params.skip();
+        }
+
+        // libclang cannot be interrupted, requests which already run finish but are not answered
+        std::lock_guard<std::mutex> l(mMutex);
+        auto it = mPending.find(id);
+        if (it != mPending.end())
+            it->second = true;
+    }
+
+    void server::queue(const std::string& id, std::function<void(json_writer& w)> result) {
+        {
+            std::lock_guard<std::mutex> l(mMutex);
+            mPending[id] = false;
+        }
+
+        mJobs.push([this, id, result]{
+            auto cancelled = [this, &id]{
+                std::lock_guard<std::mutex> l(mMutex);
+                return mPending[id];
+            };
+
+            json_writer w;
+            if (!cancelled()) {
+                w.begin_object().key("jsonrpc").string("2.0").key("id").raw(id).key("result");
+                result(w);
+                w.end_object();
+            }
+
+            bool skipped;
+            {
+                std::lock_guard<std::mutex> l(mMutex);
+                skipped = mPending[id];
+                mPending.erase(id);
+            }
+
+            if (skipped)
+                error(id, request_cancelled, "Request cancelled");
+            else
+                send(w);
+        });
+    }
+
+    void server::error(const std::string& id, int64_t code, const char* message) {
+        json_writer w;
+        w.begin_object().key("jsonrpc").string("2.0").key("id").raw(id.empty() ? "null" : id)
+            .key("error").begin_object().key("code").number(code).key("message").string(message).end_object()
+        .end_object();
+
+        send(w);
+    }
+
+    clang::line_index_shared server::lines(const std::string& path) {
+        std::lock_guard<std::mutex> l(mMutex);
+
+        auto doc = mDocuments.find(path);
+        if (doc != mDocuments.end())
+            return doc->second.lines;
+
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return nullptr;
+
+        auto it = mFiles.find(path);
+        if (it != mFiles.end() && it->second.first == st.st_mtime)
+            return it->second.second;
+
+        clang::unsaved_buffer_shared buffer = clang::unsaved_buffer::map(path.c_str());
+        if (!buffer)
+            return nullptr;
+
+        if (mFiles.size() >= file_cache_size)
+            mFiles.clear();
+
+        auto ret = std::make_shared<const clang::line_index>(buffer);
+        mFiles[path] = std::make_pair(st.st_mtime, ret);
+        return ret;
+    }
+
+    void server::position(json_writer& w, const clang::line_index_shared& lines, uint32_t row, uint32_t col) {
+        uint32_t line = row ? row - 1 : 0;
+        uint32_t character = col ? col - 1 : 0;
+
+        if (lines && row)
+            character = lines->utf16_column(row, col) - 1;
+
+        w.begin_object().key("line").number(line).key("character").number(character).end_object();
+    }
+
+    void server::symbol(json_writer& w, const clang::ast_element& e, const clang::line_index_shared& lines) {
+        int64_t kind = symbol_kind(e.cursor);
+        if (!kind || e.name.empty())
+            return;
+
+        w.begin_object().key("name").string(e.name).key("kind").number(kind);
+
+        if (!e.type.empty())
+            w.key("detail").string(e.type);
+
+        // only the location is known, both ranges are empty
+        for (const char* range : {"range", "selectionRange"}) {
+            w.key(range).begin_object().key("start");
+            position(w, lines, e.loc.row, e.loc.col);
+            w.key("end");
+            position(w, lines, e.loc.row, e.loc.col);
+            w.end_object();
+        }
+
+        if (!e.children.empty()) {
+            w.key("children").begin_array();
+            for (auto &c : e.children) {
+                symbol(w, c, lines);
+            }
+            w.end_array();
+        }
+
+        w.end_object();
+    }
+
+    void server::publish(const std::string& path, const std::vector<clang::diagnostic>& added,
+        const std::vector<clang::diagnostic>& removed)
+    {
+        std::lock_guard<std::mutex> l(mDiagnosticsMutex);
+
+        auto &current = mDiagnostics[path];
+        for (auto &d : removed) {
+            current.erase(clang::diagnostic_key(d));
+        }
+
+        for (auto &d : added) {
+            current[clang::diagnostic_key(d)] = d;
+        }
+
+        // LSP replaces all diagnostics of a document, only those located in it are sent
+        std::vector<const clang::diagnostic*> list;
+        for (auto &d : current) {
+            if (d.second.loc.file == path || d.second.loc.file.empty())
+                list.push_back(&d.second);
+        }
+
+        std::sort(list.begin(), list.end(), [](const clang::diagnostic* a, const clang::diagnostic* b) {
+            return a->loc.row < b->loc.row || (a->loc.row == b->loc.row && a->loc.col < b->loc.col);
+        });
+
+        clang::line_index_shared lines = this->lines(path);
+
+        json_writer w;
+        w.begin_object().key("jsonrpc").string("2.0").key("method").string("textDocument/publishDiagnostics")
+            .key("params").begin_object().key("uri").string(path2uri(path)).key("diagnostics").begin_array();
+
+        for (auto d : list) {
+            w.begin_object().key("range").begin_object().key("start");
+            position(w, lines, d->loc.row, d->loc.col);
+            w.key("end");
+            position(w, lines, d->loc.row, d->loc.col);
+            w.end_object()
+                .key("severity").number(lsp_severity(d->severity))
+                .key("source").string("clang")
+                .key("message").string(d->summary.empty() ? d->text : d->summary)
+            .end_object();
+        }
+
+        w.end_array().end_object().end_object();
+
+        if (current.empty())
+            mDiagnostics.erase(path);
+
+        send(w);
+    }
+}
+
+/**
+ * Language server for clang::tool on stdin / stdout
+ *
+ * Usage: clang_tool_lsp [--threads=N]. Supports incremental document sync, completion,
+ * go to definition, document symbols, pushed diagnostics and $/cancelRequest. Positions
+ * are UTF-16 based, as required by the protocol. Default compiler arguments can be
+ * passed as initializationOptions.arguments.
+ */
+int main(int argc, char** argv) {
+    uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--threads=", 10) == 0)
+            threads = std::max(1ul, strtoul(argv[i]+10, nullptr, 10));
+    }
+
+    // a client going away must not kill us in the middle of a write
+    signal(SIGPIPE, SIG_IGN);
+
+    server s(threads);
+    return s.run();
+}
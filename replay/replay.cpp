@@ -0,0 +1,222 @@
+/**
+* @file replay/replay.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "clang_tool.hpp"
+#include "clang_session_log.hpp"
+
+namespace {
+    /// Latencies of all replayed operations in nanoseconds
+    clang::histogram latencies[static_cast<uint32_t>(clang::session_op::count)];
+
+    /** Returns the i-th string of r, or an empty string */
+    const char* str(const clang::session_record& r, size_t i) {
+        return i < r.strings.size() ? r.strings[i].c_str() : "";
+    }
+
+    /** Returns the i-th value of r, or 0 */
+    uint32_t val(const clang::session_record& r, size_t i) {
+        return i < r.values.size() ? r.values[i] : 0;
+    }
+
+    /** Executes a single record, index is the prefix saved indexes are redirected to */
+    void execute(clang::tool& tool, const clang::session_record& r, const std::string& index) {
+        using clang::session_op;
+
+        switch (r.op) {
+            case session_op::arguments_set:
+            case session_op::arguments_set_file: {
+                size_t first = r.op == session_op::arguments_set ? 0 : 1;
+                std::vector<const char*> args;
+
+                for (size_t i = first; i < r.strings.size(); ++i) {
+                    args.push_back(r.strings[i].c_str());
+                }
+
+                if (first)
+                    tool.arguments_set(str(r, 0), args.data(), args.size());
+                else
+                    tool.arguments_set(args.data(), args.size());
+            } break;
+            case session_op::arguments_load:
+                tool.arguments_load(str(r, 0));
+                break;
+            case session_op::index_save:
+                tool.index_save(index.c_str());
+                break;
+            case session_op::index_load:
+                tool.index_load(index.c_str());
+                break;
+            case session_op::index_clear:
+                tool.index_clear();
+                break;
+            case session_op::index_touch:
+                tool.index_touch(str(r, 0));
+                break;
+            case session_op::index_add:
+                tool.index_add(str(r, 0));
+                break;
+            case session_op::index_touch_unsaved:
+                if (r.strings.size() > 1)
+                    tool.index_touch_unsaved(str(r, 0), r.strings[1].data(), r.strings[1].size());
+                break;
+            case session_op::index_remove:
+                tool.index_remove(str(r, 0));
+                break;
+            case session_op::index_discard_unsaved:
+                tool.index_discard_unsaved(str(r, 0));
+                break;
+            case session_op::tu_ast:
+                tool.tu_ast(str(r, 0));
+                break;
+            case session_op::tu_tokens:
+                tool.tu_tokens(str(r, 0), val(r, 0), val(r, 1));
+                break;
+            case session_op::tu_diagnose:
+                tool.tu_diagnose(str(r, 0));
+                break;
+            case session_op::workspace_diagnose:
+                tool.workspace_diagnose();
+                break;
+            case session_op::cursor_complete:
+                tool.cursor_complete(str(r, 0), val(r, 0), val(r, 1));
+                break;
+            case session_op::cursor_type:
+                tool.cursor_type(str(r, 0), val(r, 0), val(r, 1));
+                break;
+            case session_op::cursor_declaration:
+                tool.cursor_declaration(str(r, 0), val(r, 0), val(r, 1));
+                break;
+            case session_op::cursor_definition:
+                tool.cursor_definition(str(r, 0), val(r, 0), val(r, 1));
+                break;
+            case session_op::cursor_info:
+                tool.cursor_info(str(r, 0), val(r, 0), val(r, 1));
+                break;
+            case session_op::cursor_batch: {
+                std::vector<clang::cursor_query> queries;
+
+                for (size_t i = 0; i + 2 < r.values.size(); i += 3) {
+                    queries.push_back(clang::cursor_query{r.values[i], r.values[i+1], r.values[i+2]});
+                }
+
+                tool.cursor_batch(str(r, 0), queries);
+            } break;
+            case session_op::count:
+                break;
+        }
+    }
+}
+
+/**
+ * Replays a log recorded with tool::record_start
+ *
+ * Usage: clang_tool_replay <log> [--speed=original|max]. At original speed each call is
+ * issued at the time it was recorded, unless the previous one is still running. Saved
+ * indexes are written to a temporary directory instead of their original location. Prints
+ * one JSON object per line, like the benchmark.
+ */
+int main(int argc, char** argv) {
+    const char* log = nullptr;
+    bool max = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--speed=max") == 0)
+            max = true;
+        else if (strcmp(argv[i], "--speed=original") == 0)
+            max = false;
+        else if (strncmp(argv[i], "--", 2) != 0)
+            log = argv[i];
+    }
+
+    clang::session_reader reader;
+    if (!log || !reader.open(log)) {
+        std::cerr << "Usage: " << argv[0] << " <log> [--speed=original|max]" << std::endl;
+        return 1;
+    }
+
+    char tmp[] = "/tmp/clang_tool_replay_XXXXXX";
+    if (!mkdtemp(tmp)) {
+        std::cerr << "Unable to create index directory" << std::endl;
+        return 1;
+    }
+
+    std::string dir(tmp);
+    uint64_t records = 0;
+    uint64_t late = 0;
+    uint64_t wall = 0;
+
+    {
+        clang::tool tool;
+        clang::session_record r;
+
+        auto start = std::chrono::steady_clock::now();
+        while (reader.next(r)) {
+            auto scheduled = start + std::chrono::microseconds(r.time);
+
+            if (!max) {
+                auto now = std::chrono::steady_clock::now();
+                if (now < scheduled)
+                    std::this_thread::sleep_until(scheduled);
+                else
+                    late += std::chrono::duration_cast<std::chrono::microseconds>(now - scheduled).count();
+            }
+
+            auto begin = std::chrono::steady_clock::now();
+            execute(tool, r, dir+"/index_");
+            auto end = std::chrono::steady_clock::now();
+
+            latencies[static_cast<uint32_t>(r.op)].record(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()
+            );
+            ++records;
+        }
+
+        wall = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::cout << "{\"config\":{\"log\":\"" << log << "\",\"speed\":\"" << (max ? "max" : "original")
+              << "\",\"records\":" << records << ",\"wall_us\":" << wall << ",\"late_us\":" << late << "}}" << std::endl;
+
+    for (uint32_t i = 0; i < static_cast<uint32_t>(clang::session_op::count); ++i) {
+        const clang::histogram& h = latencies[i];
+        if (!h.count())
+            continue;
+
+        std::cout << "{\"op\":\"" << clang::session2str(static_cast<clang::session_op>(i)) << "\",\"count\":" << h.count()
+                  << ",\"mean_us\":" << h.sum() / h.count() / 1000.0
+                  << ",\"p50_us\":" << h.percentile(50) / 1000.0
+                  << ",\"p90_us\":" << h.percentile(90) / 1000.0
+                  << ",\"p99_us\":" << h.percentile(99) / 1000.0
+                  << ",\"max_us\":" << h.max() / 1000.0 << "}" << std::endl;
+    }
+
+    std::string cmd = "rm -rf '"+dir+"'";
+    return system(cmd.c_str()) == 0 ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+/**
+* @file test/compilation_database.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "clang_compilation_database.hpp"
+#include "test.hpp"
+
+namespace {
+    /** Returns true if args contains arg */
+    bool contains(const std::vector<std::string>& args, const std::string& arg) {
+        return std::find(args.begin(), args.end(), arg) != args.end();
+    }
+}
+
+TEST_CASE(compilation_database_output) {
+    std::string dir = test::temp_dir();
+    std::ofstream(dir + "/compile_commands.json")
+        << "[{\"directory\":\"" << dir << "\",\"file\":\"main.cpp\",\"command\":"
+        << "\"clang++ -c -o main.o -omain2.o -order_file order.txt -objcmt-migrate-literals -DX main.cpp\"}]";
+
+    clang::compilation_database db;
+    CHECK(db.load(dir.c_str()) == 1);
+
+    const std::vector<std::string>& args = db.find(dir + "/main.cpp")->args();
+
+    // output and input are dropped
+    CHECK(!contains(args, "-c"));
+    CHECK(!contains(args, "-o"));
+    CHECK(!contains(args, "main.o"));
+    CHECK(!contains(args, "-omain2.o"));
+    CHECK(!contains(args, "main.cpp"));
+
+    // unrelated options starting with -o are kept
+    CHECK(contains(args, "-order_file"));
+    CHECK(contains(args, "order.txt"));
+    CHECK(contains(args, "-objcmt-migrate-literals"));
+    CHECK(contains(args, "-DX"));
+}
+
+TEST_CASE(compilation_database_paths) {
+    std::string dir = test::temp_dir();
+    std::ofstream(dir + "/compile_commands.json")
+        << "[{\"directory\":\"" << dir << "\",\"file\":\"main.cpp\",\"command\":"
+        << "\"clang++ -Iinc -I other -include-pch pre.pch -include pre.h -isystem-after sys main.cpp\"}]";
+
+    clang::compilation_database db;
+    CHECK(db.load(dir.c_str()) == 1);
+
+    const std::vector<std::string>& args = db.find(dir + "/main.cpp")->args();
+
+    // joined and separate paths are made absolute
+    CHECK(contains(args, "-I" + dir + "/inc"));
+    CHECK(contains(args, dir + "/other"));
+    CHECK(contains(args, dir + "/pre.h"));
+
+    // -include-pch is not -include joined with "-pch"
+    CHECK(contains(args, "-include-pch"));
+    CHECK(contains(args, dir + "/pre.pch"));
+    CHECK(!contains(args, "-include" + dir + "/-pch"));
+
+    // unknown options sharing a prefix are left alone
+    CHECK(contains(args, "-isystem-after"));
+}
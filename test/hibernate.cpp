@@ -0,0 +1,68 @@
+/**
+* @file test/hibernate.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <clang-c/Index.h>
+
+#include "clang_translation_unit.hpp"
+#include "test.hpp"
+
+TEST_CASE(hibernate_edit_query) {
+    std::string dir = test::temp_dir();
+    std::string path = dir + "/main.cpp";
+    std::ofstream(path.c_str()) << "int first();\nint main() { return first(); }\n";
+
+    CXIndex idx = clang_createIndex(0, 0);
+    clang::argument_set_shared args = std::make_shared<const clang::argument_set>(
+        std::vector<std::string>{"-x", "c++"});
+
+    {
+        clang::translation_unit unit(clang::translation_unit::parse(idx, path, *args, nullptr),
+            path, args, nullptr, clang::parse_tier::full, idx);
+
+        CHECK(unit.hibernate(idx, dir + "/main.unit"));
+        CHECK(unit.hibernated());
+
+        // the loaded unit has no compiler invocation, the edit must parse it from source
+        std::string edit = "int second();\nint main() { return second(); }\n";
+        unit.set_unsaved(edit.c_str(), edit.size());
+
+        CHECK(!unit.hibernated());
+        CHECK(unit.diagnostics()->empty());
+        CHECK(!unit.complete_at(2, 21).empty());
+    }
+
+    {
+        clang::translation_unit unit(clang::translation_unit::parse(idx, path, *args, nullptr),
+            path, args, nullptr, clang::parse_tier::full, idx);
+
+        // completing right after waking works without a reparse in between
+        CHECK(unit.hibernate(idx, dir + "/main2.unit"));
+        CHECK(!unit.complete_at(2, 21).empty());
+    }
+
+    clang_disposeIndex(idx);
+}
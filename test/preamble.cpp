@@ -0,0 +1,96 @@
+/**
+* @file test/preamble.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <clang-c/Index.h>
+
+#include "clang_compilation_database.hpp"
+#include "clang_preamble.hpp"
+#include "clang_preamble_cache.hpp"
+#include "clang_unsaved_overlay.hpp"
+#include "test.hpp"
+
+namespace {
+    /** Builds a shared preamble from region for a source in dir, a.h contains header */
+    bool build_with(const std::string& dir, const std::string& header,
+        const std::string& region = "#include \"a.h\"\n")
+    {
+        std::ofstream(dir + "/a.h") << header;
+
+        CXIndex idx = clang_createIndex(0, 0);
+        clang::argument_set args({"-x", "c++"});
+        clang::shared_preamble p(dir + "/a.pch");
+
+        bool ret = p.build(idx, region, dir + "/main.cpp", args);
+
+        clang_disposeIndex(idx);
+        return ret;
+    }
+
+    /** Returns a snapshot with a.h in dir set to header */
+    clang::unsaved_files_shared header_snapshot(const std::string& dir, const std::string& header) {
+        auto ret = std::make_shared<clang::unsaved_files>();
+        ret->version = 0;
+        ret->entries.push_back(std::make_pair(dir + "/a.h", clang::unsaved_buffer::copy(header.c_str(), header.size())));
+        return ret;
+    }
+}
+
+TEST_CASE(preamble_guarded_headers) {
+    std::string dir = test::temp_dir();
+
+    CHECK(build_with(dir, "#ifndef A_H\n#define A_H\nstruct a {};\n#endif\n"));
+    CHECK(build_with(dir, "#pragma once\nstruct a {};\n"));
+}
+
+TEST_CASE(preamble_unguarded_headers) {
+    std::string dir = test::temp_dir();
+
+    // included again by the unit itself, this would redefine struct a
+    CHECK(!build_with(dir, "struct a {};\n"));
+
+    // X-macro headers are meant to be included several times
+    CHECK(!build_with(dir, "X(first)\nX(second)\n", "#define X(name) int name;\n#include \"a.h\"\n"));
+}
+
+TEST_CASE(preamble_key_unsaved_headers) {
+    std::string dir = test::temp_dir();
+    std::string path = dir + "/main.cpp";
+    std::ofstream(dir + "/a.h") << "int a;\n";
+    std::ofstream(path.c_str()) << "#include \"a.h\"\nint main() { return a; }\n";
+
+    CXIndex idx = clang_createIndex(0, 0);
+    const char* args[] = {"-x", "c++"};
+    CXTranslationUnit unit = clang_parseTranslationUnit(idx, path.c_str(), args, 2, nullptr, 0, CXTranslationUnit_None);
+    CHECK(unit != nullptr);
+
+    // same content in a different buffer keeps the key, other content changes it
+    std::string first = clang::preamble_key_from_unit(unit, path, nullptr, header_snapshot(dir, "int a;\n")).hash;
+    CHECK(clang::preamble_key_from_unit(unit, path, nullptr, header_snapshot(dir, "int a;\n")).hash == first);
+    CHECK(clang::preamble_key_from_unit(unit, path, nullptr, header_snapshot(dir, "int b;\n")).hash != first);
+
+    clang_disposeTranslationUnit(unit);
+    clang_disposeIndex(idx);
+}
@@ -0,0 +1,66 @@
+/**
+* @file test/session_log.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <fstream>
+#include <string>
+#include <cstdint>
+
+#include "clang_session_log.hpp"
+#include "test.hpp"
+
+namespace {
+    /** Writes value as is, like the recorder */
+    template <typename T>
+    void write(std::ofstream& out, T value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    /** Returns true if a log with a single record of count strings, the first one length bytes, can be read */
+    bool read_record(uint32_t count, uint32_t length) {
+        std::string path = test::temp_dir() + "/session.log";
+
+        {
+            std::ofstream out(path.c_str(), std::ofstream::out | std::ofstream::binary);
+            out.write("CTSL", 4);
+            write<uint32_t>(out, clang::session_recorder::version);
+
+            write<uint8_t>(out, 0);
+            write<uint64_t>(out, 0);
+            write<uint32_t>(out, count);
+            write<uint32_t>(out, length);
+            out << std::string(length < 16 ? length : 16, 'x');
+            write<uint32_t>(out, 0);
+        }
+
+        clang::session_reader reader;
+        clang::session_record record;
+        return reader.open(path.c_str()) && reader.next(record);
+    }
+}
+
+TEST_CASE(session_log_corrupt_counts) {
+    CHECK(read_record(1, 4));
+
+    // must fail without trying to allocate the claimed sizes
+    CHECK(!read_record(0xFFFFFFFF, 4));
+    CHECK(!read_record(1, 0xFFFFFFFF));
+}
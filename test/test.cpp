@@ -0,0 +1,85 @@
+/**
+* @file test/test.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdlib>
+#include <cstdint>
+
+#include "test.hpp"
+
+namespace test {
+    std::vector<std::pair<const char*, std::function<void()>>>& cases() {
+        static std::vector<std::pair<const char*, std::function<void()>>> ret;
+        return ret;
+    }
+
+    uint32_t& failures() {
+        static uint32_t ret = 0;
+        return ret;
+    }
+
+    registrar::registrar(const char* name, std::function<void()> fn) {
+        cases().push_back(std::make_pair(name, std::move(fn)));
+    }
+
+    void fail(const char* file, int line, const char* expr) {
+        std::cerr << file << ":" << line << ": check failed: " << expr << std::endl;
+        ++failures();
+    }
+
+    std::string temp_dir() {
+        char tmp[] = "/tmp/clang_tool_test_XXXXXX";
+        if (!mkdtemp(tmp)) {
+            std::cerr << "Unable to create temporary directory" << std::endl;
+            exit(1);
+        }
+
+        return tmp;
+    }
+}
+
+/**
+ * Runs all test cases, or those whose name starts with the first argument
+ *
+ * Returns non-zero if any check failed.
+ */
+int main(int argc, char** argv) {
+    std::string filter = argc > 1 ? argv[1] : "";
+    uint32_t run = 0;
+
+    for (auto &c : test::cases()) {
+        if (std::string(c.first).compare(0, filter.size(), filter) != 0)
+            continue;
+
+        uint32_t before = test::failures();
+        c.second();
+        ++run;
+
+        std::cout << (test::failures() == before ? "ok   " : "FAIL ") << c.first << std::endl;
+    }
+
+    std::cout << run << " cases, " << test::failures() << " failed checks" << std::endl;
+    return test::failures() ? 1 : 0;
+}
@@ -0,0 +1,53 @@
+/**
+* @file test/test.hpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#ifndef _RD_TEST_HPP_
+#define _RD_TEST_HPP_
+
+#include <string>
+#include <functional>
+#include <cstdint>
+
+namespace test {
+    /** Registers a test case at static initialization */
+    struct registrar {
+        registrar(const char* name, std::function<void()> fn);
+    };
+
+    /** Reports a failed check */
+    void fail(const char* file, int line, const char* expr);
+
+    /** Creates a fresh directory below /tmp and returns its path */
+    std::string temp_dir();
+}
+
+/// Defines a test case, name has to be a valid identifier
+#define TEST_CASE(name) \
+    static void test_##name(); \
+    static test::registrar registrar_##name(#name, test_##name); \
+    static void test_##name()
+
+/// Records a failure if expr is false, the case continues
+#define CHECK(expr) \
+    do { if (!(expr)) test::fail(__FILE__, __LINE__, #expr); } while (0)
+
+#endif /* _RD_TEST_HPP_ */
@@ -0,0 +1,66 @@
+/**
+* @file test/tokens.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <clang-c/Index.h>
+
+#include "clang_translation_unit.hpp"
+#include "test.hpp"
+
+namespace {
+    /** Returns the cursor kind of the token at offset, or 0 */
+    uint16_t cursor_at(const std::vector<clang::token>& tokens, uint32_t offset) {
+        for (auto &t : tokens) {
+            if (t.offset == offset)
+                return t.cursor;
+        }
+
+        return 0;
+    }
+}
+
+TEST_CASE(tokens_moved_line) {
+    std::string dir = test::temp_dir();
+    std::string path = dir + "/main.cpp";
+    std::ofstream(path.c_str()) << "struct a {\n  int f;\n};\nint g;\n";
+
+    CXIndex idx = clang_createIndex(0, 0);
+    clang::argument_set args({"-x", "c++"});
+
+    {
+        clang::translation_unit unit(clang::translation_unit::parse(idx, path, args, nullptr), path);
+        CHECK(cursor_at(unit.tokens(1, 4), 17) == CXCursor_FieldDecl);
+
+        // same text on another row but now a variable, the old annotation must not be reused
+        std::string edit = "  int f;\nint g;\n";
+        unit.set_unsaved(edit.c_str(), edit.size());
+
+        std::vector<clang::token> tokens = unit.tokens(1, 2);
+        CHECK(cursor_at(tokens, 6) == CXCursor_VarDecl);
+        CHECK(cursor_at(tokens, 13) == CXCursor_VarDecl);
+    }
+
+    clang_disposeIndex(idx);
+}
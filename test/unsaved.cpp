@@ -0,0 +1,93 @@
+/**
+* @file test/unsaved.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "clang_tool.hpp"
+#include "clang_translation_unit.hpp"
+#include "clang_unsaved_buffer.hpp"
+#include "clang_unsaved_overlay.hpp"
+#include "test.hpp"
+
+TEST_CASE(unsaved_missing_file) {
+    std::string path = test::temp_dir() + "/missing.cpp";
+    clang::tool tool;
+
+    clang::unsaved_buffer_shared buffer = clang::unsaved_buffer::map(path.c_str());
+    CHECK(!buffer);
+
+    // must behave like discarding unsaved content, not dereference the buffer
+    tool.index_touch_unsaved(path.c_str(), buffer);
+    CHECK(tool.index_status().empty());
+}
+
+TEST_CASE(unsaved_null_discards) {
+    std::string dir = test::temp_dir();
+    std::string path = dir + "/main.cpp";
+    std::ofstream(path.c_str()) << "int main() { return 0; }\n";
+
+    clang::tool tool;
+    tool.index_touch(path.c_str());
+
+    std::string broken = "int main() { return }\n";
+    tool.index_touch_unsaved(path.c_str(), broken.c_str(), broken.size());
+    CHECK(!tool.tu_diagnose(path.c_str()).empty());
+
+    // back to the content on disk, which compiles cleanly
+    tool.index_touch_unsaved(path.c_str(), clang::unsaved_buffer_shared());
+    CHECK(tool.tu_diagnose(path.c_str()).empty());
+}
+
+TEST_CASE(unsaved_completion_keeps_overlay_version) {
+    std::string dir = test::temp_dir();
+    std::string header = dir + "/first.h";
+    std::string path = dir + "/main.cpp";
+    std::ofstream(header.c_str()) << "int first();\n";
+    std::ofstream(path.c_str()) << "#include \"first.h\"\nint main() { return first(); }\n";
+
+    CXIndex idx = clang_createIndex(0, 0);
+    clang::unsaved_overlay overlay;
+    clang::argument_set_shared args = std::make_shared<const clang::argument_set>(
+        std::vector<std::string>{"-x", "c++"});
+
+    {
+        clang::translation_unit unit(clang::translation_unit::parse(idx, path, *args, overlay.snapshot()),
+            path, args, &overlay);
+        CHECK(unit.diagnostics()->empty());
+
+        // header edit lands between the overlay change and the dependent reparse
+        std::string edit = "int second();\n";
+        overlay.set(header, clang::unsaved_buffer::copy(edit.c_str(), edit.size()));
+        unit.complete_at(2, 21);
+
+        // completion must not claim the unit is up to date, or reparse_dependents skips it
+        CHECK(unit.overlay_version() != overlay.version());
+        unit.refresh();
+        CHECK(unit.overlay_version() == overlay.version());
+        CHECK(!unit.diagnostics()->empty());
+    }
+
+    clang_disposeIndex(idx);
+}
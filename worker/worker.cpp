@@ -0,0 +1,50 @@
+/**
+* @file worker/worker.cpp
+* @author Robin Dietrich <me (at) invokr (dot) org>
+* @version 1.0
+*
+* @par License
+*   clang-tool
+*   Copyright 2015 Robin Dietrich
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include <iostream>
+#include <cstdlib>
+#include <csignal>
+
+#include "clang_tool.hpp"
+#include "clang_worker_pool.hpp"
+
+/**
+ * Worker process of clang::worker_pool
+ *
+ * Usage: clang_tool_worker <fd>. Answers requests on the socket fd until the pool closes
+ * it, the pool passes clang::worker_pool::worker_fd. Not meant to be started by hand.
+ */
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <fd>" << std::endl;
+        return 1;
+    }
+
+    // the signal mask survives exec, the client may block signals for a handling thread
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, nullptr);
+
+    clang::tool t;
+    t.serve(atoi(argv[1]));
+    return 0;
+}